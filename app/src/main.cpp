@@ -25,6 +25,7 @@
 #include <optional>
 
 #include <charconv>
+#include <iterator>
 #include <cstdio>
 
 #include <fmt/format.h>
@@ -85,6 +86,13 @@ show_context(const efyj::context& ctx) noexcept
                    ctx.line,
                    ctx.column);
         break;
+    case efyj::status::dataset_format_error:
+    case efyj::status::dataset_model_mismatch:
+        fmt::print(stderr,
+                   "dataset error {} - {}\n",
+                   get_error_message(ctx.status),
+                   ctx.data_1);
+        break;
     case efyj::status::extract_option_same_input_files:
         fmt::print(stderr, "{}\n", get_error_message(ctx.status));
         break;
@@ -126,10 +134,16 @@ usage()
       "DEXi file (need 1 csv, 2 dexi\n"
       "    -p/--prediction      Compute prediction\n"
       "    -a/--adjustement     Compute adjustment\n"
-      "    -e/--evaluate        Compulte evalaution\n"
+      "    -e/--evaluate        Compulte evalaution (reads the csv from "
+      "the standard input without csv file)\n"
+      "    --convert            Convert the csv file into a binary dataset "
+      "(need 1 csv, 1 dexi, 1 efyj)\n"
       "    --without-reduce     Without the reduce models generator "
       "algorithm\n"
       "    -l/--limit integer   Limit of computation\n"
+      "    -t/--top integer     Number of results kept per adjustment step\n"
+      "    --order string       Lines enumeration order: table (default), "
+      "hits or kappa\n"
       "    -j/--jobs thread     Use threads [int]\n"
       "    ...                  DEXi and CSV files\n"
       "\n");
@@ -205,13 +219,153 @@ merge(efyj::context& ctx,
     return EXIT_SUCCESS;
 }
 
+static int
+convert(efyj::context& ctx,
+        const std::string& model,
+        const std::string& option,
+        const std::string& output)
+{
+    if (const auto ret =
+          efyj::convert_options_to_file(ctx, model, option, output);
+        efyj::is_bad(ret)) {
+        fmt::print(stderr,
+                   "Fail to convert {} with {} into {}\n",
+                   option,
+                   model,
+                   output);
+        show_context(ctx);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+struct stream_output
+{
+    fmt::memory_buffer buffer;
+    size_t rows = 0;
+    double linear_weighted_kappa = 0.0;
+    double squared_weighted_kappa = 0.0;
+};
+
+static size_t
+read_file(char* buffer, size_t size, void* user_data)
+{
+    return std::fread(buffer, 1, size, static_cast<std::FILE*>(user_data));
+}
+
+static bool
+write_block(const efyj::evaluation_block& block, void* user_data)
+{
+    auto* out = static_cast<stream_output*>(user_data);
+    auto it = std::back_inserter(out->buffer);
+    const bool have_places = !block.places.empty();
+
+    out->buffer.clear();
+    for (size_t i = 0, e = block.size(); i != e; ++i)
+        fmt::format_to(it,
+                       "{};{};{};{};{};{}\n",
+                       block.identifiers[i],
+                       have_places ? std::string_view(block.places[i])
+                                   : std::string_view(),
+                       block.departments[i],
+                       block.years[i],
+                       block.observations[i],
+                       block.simulations[i]);
+
+    std::fwrite(out->buffer.data(), 1, out->buffer.size(), stdout);
+
+    out->rows = block.total_rows;
+    out->linear_weighted_kappa = block.linear_weighted_kappa;
+    out->squared_weighted_kappa = block.squared_weighted_kappa;
+
+    return true;
+}
+
+static bool
+write_values(const efyj::evaluation_block& block, void* user_data)
+{
+    auto* out = static_cast<stream_output*>(user_data);
+    auto it = std::back_inserter(out->buffer);
+
+    out->buffer.clear();
+    for (size_t i = 0, e = block.size(); i != e; ++i)
+        fmt::format_to(
+          it, "{};{}\n", block.observations[i], block.simulations[i]);
+
+    std::fwrite(out->buffer.data(), 1, out->buffer.size(), stdout);
+
+    out->rows = block.total_rows;
+    out->linear_weighted_kappa = block.linear_weighted_kappa;
+    out->squared_weighted_kappa = block.squared_weighted_kappa;
+
+    return true;
+}
+
+/* Evaluates the csv read from the standard input block by block and writes
+ * the simulated values to the standard output. Messages and kappa values
+ * are written to the standard error. */
+static int
+evaluate_stream(efyj::context& ctx, const std::string& model, int threads)
+{
+    stream_output out;
+
+    fmt::print("simulation;place;department;year;observed;simulated\n");
+
+    if (const auto ret = efyj::evaluate(
+          ctx, model, read_file, stdin, write_block, &out, 4096, threads);
+        is_bad(ret)) {
+        std::fflush(stdout);
+        fmt::print(stderr, "Fail to evaluate {} with stdin\n", model);
+        show_context(ctx);
+        return EXIT_FAILURE;
+    }
+
+    std::fflush(stdout);
+    fmt::print(stderr, "rows: {}\n", out.rows);
+    fmt::print(stderr, "linear-kappa: {}\n", out.linear_weighted_kappa);
+    fmt::print(stderr, "squared-kappa: {}\n", out.squared_weighted_kappa);
+
+    return EXIT_SUCCESS;
+}
+
 static int
 evaluate(efyj::context& ctx,
          const std::string& model,
-         const std::string& option)
+         const std::string& option,
+         int threads)
 {
+    /* The csv files are evaluated by the pipeline, the binary datasets are
+     * mapped in memory and evaluated at once. */
+    if (!ends_with(option, ".efyj")) {
+        std::FILE* is = std::fopen(option.c_str(), "rb");
+        if (!is) {
+            fmt::print(stderr, "Fail to open {}\n", option);
+            return EXIT_FAILURE;
+        }
+
+        stream_output out;
+        fmt::print("observation;simulation\n");
+        std::fflush(stdout);
+
+        const auto ret = efyj::evaluate(
+          ctx, model, read_file, is, write_values, &out, 4096, threads);
+        std::fclose(is);
+
+        if (is_bad(ret)) {
+            fmt::print(stderr, "Fail to evaluate {} with {}\n", model, option);
+            show_context(ctx);
+            return EXIT_FAILURE;
+        }
+
+        fmt::print("linear-kappa: {}\n", out.linear_weighted_kappa);
+        fmt::print("squared-kappa: {}\n", out.squared_weighted_kappa);
+
+        return EXIT_SUCCESS;
+    }
+
     efyj::evaluation_results out;
-    if (const auto ret = efyj::evaluate(ctx, model, option, out);
+    if (const auto ret = efyj::evaluate(ctx, model, option, out, threads);
         is_bad(ret)) {
         fmt::print(stderr, "Fail to evaluate {} with {}\n", model, option);
         show_context(ctx);
@@ -260,6 +414,15 @@ update_result(const efyj::result& r, void* /*user_data*/)
 
     fmt::print("\n");
 
+    for (auto& alt : r.alternatives) {
+        fmt::print("  {:13.10g};", alt.kappa);
+
+        for (auto& elem : alt.modifiers)
+            fmt::print("{}-{}-{};", elem.attribute, elem.line, elem.value);
+
+        fmt::print("\n");
+    }
+
     return true;
 }
 
@@ -269,7 +432,9 @@ adjustment(efyj::context& ctx,
            const std::string& option,
            bool reduce,
            int limit,
-           unsigned int thread)
+           unsigned int thread,
+           unsigned int top,
+           efyj::line_order order)
 {
     const auto ret = efyj::adjustment(ctx,
                                       model,
@@ -280,7 +445,9 @@ adjustment(efyj::context& ctx,
                                       nullptr,
                                       reduce,
                                       limit,
-                                      thread);
+                                      thread,
+                                      top,
+                                      order);
 
     if (!efyj::is_success(ret)) {
         fmt::print(
@@ -299,7 +466,8 @@ prediction(efyj::context& ctx,
            const std::string& option,
            bool reduce,
            int limit,
-           unsigned int thread)
+           unsigned int thread,
+           efyj::line_order order)
 {
     const auto ret = efyj::prediction(ctx,
                                       model,
@@ -310,7 +478,8 @@ prediction(efyj::context& ctx,
                                       nullptr,
                                       reduce,
                                       limit,
-                                      thread);
+                                      thread,
+                                      order);
 
     if (!efyj::is_success(ret)) {
         fmt::print(
@@ -331,7 +500,8 @@ enum class operation_type
     merge,
     evaluate,
     adjustment,
-    prediction
+    prediction,
+    convert
 };
 
 struct attributes
@@ -343,6 +513,8 @@ struct attributes
     operation_type type = operation_type::none;
 
     int limit = std::numeric_limits<int>::max();
+    int top = 1;
+    efyj::line_order order = efyj::line_order::table;
     bool reduce = true;
 
     bool show_version = false;
@@ -352,9 +524,9 @@ struct attributes
                            std::optional<std::string_view> arg)
     {
         if (arg)
-            fmt::print("parse long option {} arg {}\n", opt, *arg);
+            fmt::print(stderr, "parse long option {} arg {}\n", opt, *arg);
         else
-            fmt::print("parse long option {} without arg\n", opt);
+            fmt::print(stderr, "parse long option {} without arg\n", opt);
 
         bool consume_arg = false;
 
@@ -376,8 +548,14 @@ struct attributes
             type = operation_type::adjustment;
         else if (opt.compare("prediction") == 0)
             type = operation_type::prediction;
+        else if (opt.compare("convert") == 0)
+            type = operation_type::convert;
         else if (opt.compare("limit") == 0 && arg)
             consume_arg = parse_limit(*arg);
+        else if (opt.compare("top") == 0 && arg)
+            consume_arg = parse_top(*arg);
+        else if (opt.compare("order") == 0 && arg)
+            consume_arg = parse_order(*arg);
         else if (opt.compare("without-reduce") == 0)
             reduce = false;
         else
@@ -389,9 +567,9 @@ struct attributes
     bool parse_short_option(char opt, std::optional<std::string_view> arg)
     {
         if (arg)
-            fmt::print("parse short option {} arg {}\n", opt, *arg);
+            fmt::print(stderr, "parse short option {} arg {}\n", opt, *arg);
         else
-            fmt::print("parse short option {} without arg\n", opt);
+            fmt::print(stderr, "parse short option {} without arg\n", opt);
 
         bool consume_arg = false;
 
@@ -401,6 +579,8 @@ struct attributes
             show_version = true;
         else if (opt == 'j' && arg)
             consume_arg = parse_jobs(*arg);
+        else if (opt == 't' && arg)
+            consume_arg = parse_top(*arg);
         else if (opt == 'i')
             type = operation_type::info;
         else if (opt == 'x')
@@ -471,6 +651,51 @@ struct attributes
 
         return true;
     }
+
+    bool parse_top(std::string_view arg)
+    {
+        if (arg.empty()) {
+            fmt::print(stderr, "Missing argument for --top [int]\n");
+            return false;
+        }
+
+        int var;
+        if (std::from_chars(arg.data(), arg.data() + arg.size(), var).ec !=
+            std::errc()) {
+            fmt::print(stderr, "Missing argument for --top [int]\n");
+            return false;
+        }
+
+        if (var <= 0) {
+            fmt::print(stderr,
+                       "Negative or zero argument for --top [int]. Assume "
+                       "top = 1\n");
+            return true;
+        }
+
+        top = var;
+
+        return true;
+    }
+
+    bool parse_order(std::string_view arg)
+    {
+        if (arg.compare("table") == 0)
+            order = efyj::line_order::table;
+        else if (arg.compare("hits") == 0)
+            order = efyj::line_order::row_hits;
+        else if (arg.compare("kappa") == 0)
+            order = efyj::line_order::kappa_gain;
+        else {
+            fmt::print(stderr,
+                       "Unknown argument `{}' for --order [table, hits, "
+                       "kappa]\n",
+                       arg);
+            return false;
+        }
+
+        return true;
+    }
 };
 
 int
@@ -482,7 +707,7 @@ main(int argc, char* argv[])
     while (i < argc) {
         const std::string_view arg(argv[i]);
 
-        fmt::print("Param `{}`\n", arg);
+        fmt::print(stderr, "Param `{}`\n", arg);
 
         if (arg[0] == '-') {
             if (arg.size() > 1U) {
@@ -530,10 +755,13 @@ main(int argc, char* argv[])
     std::string dexifile1;
     std::string dexifile2;
     std::string csvfile;
+    std::string efyjfile;
 
     for (const auto& str : atts.optind) {
         if (ends_with(str, ".csv"))
             csvfile = str;
+        else if (ends_with(str, ".efyj"))
+            efyjfile = str;
         else if (ends_with(str, ".dxi")) {
             if (dexifile1.empty())
                 dexifile1 = str;
@@ -543,6 +771,10 @@ main(int argc, char* argv[])
             fmt::print(stderr, "unknown file type {}.\n", str);
     }
 
+    /* A binary dataset replaces the csv file except for the conversion. */
+    if (atts.type != operation_type::convert && csvfile.empty())
+        csvfile = efyjfile;
+
     efyj::context ctx;
     ctx.out = &std::cout;
     ctx.err = &std::cerr;
@@ -601,13 +833,14 @@ main(int argc, char* argv[])
     case operation_type::evaluate:
         if (dexifile1.empty())
             fmt::print(stderr, "[evaluate] missing dexi.\n");
-        else if (csvfile.empty())
-            fmt::print(stderr, "[evaluate] missing csv file.\n");
-        else {
+        else if (csvfile.empty()) {
+            ctx.out = &std::cerr;
+            ::evaluate_stream(ctx, dexifile1, atts.threads);
+        } else {
             fmt::print("Evaluate options from file `{}' into file `{}'\n",
                        dexifile1.c_str(),
                        csvfile.c_str());
-            ::evaluate(ctx, dexifile1, csvfile);
+            ::evaluate(ctx, dexifile1, csvfile, atts.threads);
         }
         break;
     case operation_type::adjustment:
@@ -619,8 +852,14 @@ main(int argc, char* argv[])
             fmt::print("Pdjustment options from file `{}' into file `{}'\n",
                        dexifile1.c_str(),
                        csvfile.c_str());
-            ::adjustment(
-              ctx, dexifile1, csvfile, atts.reduce, atts.limit, atts.threads);
+            ::adjustment(ctx,
+                         dexifile1,
+                         csvfile,
+                         atts.reduce,
+                         atts.limit,
+                         atts.threads,
+                         atts.top,
+                         atts.order);
         }
         break;
     case operation_type::prediction:
@@ -632,8 +871,27 @@ main(int argc, char* argv[])
             fmt::print("Prediction options from file `{}' into file `{}'\n",
                        dexifile1.c_str(),
                        csvfile.c_str());
-            ::prediction(
-              ctx, dexifile1, csvfile, atts.reduce, atts.limit, atts.threads);
+            ::prediction(ctx,
+                         dexifile1,
+                         csvfile,
+                         atts.reduce,
+                         atts.limit,
+                         atts.threads,
+                         atts.order);
+        }
+        break;
+    case operation_type::convert:
+        if (dexifile1.empty())
+            fmt::print(stderr, "[convert] missing dexi.\n");
+        else if (csvfile.empty())
+            fmt::print(stderr, "[convert] missing csv file.\n");
+        else if (efyjfile.empty())
+            fmt::print(stderr, "[convert] missing output efyj file.\n");
+        else {
+            fmt::print("Convert options from file `{}' into file `{}'\n",
+                       csvfile.c_str(),
+                       efyjfile.c_str());
+            ::convert(ctx, dexifile1, csvfile, efyjfile);
         }
         break;
     }
@@ -26,8 +26,12 @@
 #define EFYJ_MINOR_VERSION 6
 #define EFYJ_PATCH_VERSION 0
 
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 #include <efyj/matrix.hpp>
@@ -105,7 +109,10 @@ enum class status : int
     scale_value_inconsistent,
     option_too_many,
 
-    unknown_error
+    unknown_error,
+
+    dataset_format_error,
+    dataset_model_mismatch
 };
 
 template<typename T, typename... Args>
@@ -159,7 +166,12 @@ get_error_message(const efyj::status s) noexcept
                                  "option input inconsistent",
                                  "scale value inconsistent",
                                  "option too any",
-                                 "unknown error" };
+                                 "unknown error",
+                                 "dataset format error",
+                                 "dataset model mismatch" };
+
+    static_assert(std::size(ret) ==
+                  static_cast<size_t>(status::dataset_model_mismatch) + 1);
 
     const auto elem = static_cast<int>(s);
     const auto max_elem = std::size(ret);
@@ -210,7 +222,14 @@ struct information_results
 struct evaluation_results
 {
     matrix<value> options;
-    matrix<value> attributes;
+
+    /// Values of the aggregate attributes selected by the @c aggregates
+    /// argument of @c evaluate: one row per option, one column per
+    /// attribute named in @c attribute_names. The values of an option are
+    /// contiguous (the attributes x options matrix stored column-major).
+    matrix<std::uint8_t> attributes;
+    std::vector<std::string> attribute_names;
+
     std::vector<value> simulations;
     std::vector<value> observations;
     matrix<value> confusion;
@@ -221,6 +240,7 @@ struct evaluation_results
     {
         options.clear();
         attributes.clear();
+        attribute_names.clear();
         simulations.clear();
         observations.clear();
         confusion.clear();
@@ -229,6 +249,32 @@ struct evaluation_results
     }
 };
 
+/**
+ * @brief A block of rows evaluated by the streaming @c evaluate function.
+ *
+ * The vectors are reused from one block to the next. The confusion matrix
+ * and the kappa values accumulate all the rows read since the first block.
+ */
+struct evaluation_block
+{
+    std::vector<std::string> identifiers; ///< simulation identifiers.
+    std::vector<std::string> places;      ///< empty without place column.
+    std::vector<int> departments;
+    std::vector<int> years;
+    std::vector<value> observations;
+    std::vector<value> simulations; ///< values computed by the model.
+    matrix<value> confusion;
+    size_t first_row;  ///< index of the first row of the block.
+    size_t total_rows; ///< number of rows read since the first block.
+    double linear_weighted_kappa;
+    double squared_weighted_kappa;
+
+    size_t size() const noexcept
+    {
+        return simulations.size();
+    }
+};
+
 struct modifier
 {
     modifier() noexcept = default;
@@ -244,9 +290,23 @@ struct modifier
     int value;
 };
 
+/**
+ * @brief A candidate retained by the @c adjustment function when more than one
+ * result per step is requested.
+ */
+struct alternative
+{
+    std::vector<modifier> modifiers;
+    double kappa;
+};
+
 struct result
 {
     std::vector<modifier> modifiers;
+
+    /** The @c top best candidates of the step sorted by decreasing kappa
+     * then by enumeration order. Empty if @c top is lower than 2. */
+    std::vector<alternative> alternatives;
     double kappa;
     double time;
     unsigned long int kappa_computed;
@@ -255,6 +315,7 @@ struct result
     void clear()
     {
         modifiers.clear();
+        alternatives.clear();
         kappa = 0.0;
         time = 0.0;
         kappa_computed = 0;
@@ -291,6 +352,203 @@ struct data
     }
 };
 
+/**
+ * @brief Type of the elements of an @c array_view.
+ */
+enum class element_type : int
+{
+    uint8,
+    int32
+};
+
+/**
+ * @brief A read-only view on a contiguous array of integers owned by the
+ * caller, for example a NumPy array.
+ */
+struct array_view
+{
+    const void* data = nullptr;
+    size_t size = 0;
+    element_type type = element_type::int32;
+
+    array_view() noexcept = default;
+
+    array_view(const void* data_, size_t size_, element_type type_) noexcept
+      : data(data_)
+      , size(size_)
+      , type(type_)
+    {}
+
+    array_view(const std::vector<int>& vec) noexcept
+      : data(vec.data())
+      , size(vec.size())
+      , type(element_type::int32)
+    {}
+
+    int operator[](size_t i) const noexcept
+    {
+        return type == element_type::uint8
+                 ? static_cast<const std::uint8_t*>(data)[i]
+                 : static_cast<const std::int32_t*>(data)[i];
+    }
+};
+
+/**
+ * @brief Same options as @c data but the integer columns are read in place
+ * from arrays owned by the caller.
+ *
+ * The arrays must stay valid during the call. @c scale_values stores the
+ * rows one after the other like @c data::scale_values.
+ */
+struct data_view
+{
+    std::vector<std::string> simulations;
+    std::vector<std::string> places;
+    array_view departments;
+    array_view years;
+    array_view observed;
+    array_view scale_values;
+
+    size_t rows() const noexcept
+    {
+        return simulations.size();
+    }
+};
+
+/**
+ * @brief Order used by the @c adjustment and @c prediction functions to
+ * enumerate the lines of the utility functions.
+ *
+ * @c table enumerates the lines in the DEXi tables order, @c row_hits starts
+ * with the lines used by the largest number of options and @c kappa_gain
+ * starts with the lines whose single update gives the best kappa.
+ */
+enum class line_order : int
+{
+    table,
+    row_hits,
+    kappa_gain
+};
+
+/**
+ * @brief A DEXi model read once by @c load_model with its compiled solver.
+ *
+ * The handle is immutable and copies share the same model: it can be used
+ * by several threads at the same time.
+ */
+class EFYJ_API model_handle
+{
+public:
+    struct impl;
+
+    model_handle() noexcept = default;
+
+    explicit model_handle(std::shared_ptr<const impl> impl_) noexcept
+      : m_impl(std::move(impl_))
+    {}
+
+    bool empty() const noexcept
+    {
+        return m_impl == nullptr;
+    }
+
+    const impl* get() const noexcept
+    {
+        return m_impl.get();
+    }
+
+private:
+    std::shared_ptr<const impl> m_impl;
+};
+
+/**
+ * @brief Options read once by @c load_dataset for a model with the
+ * scale values converted and the subdataset groups built.
+ *
+ * Like @c model_handle, the handle is immutable and can be shared between
+ * threads.
+ */
+class EFYJ_API dataset_handle
+{
+public:
+    struct impl;
+
+    dataset_handle() noexcept = default;
+
+    explicit dataset_handle(std::shared_ptr<const impl> impl_) noexcept
+      : m_impl(std::move(impl_))
+    {}
+
+    bool empty() const noexcept
+    {
+        return m_impl == nullptr;
+    }
+
+    const impl* get() const noexcept
+    {
+        return m_impl.get();
+    }
+
+private:
+    std::shared_ptr<const impl> m_impl;
+};
+
+/**
+ * @brief Progress of a computation started by @c start_adjustment or
+ * @c start_prediction.
+ */
+struct job_progress
+{
+    unsigned long long int candidates = 0; ///< candidates evaluated.
+    double kappa = 0.0;      ///< kappa of the last step done.
+    double elapsed = 0.0;    ///< seconds since the start.
+    double remaining = -1.0; ///< estimated seconds left, negative if unknown.
+    unsigned int step = 0;   ///< step in progress.
+    unsigned int steps = 0;  ///< number of steps.
+    bool done = false;
+    bool cancelled = false;
+};
+
+/**
+ * @brief A computation running in its own thread.
+ *
+ * The progress is read without lock and without waiting for the
+ * computation. Copies share the same computation; the computation is
+ * cancelled and joined when the last copy is destroyed. If the last copy is
+ * destroyed by a callback of the computation, the computation is cancelled
+ * and ends in the background.
+ */
+class EFYJ_API job
+{
+public:
+    struct impl;
+
+    job() noexcept = default;
+
+    explicit job(std::shared_ptr<impl> impl_) noexcept
+      : m_impl(std::move(impl_))
+    {}
+
+    bool empty() const noexcept
+    {
+        return m_impl == nullptr;
+    }
+
+    job_progress progress() const noexcept;
+
+    /** Asks the computation to stop after the line combination in progress.
+     * The step in progress is not reported. */
+    void cancel() noexcept;
+
+    /** Blocks until the end of the computation and copies its status and
+     * error position into @c ctx. Returns @c internal_error from a callback
+     * of the computation. */
+    status wait(context& ctx) noexcept;
+
+private:
+    std::shared_ptr<impl> m_impl;
+};
+
 /**
  * @brief Use during the @c adjustment or @c prediction function call to show
  * compuation results.
@@ -304,25 +562,102 @@ using result_callback = bool (*)(const result&, void* user_data_result);
 
 using check_user_interrupt_callback = void (*)(void* user_data_interrupt);
 
+/**
+ * @brief Use by the streaming @c evaluate function to read at most @c size
+ * bytes of CSV options into @c buffer.
+ *
+ * This function returns the number of bytes read, 0 at the end of the
+ * stream.
+ */
+using stream_reader_callback = size_t (*)(char* buffer,
+                                          size_t size,
+                                          void* user_data_reader);
+
+/**
+ * @brief Use by the streaming @c evaluate function to send each evaluated
+ * block.
+ *
+ * This function can return false to stop the evaluation.
+ */
+using evaluation_block_callback = bool (*)(const evaluation_block& block,
+                                           void* user_data_block);
+
 EFYJ_API
 status
 information(context& ctx,
             const std::string& model_file_path,
             information_results& ret) noexcept;
 
+/**
+ * @brief Evaluates all the options of the model.
+ *
+ * The rows are split between at most @c thread threads, each with its own
+ * solver and confusion matrix. Datasets of a few thousand rows are
+ * evaluated on the calling thread.
+ *
+ * If @c aggregates is not null, the values of the aggregate attributes
+ * computed to solve each option are kept in @c ret.attributes. The mask
+ * has one element per attribute of the DEXi file, in file order; basic
+ * attributes are ignored and an empty mask keeps all the aggregate
+ * attributes.
+ */
 EFYJ_API
 status
 evaluate(context& ctx,
          const std::string& model_file_path,
          const data& d,
-         evaluation_results& ret) noexcept;
+         evaluation_results& ret,
+         unsigned int thread = 1,
+         const std::vector<bool>* aggregates = nullptr) noexcept;
 
 EFYJ_API
 status
 evaluate(context& ctx,
          const std::string& model_file_path,
          const std::string& options_file_path,
-         evaluation_results& ret) noexcept;
+         evaluation_results& ret,
+         unsigned int thread = 1,
+         const std::vector<bool>* aggregates = nullptr) noexcept;
+
+EFYJ_API
+status
+evaluate(context& ctx,
+         const std::string& model_file_path,
+         const data_view& d,
+         evaluation_results& ret,
+         unsigned int thread = 1,
+         const std::vector<bool>* aggregates = nullptr) noexcept;
+
+/**
+ * @brief Evaluates the CSV options read from @c reader by blocks of
+ * @c block_size rows.
+ *
+ * The parsing, the evaluation by @c thread workers and the calls to
+ * @c callback run at the same time on successive blocks; only a few blocks
+ * are kept in memory. Blocks are sent to @c callback in file order, from
+ * the calling thread, with the kappa values of all the rows already read.
+ * The subdatasets are not built.
+ */
+EFYJ_API
+status
+evaluate(context& ctx,
+         const std::string& model_file_path,
+         stream_reader_callback reader,
+         void* user_data_reader,
+         evaluation_block_callback callback,
+         void* user_data_callback,
+         size_t block_size = 4096,
+         unsigned int thread = 1) noexcept;
+
+EFYJ_API
+status
+evaluate(context& ctx,
+         const std::string& model_file_path,
+         std::istream& is,
+         evaluation_block_callback callback,
+         void* user_data_callback,
+         size_t block_size = 4096,
+         unsigned int thread = 1) noexcept;
 
 EFYJ_API status
 adjustment(context& ctx,
@@ -334,7 +669,9 @@ adjustment(context& ctx,
            void* user_data_interrupt,
            bool reduce,
            int limit,
-           unsigned int thread) noexcept;
+           unsigned int thread,
+           unsigned int top = 1,
+           line_order order = line_order::table) noexcept;
 
 EFYJ_API status
 adjustment(context& ctx,
@@ -346,7 +683,9 @@ adjustment(context& ctx,
            void* user_data_interrupt,
            bool reduce,
            int limit,
-           unsigned int thread) noexcept;
+           unsigned int thread,
+           unsigned int top = 1,
+           line_order order = line_order::table) noexcept;
 
 EFYJ_API status
 prediction(context& ctx,
@@ -358,7 +697,8 @@ prediction(context& ctx,
            void* user_data_interrupt,
            bool reduce,
            int limit,
-           unsigned int thread) noexcept;
+           unsigned int thread,
+           line_order order = line_order::table) noexcept;
 
 EFYJ_API status
 prediction(context& ctx,
@@ -370,7 +710,101 @@ prediction(context& ctx,
            void* user_data_interrupt,
            bool reduce,
            int limit,
-           unsigned int thread) noexcept;
+           unsigned int thread,
+           line_order order = line_order::table) noexcept;
+
+EFYJ_API status
+load_model(context& ctx,
+           const std::string& model_file_path,
+           model_handle& out) noexcept;
+
+EFYJ_API status
+load_dataset(context& ctx,
+             const model_handle& model,
+             const std::string& options_file_path,
+             dataset_handle& out) noexcept;
+
+EFYJ_API status
+load_dataset(context& ctx,
+             const model_handle& model,
+             const data& d,
+             dataset_handle& out) noexcept;
+
+EFYJ_API status
+load_dataset(context& ctx,
+             const model_handle& model,
+             const data_view& d,
+             dataset_handle& out) noexcept;
+
+EFYJ_API status
+evaluate(context& ctx,
+         const model_handle& model,
+         const dataset_handle& dataset,
+         evaluation_results& ret,
+         unsigned int thread = 1,
+         const std::vector<bool>* aggregates = nullptr) noexcept;
+
+EFYJ_API status
+adjustment(context& ctx,
+           const model_handle& model,
+           const dataset_handle& dataset,
+           result_callback callback,
+           void* user_data_callback,
+           check_user_interrupt_callback interrupt,
+           void* user_data_interrupt,
+           bool reduce,
+           int limit,
+           unsigned int thread,
+           unsigned int top = 1,
+           line_order order = line_order::table) noexcept;
+
+EFYJ_API status
+prediction(context& ctx,
+           const model_handle& model,
+           const dataset_handle& dataset,
+           result_callback callback,
+           void* user_data_callback,
+           check_user_interrupt_callback interrupt,
+           void* user_data_interrupt,
+           bool reduce,
+           int limit,
+           unsigned int thread,
+           line_order order = line_order::table) noexcept;
+
+/**
+ * @brief Starts the adjustment of a model handle with a dataset handle in a
+ * new thread and returns immediately.
+ *
+ * @c callback, which may be null, is called from the job thread. The
+ * handles are shared by the job and can be released by the caller.
+ */
+EFYJ_API status
+start_adjustment(context& ctx,
+                 const model_handle& model,
+                 const dataset_handle& dataset,
+                 result_callback callback,
+                 void* user_data_callback,
+                 bool reduce,
+                 int limit,
+                 job& out,
+                 unsigned int top = 1,
+                 line_order order = line_order::table) noexcept;
+
+/**
+ * @brief Starts the prediction of a model handle with a dataset handle in a
+ * new thread, using @c thread workers, and returns immediately.
+ */
+EFYJ_API status
+start_prediction(context& ctx,
+                 const model_handle& model,
+                 const dataset_handle& dataset,
+                 result_callback callback,
+                 void* user_data_callback,
+                 bool reduce,
+                 int limit,
+                 unsigned int thread,
+                 job& out,
+                 line_order order = line_order::table) noexcept;
 
 EFYJ_API status
 extract_options_to_file(context& ctx,
@@ -393,6 +827,20 @@ extract_options(context& ctx,
                 const std::string& options_file_path,
                 data& out) noexcept;
 
+/**
+ * @brief Converts the CSV options file into the binary dataset format.
+ *
+ * The binary file stores the model fingerprint, the scale values, the
+ * observations and the precomputed subdataset groups. It is mapped into
+ * memory by the functions taking an @c options_file_path without any
+ * parsing and is rejected if the model changes.
+ */
+EFYJ_API status
+convert_options_to_file(context& ctx,
+                        const std::string& model_file_path,
+                        const std::string& options_file_path,
+                        const std::string& output_file_path) noexcept;
+
 EFYJ_API status
 merge_options_to_file(context& ctx,
                       const std::string& model,
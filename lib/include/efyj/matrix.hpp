@@ -93,6 +93,10 @@ public:
     bool empty() const noexcept;
     size_type size() const noexcept;
 
+    /** The elements are stored contiguously in row-major order. */
+    value_type* data() noexcept;
+    const value_type* data() const noexcept;
+
     size_type rows() const noexcept;
     size_type columns() const noexcept;
 
@@ -273,6 +277,20 @@ matrix<T, Container>::size() const noexcept
     return m_c.size();
 }
 
+template<typename T, class Container>
+typename matrix<T, Container>::value_type*
+matrix<T, Container>::data() noexcept
+{
+    return m_c.data();
+}
+
+template<typename T, class Container>
+const typename matrix<T, Container>::value_type*
+matrix<T, Container>::data() const noexcept
+{
+    return m_c.data();
+}
+
 template<typename T, class Container>
 typename matrix<T, Container>::size_type
 matrix<T, Container>::rows() const noexcept
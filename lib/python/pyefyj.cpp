@@ -19,11 +19,20 @@
  * IN THE SOFTWARE.
  */
 
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
 
 #include "../src/utils.hpp"
 #include <efyj/efyj.hpp>
 
+#include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
@@ -87,6 +96,10 @@ show_context(const efyj::context& ctx) noexcept
                   " column ",
                   ctx.column);
         break;
+    case efyj::status::dataset_format_error:
+    case efyj::status::dataset_model_mismatch:
+        py::print("Dataset error: ", get_error_message(ctx.status));
+        break;
     case efyj::status::extract_option_same_input_files:
         py::print("Error: ", get_error_message(ctx.status));
         break;
@@ -114,26 +127,220 @@ show_context(const efyj::context& ctx) noexcept
     }
 }
 
+/* Returns a view on the C-contiguous uint8 or int32 buffer @e b without
+ * copy. @e info holds the buffer export: it must outlive the view. */
+static efyj::array_view
+make_array_view(const py::buffer& b, const char* name, py::buffer_info& info)
+{
+    info = b.request();
+
+    if (info.ndim < 1 || info.ndim > 2)
+        throw py::value_error(std::string(name) +
+                              ": one or two dimensions expected");
+
+    py::ssize_t stride = info.itemsize;
+    for (auto i = info.ndim; i-- > 0;) {
+        if (info.shape[i] > 1 && info.strides[i] != stride)
+            throw py::value_error(std::string(name) +
+                                  ": C-contiguous array expected");
+
+        stride *= info.shape[i];
+    }
+
+    std::string_view format(info.format);
+    while (!format.empty() && (format[0] == '@' || format[0] == '='))
+        format.remove_prefix(1);
+
+    efyj::element_type type;
+    if (info.itemsize == 1 && format == "B")
+        type = efyj::element_type::uint8;
+    else if (info.itemsize == 4 && (format == "i" || format == "l"))
+        type = efyj::element_type::int32;
+    else
+        throw py::type_error(std::string(name) +
+                             ": uint8 or int32 array expected");
+
+    return efyj::array_view(info.ptr, static_cast<size_t>(info.size), type);
+}
+
+/* None disables the aggregate attributes values of evaluate. */
+static const std::vector<bool>*
+to_mask(const std::optional<std::vector<bool>>& aggregates) noexcept
+{
+    return aggregates ? &*aggregates : nullptr;
+}
+
+/* A data view on Python buffers. The buffer exports are released, with
+ * the GIL held, when the view is destroyed after the computation. */
+struct buffer_data_view
+{
+    std::array<py::buffer_info, 4> buffers;
+    efyj::data_view view;
+};
+
+static buffer_data_view
+make_data_view(std::vector<std::string> simulations,
+               std::vector<std::string> places,
+               const py::buffer& departments,
+               const py::buffer& years,
+               const py::buffer& observed,
+               const py::buffer& scale_values)
+{
+    buffer_data_view d;
+    d.view.simulations = std::move(simulations);
+    d.view.places = std::move(places);
+    d.view.departments =
+      make_array_view(departments, "departments", d.buffers[0]);
+    d.view.years = make_array_view(years, "years", d.buffers[1]);
+    d.view.observed = make_array_view(observed, "observed", d.buffers[2]);
+    d.view.scale_values =
+      make_array_view(scale_values, "scale_values", d.buffers[3]);
+
+    return d;
+}
+
+/* Results of an adjustment or a prediction running without the GIL. The
+ * computation pushes the result of each step, Python polls them from
+ * another thread and may ask the computation to stop. */
+class result_queue
+{
+public:
+    void push(const efyj::result& r)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_results.emplace_back(r);
+    }
+
+    std::vector<efyj::result> poll()
+    {
+        std::vector<efyj::result> ret;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ret.swap(m_results);
+        return ret;
+    }
+
+    void cancel() noexcept
+    {
+        m_cancelled.store(true, std::memory_order_relaxed);
+    }
+
+    bool cancelled() const noexcept
+    {
+        return m_cancelled.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<efyj::result> m_results;
+    std::atomic<bool> m_cancelled{ false };
+};
+
+struct computation
+{
+    efyj::result last;
+    result_queue* queue = nullptr;
+    bool interrupted = false;
+
+    bool cancelled() const noexcept
+    {
+        return queue && queue->cancelled();
+    }
+};
+
+static efyj::context
+make_context()
+{
+    efyj::context ctx;
+    ctx.out = &std::cout;
+    ctx.err = &std::cerr;
+    ctx.line = 0;
+    ctx.column = 0;
+    ctx.size = 0;
+    ctx.data_1.reserve(256u);
+    ctx.status = efyj::status::success;
+    ctx.log_priority = efyj::log_level::info;
+
+    return ctx;
+}
+
+/* Called without the GIL. The GIL is taken back only to check signals; the
+ * exception stops the computation and the pending Python error is raised
+ * once the GIL is restored. */
 static void
-check_user_interrupt(void* /*user_data*/)
+check_user_interrupt(void* user_data)
 {
-    if (PyErr_CheckSignals() != 0)
-        throw py::error_already_set();
+    auto* state = reinterpret_cast<computation*>(user_data);
+
+    if (state->cancelled())
+        throw std::runtime_error("computation cancelled");
+
+    {
+        py::gil_scoped_acquire acquire;
+        state->interrupted = PyErr_CheckSignals() != 0;
+    }
+
+    if (state->interrupted)
+        throw std::runtime_error("computation interrupted");
 }
 
 static bool
 update_result(const efyj::result& r, void* user_data)
 {
-    auto* ret = reinterpret_cast<efyj::result*>(user_data);
+    auto* state = reinterpret_cast<computation*>(user_data);
 
     try {
-        *ret = r;
-        return true;
+        state->last = r;
+        if (state->queue)
+            state->queue->push(r);
+
+        return !state->cancelled();
     } catch (...) {
         return false;
     }
 };
 
+/* Called from the thread of a job: only the queue is used, not Python. */
+static bool
+push_result(const efyj::result& r, void* user_data)
+{
+    auto* queue = reinterpret_cast<result_queue*>(user_data);
+
+    try {
+        queue->push(r);
+        return !queue->cancelled();
+    } catch (...) {
+        return false;
+    }
+}
+
+/* Runs the adjustment or the prediction @e f with the GIL released so other
+ * Python threads progress during the computation. */
+template<typename Function>
+static efyj::result
+run_without_gil(const char* name, result_queue* queue, Function f)
+{
+    auto ctx = make_context();
+    computation state;
+    state.queue = queue;
+
+    efyj::status ret;
+    {
+        py::gil_scoped_release release;
+        ret = f(ctx, &state);
+    }
+
+    if (state.interrupted)
+        throw py::error_already_set();
+
+    if (is_bad(ret) && !state.cancelled()) {
+        py::print(name, " failed");
+        show_context(ctx);
+    }
+
+    return state.last;
+}
+
 PYBIND11_MODULE(pyefyj, m)
 {
     m.doc() = R"pbdoc(
@@ -143,8 +350,14 @@ PYBIND11_MODULE(pyefyj, m)
         .. autosummary::
            :toctree: _generate
            information
+           load_model
+           load_dataset
+           evaluate
            adjustment
            prediction
+           start_adjustment
+           start_prediction
+           result_queue
     )pbdoc";
 
     m.attr("__version__") = MACRO_STRINGIFY(VERSION_MAJOR) "." MACRO_STRINGIFY(
@@ -162,9 +375,14 @@ PYBIND11_MODULE(pyefyj, m)
       .def_readonly("line", &efyj::modifier::line)
       .def_readonly("value", &efyj::modifier::value);
 
+    py::class_<efyj::alternative>(m, "alternative")
+      .def_readonly("modifiers", &efyj::alternative::modifiers)
+      .def_readonly("kappa", &efyj::alternative::kappa);
+
     py::class_<efyj::result>(m, "results")
       .def(py::init<>())
       .def_readonly("modifiers", &efyj::result::modifiers)
+      .def_readonly("alternatives", &efyj::result::alternatives)
       .def_readonly("kappa", &efyj::result::kappa)
       .def_readonly("time", &efyj::result::time)
       .def_readonly("kappa_computed", &efyj::result::kappa_computed)
@@ -179,19 +397,116 @@ PYBIND11_MODULE(pyefyj, m)
       .def_readwrite("observed", &efyj::data::observed)
       .def_readwrite("scale_values", &efyj::data::scale_values);
 
-    efyj::context ctx;
-    ctx.out = &std::cout;
-    ctx.err = &std::cerr;
-    ctx.line = 0;
-    ctx.column = 0;
-    ctx.size = 0;
-    ctx.data_1.reserve(256u);
-    ctx.status = efyj::status::success;
-    ctx.log_priority = efyj::log_level::info;
+    /* The arrays share the memory of the results: they keep the Python
+     * results object alive instead of copying the vectors. */
+    py::class_<efyj::evaluation_results>(m, "evaluation_results")
+      .def(py::init<>())
+      .def_property_readonly(
+        "simulations",
+        [](py::object self) {
+            auto& r = self.cast<efyj::evaluation_results&>();
+            return py::array_t<efyj::value>(
+              static_cast<py::ssize_t>(r.simulations.size()),
+              r.simulations.data(),
+              self);
+        })
+      .def_property_readonly(
+        "observations",
+        [](py::object self) {
+            auto& r = self.cast<efyj::evaluation_results&>();
+            return py::array_t<efyj::value>(
+              static_cast<py::ssize_t>(r.observations.size()),
+              r.observations.data(),
+              self);
+        })
+      .def_property_readonly(
+        "confusion",
+        [](py::object self) {
+            auto& r = self.cast<efyj::evaluation_results&>();
+            std::vector<py::ssize_t> shape{
+                static_cast<py::ssize_t>(r.confusion.rows()),
+                static_cast<py::ssize_t>(r.confusion.columns())
+            };
+            return py::array_t<efyj::value>(
+              shape, r.confusion.data(), self);
+        })
+      .def_property_readonly(
+        "attributes",
+        [](py::object self) {
+            auto& r = self.cast<efyj::evaluation_results&>();
+            std::vector<py::ssize_t> shape{
+                static_cast<py::ssize_t>(r.attributes.rows()),
+                static_cast<py::ssize_t>(r.attributes.columns())
+            };
+            return py::array_t<std::uint8_t>(
+              shape, r.attributes.data(), self);
+        })
+      .def_readonly("attribute_names",
+                    &efyj::evaluation_results::attribute_names)
+      .def_readonly("linear_weighted_kappa",
+                    &efyj::evaluation_results::linear_weighted_kappa)
+      .def_readonly("squared_weighted_kappa",
+                    &efyj::evaluation_results::squared_weighted_kappa);
+
+    py::class_<efyj::model_handle>(m, "model_handle")
+      .def(py::init<>())
+      .def("empty", &efyj::model_handle::empty);
+
+    py::class_<efyj::dataset_handle>(m, "dataset_handle")
+      .def(py::init<>())
+      .def("empty", &efyj::dataset_handle::empty);
+
+    py::class_<efyj::job_progress>(m, "job_progress")
+      .def_readonly("candidates", &efyj::job_progress::candidates)
+      .def_readonly("kappa", &efyj::job_progress::kappa)
+      .def_readonly("elapsed", &efyj::job_progress::elapsed)
+      .def_readonly("remaining", &efyj::job_progress::remaining)
+      .def_readonly("step", &efyj::job_progress::step)
+      .def_readonly("steps", &efyj::job_progress::steps)
+      .def_readonly("done", &efyj::job_progress::done)
+      .def_readonly("cancelled", &efyj::job_progress::cancelled);
+
+    py::class_<efyj::job>(m, "job")
+      .def("empty", &efyj::job::empty)
+      .def("progress", &efyj::job::progress)
+      .def("cancel", &efyj::job::cancel)
+      .def(
+        "wait",
+        [](efyj::job& self) -> bool {
+            auto ctx = make_context();
+            efyj::status ret;
+            {
+                py::gil_scoped_release release;
+                ret = self.wait(ctx);
+            }
+
+            if (is_bad(ret)) {
+                py::print("job failed");
+                show_context(ctx);
+                return false;
+            }
+
+            return true;
+        },
+        "Waits for the end of the computation without holding the GIL.");
 
+    py::class_<result_queue>(m, "result_queue")
+      .def(py::init<>())
+      .def("poll",
+           &result_queue::poll,
+           py::call_guard<py::gil_scoped_release>(),
+           "Removes and returns the results pushed since the last poll.")
+      .def("cancel",
+           &result_queue::cancel,
+           "Asks the computation to stop at the next check.")
+      .def_property_readonly("cancelled", &result_queue::cancelled);
+
+    /* Each call has its own context: the functions may run at the same
+     * time from several Python threads. */
     m.def(
       "information",
-      [&ctx](const std::string& s) -> efyj::information_results {
+      [](const std::string& s) -> efyj::information_results {
+          auto ctx = make_context();
           efyj::information_results out;
 
           if (const auto ret = efyj::information(ctx, s, out); is_bad(ret)) {
@@ -206,82 +521,415 @@ PYBIND11_MODULE(pyefyj, m)
         Use this information to build correct scale values vector.
     )pbdoc");
 
+    m.def(
+      "load_model",
+      [](const std::string& model_file_path) -> efyj::model_handle {
+          auto ctx = make_context();
+          efyj::model_handle out;
+
+          if (const auto ret = efyj::load_model(ctx, model_file_path, out);
+              is_bad(ret)) {
+              py::print("load_model(...) failed");
+              show_context(ctx);
+          }
+
+          return out;
+      },
+      R"pbdoc(
+        Reads a DEXi file once. The returned handle is shared by the
+        evaluate, adjustment and prediction functions.
+    )pbdoc");
+
+    m.def(
+      "load_dataset",
+      [](const efyj::model_handle& model,
+         const efyj::data& d) -> efyj::dataset_handle {
+          auto ctx = make_context();
+          efyj::dataset_handle out;
+
+          if (const auto ret = efyj::load_dataset(ctx, model, d, out);
+              is_bad(ret)) {
+              py::print("load_dataset(...) failed");
+              show_context(ctx);
+          }
+
+          return out;
+      },
+      R"pbdoc(
+        Converts data once for a model handle.
+    )pbdoc");
+
+    m.def(
+      "load_dataset",
+      [](const efyj::model_handle& model,
+         const std::string& options_file_path) -> efyj::dataset_handle {
+          auto ctx = make_context();
+          efyj::dataset_handle out;
+
+          if (const auto ret =
+                efyj::load_dataset(ctx, model, options_file_path, out);
+              is_bad(ret)) {
+              py::print("load_dataset(...) failed");
+              show_context(ctx);
+          }
+
+          return out;
+      },
+      R"pbdoc(
+        Reads a CSV or binary dataset file once for a model handle.
+    )pbdoc");
+
+    m.def(
+      "load_dataset",
+      [](const efyj::model_handle& model,
+         std::vector<std::string> simulations,
+         std::vector<std::string> places,
+         const py::buffer& departments,
+         const py::buffer& years,
+         const py::buffer& observed,
+         const py::buffer& scale_values) -> efyj::dataset_handle {
+          auto ctx = make_context();
+          const auto d = make_data_view(std::move(simulations),
+                                        std::move(places),
+                                        departments,
+                                        years,
+                                        observed,
+                                        scale_values);
+          efyj::dataset_handle out;
+
+          if (const auto ret = efyj::load_dataset(ctx, model, d.view, out);
+              is_bad(ret)) {
+              py::print("load_dataset(...) failed");
+              show_context(ctx);
+          }
+
+          return out;
+      },
+      py::arg("model"),
+      py::arg("simulations"),
+      py::arg("places"),
+      py::arg("departments"),
+      py::arg("years"),
+      py::arg("observed"),
+      py::arg("scale_values"),
+      R"pbdoc(
+        Converts C-contiguous uint8 or int32 arrays (NumPy arrays or any
+        object of the buffer protocol) once for a model handle.
+    )pbdoc");
+
     m.def(
       "evaluate",
-      [&ctx](const std::string& s,
-             const efyj::data& d) -> efyj::evaluation_results {
+      [](const efyj::model_handle& model,
+         const efyj::dataset_handle& dataset,
+         unsigned int thread,
+         const std::optional<std::vector<bool>>& aggregates)
+            -> efyj::evaluation_results {
+          auto ctx = make_context();
           efyj::evaluation_results out;
 
-          if (const auto ret = efyj::evaluate(ctx, s, d, out); is_bad(ret)) {
+          if (const auto ret = efyj::evaluate(
+                ctx, model, dataset, out, thread, to_mask(aggregates));
+              is_bad(ret)) {
               py::print("evaluation(...) failed");
               show_context(ctx);
           }
 
           return out;
       },
+      py::arg("model"),
+      py::arg("dataset"),
+      py::arg("thread") = 1u,
+      py::arg("aggregates") = py::none(),
       R"pbdoc(
-        Evaluation of DEXi file with data.
+        Evaluation of a model handle with a dataset handle. The rows are
+        split between `thread` threads. If `aggregates` is a list of
+        booleans, one per attribute of the DEXi file, the values of the
+        selected aggregate attributes are kept in the `attributes` array
+        (one row per option); an empty list keeps all of them.
     )pbdoc");
 
     m.def(
-      "adjustment",
-      [&ctx](const std::string& model_file_path,
-             const efyj::data& d) -> efyj::result {
-          efyj::result out;
-          const auto ret = efyj::adjustment(ctx,
-                                            model_file_path,
-                                            d,
-                                            update_result,
-                                            &out,
-                                            check_user_interrupt,
-                                            nullptr,
-                                            true,
-                                            0,
-                                            1u);
-
-          if (is_bad(ret)) {
-              py::print("adjustment failed");
+      "evaluate",
+      [](const std::string& s,
+         const efyj::data& d,
+         unsigned int thread,
+         const std::optional<std::vector<bool>>& aggregates)
+            -> efyj::evaluation_results {
+          auto ctx = make_context();
+          efyj::evaluation_results out;
+
+          if (const auto ret = efyj::evaluate(
+                ctx, s, d, out, thread, to_mask(aggregates));
+              is_bad(ret)) {
+              py::print("evaluation(...) failed");
               show_context(ctx);
           }
 
           return out;
       },
+      py::arg("model_file_path"),
+      py::arg("data"),
+      py::arg("thread") = 1u,
+      py::arg("aggregates") = py::none(),
       R"pbdoc(
-        Compute adjustment of a DEXi file.
+        Evaluation of DEXi file with data. The rows are split between
+        `thread` threads. See the handle `evaluate` for `aggregates`.
+    )pbdoc");
+
+    m.def(
+      "evaluate",
+      [](const std::string& model_file_path,
+         std::vector<std::string> simulations,
+         std::vector<std::string> places,
+         const py::buffer& departments,
+         const py::buffer& years,
+         const py::buffer& observed,
+         const py::buffer& scale_values,
+         unsigned int thread,
+         const std::optional<std::vector<bool>>& aggregates)
+            -> efyj::evaluation_results {
+          auto ctx = make_context();
+          const auto d = make_data_view(std::move(simulations),
+                                        std::move(places),
+                                        departments,
+                                        years,
+                                        observed,
+                                        scale_values);
+          efyj::evaluation_results out;
+
+          if (const auto ret = efyj::evaluate(ctx,
+                                              model_file_path,
+                                              d.view,
+                                              out,
+                                              thread,
+                                              to_mask(aggregates));
+              is_bad(ret)) {
+              py::print("evaluation(...) failed");
+              show_context(ctx);
+          }
+
+          return out;
+      },
+      py::arg("model_file_path"),
+      py::arg("simulations"),
+      py::arg("places"),
+      py::arg("departments"),
+      py::arg("years"),
+      py::arg("observed"),
+      py::arg("scale_values"),
+      py::arg("thread") = 1u,
+      py::arg("aggregates") = py::none(),
+      R"pbdoc(
+        Evaluation of DEXi file with C-contiguous uint8 or int32 arrays
+        (NumPy arrays or any object of the buffer protocol) read in place.
+        The `simulations`, `observations`, `confusion` and `attributes`
+        arrays of the results share the memory of the results object.
+        See the handle `evaluate` for `aggregates`.
+    )pbdoc");
+
+    m.def(
+      "adjustment",
+      [](const std::string& model_file_path,
+         const efyj::data& d,
+         unsigned int top,
+         result_queue* queue) -> efyj::result {
+          return run_without_gil(
+            "adjustment",
+            queue,
+            [&](efyj::context& ctx, computation* state) {
+                return efyj::adjustment(ctx,
+                                        model_file_path,
+                                        d,
+                                        update_result,
+                                        state,
+                                        check_user_interrupt,
+                                        state,
+                                        true,
+                                        0,
+                                        1u,
+                                        top);
+            });
+      },
+      py::arg("model_file_path"),
+      py::arg("data"),
+      py::arg("top") = 1u,
+      py::arg("queue") = py::none(),
+      R"pbdoc(
+        Compute adjustment of a DEXi file. The `top` best candidates of the
+        last step are available in the `alternatives` attribute. The GIL is
+        released during the computation: run it in a thread and poll the
+        result of each step with the optional `queue`.
+    )pbdoc");
+
+    m.def(
+      "adjustment",
+      [](const efyj::model_handle& model,
+         const efyj::dataset_handle& dataset,
+         unsigned int top,
+         result_queue* queue) -> efyj::result {
+          return run_without_gil(
+            "adjustment",
+            queue,
+            [&](efyj::context& ctx, computation* state) {
+                return efyj::adjustment(ctx,
+                                        model,
+                                        dataset,
+                                        update_result,
+                                        state,
+                                        check_user_interrupt,
+                                        state,
+                                        true,
+                                        0,
+                                        1u,
+                                        top);
+            });
+      },
+      py::arg("model"),
+      py::arg("dataset"),
+      py::arg("top") = 1u,
+      py::arg("queue") = py::none(),
+      R"pbdoc(
+        Compute adjustment of a model handle with a dataset handle.
+    )pbdoc");
+
+    m.def(
+      "prediction",
+      [](const std::string& model_file_path,
+         const efyj::data& d,
+         result_queue* queue) -> efyj::result {
+          return run_without_gil(
+            "prediction",
+            queue,
+            [&](efyj::context& ctx, computation* state) {
+                return efyj::prediction(ctx,
+                                        model_file_path,
+                                        d,
+                                        update_result,
+                                        state,
+                                        check_user_interrupt,
+                                        state,
+                                        true,
+                                        0,
+                                        1u);
+            });
+      },
+      py::arg("model_file_path"),
+      py::arg("data"),
+      py::arg("queue") = py::none(),
+      R"pbdoc(
+        Compute prediction of a DEXi file. The GIL is released during the
+        computation: run it in a thread and poll the result of each step
+        with the optional `queue`.
     )pbdoc");
 
     m.def(
       "prediction",
-      [&ctx](const std::string& model_file_path,
-             const efyj::data& d) -> efyj::result {
-          efyj::result out;
-          const auto ret = efyj::prediction(ctx,
-                                            model_file_path,
-                                            d,
-                                            update_result,
-                                            &out,
-                                            check_user_interrupt,
-                                            nullptr,
-                                            true,
-                                            0,
-                                            1u);
-
-          if (is_bad(ret)) {
-              py::print("adjustment failed");
+      [](const efyj::model_handle& model,
+         const efyj::dataset_handle& dataset,
+         result_queue* queue) -> efyj::result {
+          return run_without_gil(
+            "prediction",
+            queue,
+            [&](efyj::context& ctx, computation* state) {
+                return efyj::prediction(ctx,
+                                        model,
+                                        dataset,
+                                        update_result,
+                                        state,
+                                        check_user_interrupt,
+                                        state,
+                                        true,
+                                        0,
+                                        1u);
+            });
+      },
+      py::arg("model"),
+      py::arg("dataset"),
+      py::arg("queue") = py::none(),
+      R"pbdoc(
+        Compute prediction of a model handle with a dataset handle.
+    )pbdoc");
+
+    m.def(
+      "start_adjustment",
+      [](const efyj::model_handle& model,
+         const efyj::dataset_handle& dataset,
+         unsigned int top,
+         result_queue* queue) -> efyj::job {
+          auto ctx = make_context();
+          efyj::job out;
+
+          if (const auto ret = efyj::start_adjustment(ctx,
+                                                      model,
+                                                      dataset,
+                                                      queue ? push_result
+                                                            : nullptr,
+                                                      queue,
+                                                      true,
+                                                      0,
+                                                      out,
+                                                      top);
+              is_bad(ret)) {
+              py::print("start_adjustment failed");
+              show_context(ctx);
+          }
+
+          return out;
+      },
+      py::arg("model"),
+      py::arg("dataset"),
+      py::arg("top") = 1u,
+      py::arg("queue") = py::none(),
+      py::keep_alive<0, 4>(),
+      R"pbdoc(
+        Starts the adjustment of a model handle with a dataset handle in a
+        background thread and returns a job to poll its progress, cancel
+        or wait for it. The result of each step goes to the optional
+        `queue`.
+    )pbdoc");
+
+    m.def(
+      "start_prediction",
+      [](const efyj::model_handle& model,
+         const efyj::dataset_handle& dataset,
+         unsigned int thread,
+         result_queue* queue) -> efyj::job {
+          auto ctx = make_context();
+          efyj::job out;
+
+          if (const auto ret = efyj::start_prediction(ctx,
+                                                      model,
+                                                      dataset,
+                                                      queue ? push_result
+                                                            : nullptr,
+                                                      queue,
+                                                      true,
+                                                      0,
+                                                      thread,
+                                                      out);
+              is_bad(ret)) {
+              py::print("start_prediction failed");
               show_context(ctx);
           }
 
           return out;
       },
+      py::arg("model"),
+      py::arg("dataset"),
+      py::arg("thread") = 1u,
+      py::arg("queue") = py::none(),
+      py::keep_alive<0, 4>(),
       R"pbdoc(
-        Compute prediction of a DEXi file.
+        Starts the prediction of a model handle with a dataset handle in a
+        background thread. See `start_adjustment`.
     )pbdoc");
 
     m.def(
       "merge",
-      [&ctx](const std::string& model_file_path,
-             const std::string& output_file_path,
-             const efyj::data& d) -> bool {
+      [](const std::string& model_file_path,
+         const std::string& output_file_path,
+         const efyj::data& d) -> bool {
+          auto ctx = make_context();
           if (const auto ret =
                 efyj::merge_options(ctx, model_file_path, output_file_path, d);
               efyj::is_bad(ret)) {
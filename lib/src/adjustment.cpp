@@ -20,148 +20,62 @@
  */
 
 #include "adjustment.hpp"
+#include "cancellation.hpp"
 #include "utils.hpp"
 
 namespace efyj {
 
+static void
+copy_alternatives(top_candidates& top, result& ret)
+{
+    top.sort();
+    ret.alternatives.resize(top.size());
+
+    for (size_t i = 0, e = top.size(); i != e; ++i) {
+        auto& alt = ret.alternatives[i];
+        alt.kappa = top[i].kappa;
+        alt.modifiers.clear();
+
+        for (const auto& updater : top[i].updaters)
+            alt.modifiers.emplace_back(std::get<0>(updater),
+                                       std::get<1>(updater),
+                                       std::get<2>(updater));
+    }
+
+    top.clear();
+}
+
 adjustment_evaluator::adjustment_evaluator(context& ctx,
                                            const Model& model,
-                                           const Options& options)
+                                           const Options& options,
+                                           unsigned int top,
+                                           line_order order)
   : m_context(ctx)
   , m_model(model)
   , m_options(options)
   , simulated(options.options.rows())
-  , observed(options.options.rows())
   , solver(ctx, model)
   , kappa_c(model.attributes[0].scale.size())
+  , m_top(top > 1 ? top : 0)
+  , m_order(order)
 {}
 
 status
 adjustment_evaluator::run(result_callback callback,
                           void* user_data_callback,
                           int line_limit,
-                          [[maybe_unused]] double time_limit,
+                          double time_limit,
                           int reduce_mode,
                           const std::string& output_directory)
 {
-    model_writer writer;
-    if (auto ret = writer.init(output_directory); is_bad(ret))
-        return ret;
-
-    info(m_context, "[Output directory]\n{}\n", writer.directory.string());
-
-    result ret;
-
-    info(m_context, "[Computation starts]\n");
-
-    if (reduce_mode)
-        solver.reduce(m_options);
-
-    solver.get_functions(m_globalfunctions);
-    assert(!m_globalfunctions.empty() &&
-           "adjustment can not determine function");
-
-    const size_t max_step =
-      max_value(line_limit, solver.get_attribute_line_tuple_limit());
-    const size_t max_opt = m_options.simulations.size();
-
-    assert(max_step > 0 && "adjustment: can not determine limit");
-
-    info(m_context, "[Computation starts 1/{}\n", max_step);
-
-    {
-        m_start = std::chrono::system_clock::now();
-        for (size_t opt = 0; opt != m_options.size(); ++opt)
-            simulated[opt] = solver.solve(m_options.options.row(opt));
-
-        auto kappa = kappa_c.squared(m_options.observed, simulated);
-
-        m_end = std::chrono::system_clock::now();
-
-        info(m_context,
-             "| line updated | kappa | kappa computed "
-             "| time (s) | tuple (attribute, line, value) updated |\n");
-
-        info(m_context,
-             "| {} | {:13.10f} | {} | {} | [] |\n",
-             0,
-             kappa,
-             1,
-             std::chrono::duration<double>(m_end - m_start).count());
-
-        ret.kappa = kappa;
-        ret.time = std::chrono::duration<double>(m_end - m_start).count();
-        ret.kappa_computed = 1;
-
-        if (!is_numeric_castable<unsigned long>(m_options.size()))
-            return status::option_too_many;
-
-        ret.function_computed = static_cast<unsigned long>(m_options.size());
-
-        writer.store(m_context, m_model, ret);
-
-        if (!callback(ret, user_data_callback))
-            return status::success;
-    }
-
-    for (size_t step = 1; step <= max_step; ++step) {
-        m_start = std::chrono::system_clock::now();
-        long int loop = 0;
-
-        solver.set_functions(m_globalfunctions);
-        solver.init_walkers(step);
-        double kappa = 0;
-
-        do {
-            solver.init_next_value();
-
-            do {
-                for (size_t opt = 0; opt != max_opt; ++opt) {
-                    observed[opt] = m_options.observed[opt];
-                    simulated[opt] = solver.solve(m_options.options.row(opt));
-                }
-
-                auto localkappa = kappa_c.squared(observed, simulated);
-                loop++;
-
-                if (localkappa > kappa) {
-                    m_updaters = solver.updaters();
-                    kappa = localkappa;
-                }
-            } while (solver.next_value() == true);
-        } while (solver.next_line() == true);
-
-        m_end = std::chrono::system_clock::now();
-        auto time = std::chrono::duration<double>(m_end - m_start).count();
-
-        ret.kappa = kappa;
-        ret.time = time;
-        ret.kappa_computed = static_cast<unsigned long int>(loop);
-        ret.function_computed = static_cast<unsigned long int>(0);
-        ret.modifiers.clear();
-
-        info(
-          m_context, "| {} | {:13.10f} | {} | {} | ", step, kappa, loop, time);
-
-        for (const auto& elem : m_updaters) {
-            ret.modifiers.emplace_back(
-              std::get<0>(elem), std::get<1>(elem), std::get<2>(elem));
-
-            info(m_context,
-                 "[{},{},{}] ",
-                 std::get<0>(elem),
-                 std::get<1>(elem),
-                 std::get<2>(elem));
-        }
-
-        info(m_context, "\n");
-        writer.store(m_context, m_model, ret);
-
-        if (!callback(ret, user_data_callback))
-            break;
-    }
-
-    return status::success;
+    return run(nullptr,
+               nullptr,
+               callback,
+               user_data_callback,
+               line_limit,
+               time_limit,
+               reduce_mode,
+               output_directory);
 }
 
 status
@@ -170,12 +84,12 @@ adjustment_evaluator::run(check_user_interrupt_callback interrupt,
                           result_callback callback,
                           void* user_data_callback,
                           int line_limit,
-                          double /*time_limit*/,
+                          double time_limit,
                           int reduce_mode,
                           const std::string& output_directory)
 {
     model_writer writer;
-    if (auto ret = writer.init(output_directory); is_bad(ret))
+    if (auto ret = writer.init(m_context, output_directory); is_bad(ret))
         return ret;
 
     info(m_context, "[Output directory]\n{}\n", writer.directory.string());
@@ -187,6 +101,8 @@ adjustment_evaluator::run(check_user_interrupt_callback interrupt,
     if (reduce_mode)
         solver.reduce(m_options);
 
+    solver.sort_lines(m_options, m_order);
+
     solver.get_functions(m_globalfunctions);
     assert(!m_globalfunctions.empty() &&
            "adjustment can not determine function");
@@ -197,6 +113,9 @@ adjustment_evaluator::run(check_user_interrupt_callback interrupt,
 
     assert(max_step > 0 && "adjustment: can not determine limit");
 
+    if (m_progress)
+        m_progress->start(max_step, solver.candidate_number(max_step));
+
     info(m_context, "[Computation starts 1/{}\n", max_step);
 
     {
@@ -230,48 +149,71 @@ adjustment_evaluator::run(check_user_interrupt_callback interrupt,
 
         writer.store(m_context, m_model, ret);
 
+        if (m_progress)
+            m_progress->end_step(kappa);
+
         if (!callback(ret, user_data_callback))
             return status::success;
     }
 
-    interrupt(user_data_interrupt);
-    std::chrono::time_point<std::chrono::system_clock> int_start, int_now;
+    if (interrupt)
+        interrupt(user_data_interrupt);
+
+    cancellation_check stop(m_progress ? &m_progress->cancelled : nullptr,
+                            make_deadline(time_limit),
+                            interrupt,
+                            user_data_interrupt);
 
     for (size_t step = 1; step <= max_step; ++step) {
         m_start = std::chrono::system_clock::now();
-        int_start = m_start;
+
+        if (m_progress)
+            m_progress->begin_step(step);
 
         long int loop = 0;
 
-        solver.set_functions(m_globalfunctions);
+        solver.restore();
         solver.init_walkers(step);
         double kappa = 0;
 
         do {
+            const long int first = loop;
             solver.init_next_value();
 
             do {
+                auto signature = kappa_cache::seed;
                 for (size_t opt = 0; opt != max_opt; ++opt) {
-                    observed[opt] = m_options.observed[opt];
                     simulated[opt] = solver.solve(m_options.options.row(opt));
+                    signature =
+                      kappa_cache::combine(signature, simulated[opt]);
                 }
 
-                auto localkappa = kappa_c.squared(observed, simulated);
+                double localkappa;
+                if (!m_kappa_cache.find(signature, localkappa)) {
+                    localkappa =
+                      kappa_c.squared(m_options.observed, simulated);
+                    m_kappa_cache.insert(signature, localkappa);
+                }
                 loop++;
 
+                if (m_top.accept(localkappa, loop)) {
+                    solver.updaters(m_candidate);
+                    m_top.push(localkappa, loop, m_candidate);
+                }
+
                 if (localkappa > kappa) {
-                    m_updaters = solver.updaters();
+                    solver.updaters(m_updaters);
                     kappa = localkappa;
                 }
-                int_now = std::chrono::system_clock::now();
-                auto time =
-                  std::chrono::duration<double>(int_now - int_start).count();
-                if (time > 4.) {
-                    interrupt(user_data_interrupt);
-                    int_now = int_start = std::chrono::system_clock::now();
-                }
 
+                /* A cancelled step is incomplete and is not reported. */
+                if (stop())
+                    return status::success;
             } while (solver.next_value() == true);
+
+            if (m_progress)
+                m_progress->advance(
+                  static_cast<unsigned long long>(loop - first));
         } while (solver.next_line() == true);
 
         m_end = std::chrono::system_clock::now();
@@ -282,6 +224,7 @@ adjustment_evaluator::run(check_user_interrupt_callback interrupt,
         ret.kappa_computed = static_cast<unsigned long int>(loop);
         ret.function_computed = static_cast<unsigned long int>(0);
         ret.modifiers.clear();
+        copy_alternatives(m_top, ret);
 
         info(
           m_context, "| {} | {:13.10f} | {} | {} | ", step, kappa, loop, time);
@@ -300,6 +243,9 @@ adjustment_evaluator::run(check_user_interrupt_callback interrupt,
         info(m_context, "\n");
         writer.store(m_context, m_model, ret);
 
+        if (m_progress)
+            m_progress->end_step(kappa);
+
         if (!callback(ret, user_data_callback))
             break;
     }
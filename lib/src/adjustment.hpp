@@ -28,6 +28,7 @@
 #include "options.hpp"
 #include "post.hpp"
 #include "private.hpp"
+#include "progress.hpp"
 #include "solver-stack.hpp"
 
 namespace efyj {
@@ -39,17 +40,24 @@ struct adjustment_evaluator
     const Options& m_options;
 
     std::chrono::time_point<std::chrono::system_clock> m_start, m_end;
-    std::vector<std::tuple<int, int, int>> m_updaters;
+    std::vector<std::tuple<int, int, int>> m_updaters, m_candidate;
     std::vector<std::vector<int>> m_globalfunctions;
     std::vector<int> simulated;
-    std::vector<int> observed;
     for_each_model_solver solver;
     weighted_kappa_calculator kappa_c;
+    kappa_cache m_kappa_cache;
+    top_candidates m_top;
     unsigned long long int m_loop = 0;
+    line_order m_order;
+
+    /* Optional progress published to the job of @e start_adjustment. */
+    progress* m_progress = nullptr;
 
     adjustment_evaluator(context& context,
                          const Model& model,
-                         const Options& options);
+                         const Options& options,
+                         unsigned int top = 1,
+                         line_order order = line_order::table);
 
     status run(result_callback callback,
                void* user_data_callback,
@@ -0,0 +1,144 @@
+/* Copyright (C) 2016-2021 INRAE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef ORG_VLEPROJECT_EFYJ_DETAILS_CANCELLATION_HPP
+#define ORG_VLEPROJECT_EFYJ_DETAILS_CANCELLATION_HPP
+
+#include <efyj/efyj.hpp>
+
+#include <atomic>
+#include <chrono>
+
+namespace efyj {
+
+using steady_time_point = std::chrono::steady_clock::time_point;
+
+/** Returns the deadline of a computation of at most @e time_limit seconds,
+ * the maximum time point if @e time_limit is not positive. */
+inline steady_time_point
+make_deadline(double time_limit) noexcept
+{
+    if (time_limit <= 0.0)
+        return steady_time_point::max();
+
+    return std::chrono::steady_clock::now() +
+           std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+             std::chrono::duration<double>(time_limit));
+}
+
+/** Checks in the hot loop of an evaluator whether the computation must
+ * stop: the atomic @e token is set, the deadline is reached, or the
+ * interrupt callback throws.
+ *
+ * The token is a relaxed load on each call. The clock is read only every
+ * @e m_period calls. The period doubles while the clock reads are closer
+ * than half the @e resolution and halves when they are further than twice
+ * the resolution, so the clock is read about every 10 ms whatever the
+ * candidate rate. The interrupt callback is still called every
+ * @e interrupt_period.
+ */
+class cancellation_check
+{
+public:
+    static constexpr std::chrono::milliseconds resolution{ 10 };
+    static constexpr std::chrono::seconds interrupt_period{ 4 };
+    static constexpr unsigned int max_period = 1u << 20;
+
+    explicit cancellation_check(
+      const std::atomic<bool>* token = nullptr,
+      steady_time_point deadline = steady_time_point::max(),
+      check_user_interrupt_callback interrupt = nullptr,
+      void* user_data_interrupt = nullptr) noexcept
+      : m_token(token)
+      , m_deadline(deadline)
+      , m_interrupt(interrupt)
+      , m_user_data_interrupt(user_data_interrupt)
+      , m_last(std::chrono::steady_clock::now())
+      , m_next_interrupt(m_last + interrupt_period)
+    {}
+
+    /** Returns true if the computation must stop. */
+    bool operator()()
+    {
+        if (m_token && m_token->load(std::memory_order_relaxed))
+            return m_stopped = true;
+
+        if (--m_countdown > 0)
+            return false;
+
+        return m_stopped = check_clock();
+    }
+
+    /** Same as the call operator but reads the clock whatever the period,
+     * for a thread waiting for others. */
+    bool poll()
+    {
+        if (m_token && m_token->load(std::memory_order_relaxed))
+            return m_stopped = true;
+
+        return m_stopped = check_clock();
+    }
+
+    bool stopped() const noexcept
+    {
+        return m_stopped;
+    }
+
+private:
+    bool check_clock()
+    {
+        const auto now = std::chrono::steady_clock::now();
+        const auto elapsed = now - m_last;
+
+        if (elapsed < resolution / 2 && m_period < max_period)
+            m_period *= 2;
+        else if (elapsed > resolution * 2 && m_period > 1)
+            m_period /= 2;
+
+        m_countdown = m_period;
+        m_last = now;
+
+        if (now >= m_deadline)
+            return true;
+
+        if (m_interrupt && now >= m_next_interrupt) {
+            m_interrupt(m_user_data_interrupt);
+            m_next_interrupt = std::chrono::steady_clock::now() +
+                               interrupt_period;
+        }
+
+        return false;
+    }
+
+    const std::atomic<bool>* m_token;
+    steady_time_point m_deadline;
+    check_user_interrupt_callback m_interrupt;
+    void* m_user_data_interrupt;
+    steady_time_point m_last;
+    steady_time_point m_next_interrupt;
+    unsigned int m_period = 1;
+    unsigned int m_countdown = 1;
+    bool m_stopped = false;
+};
+
+} // namespace efyj
+
+#endif
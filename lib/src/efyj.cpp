@@ -21,6 +21,7 @@
 
 #include "efyj.hpp"
 #include "adjustment.hpp"
+#include "evaluation-pipeline.hpp"
 #include "model.hpp"
 #include "options.hpp"
 #include "post.hpp"
@@ -32,30 +33,173 @@
 
 #include <fmt/format.h>
 
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <istream>
+#include <mutex>
+
 namespace efyj {
 
-status
-make_model(context& ctx, const std::string& model_file_path, Model& model)
+/* The models already read by make_model. An entry is reused while the
+ * canonical path, the size and the content hash of the file are
+ * unchanged: a cache hit reads the file but does not parse it. The least
+ * recently used entry is removed when the cache is full. */
+struct model_cache
 {
-    const auto ifs = input_file(model_file_path.c_str());
-    if (!ifs.is_open()) {
+    struct entry
+    {
+        std::string path; ///< canonical path of the file.
+        std::uintmax_t size;
+        std::uint64_t hash;
+        std::shared_ptr<const Model> model;   ///< model read from the file.
+        std::shared_ptr<const Model> compact; ///< model without options.
+        std::shared_ptr<const solver_structure> structure;
+    };
+
+    static constexpr size_t capacity = 16;
+
+    std::mutex mutex;
+    std::vector<entry> entries; ///< most recently used at the end.
+
+    static model_cache& instance()
+    {
+        static model_cache cache;
+        return cache;
+    }
+};
+
+/* Computes the FNV-1a hash of the content of @e is and rewinds it. */
+static bool
+hash_file(std::FILE* is, std::uint64_t& hash) noexcept
+{
+    char buffer[16384];
+    size_t read;
+
+    hash = UINT64_C(14695981039346656037);
+    while ((read = std::fread(buffer, 1, sizeof(buffer), is)) > 0) {
+        for (size_t i = 0; i != read; ++i) {
+            hash ^= static_cast<unsigned char>(buffer[i]);
+            hash *= UINT64_C(1099511628211);
+        }
+    }
+
+    const bool ret = !std::ferror(is);
+    std::rewind(is);
+
+    return ret;
+}
+
+static status
+find_model(context& ctx,
+           const std::string& model_file_path,
+           model_cache::entry& out)
+{
+    std::error_code ec;
+    const auto path = std::filesystem::canonical(model_file_path, ec);
+    const auto size = ec ? std::uintmax_t{ 0 }
+                         : std::filesystem::file_size(path, ec);
+
+    const auto key = path.string();
+    const auto ifs = input_file(model_file_path.c_str(), "rb");
+    std::uint64_t hash;
+
+    if (ec || !ifs.is_open() || !hash_file(ifs.get(), hash)) {
         ctx.data_1 = model_file_path;
         return ctx.status = status::file_error;
     }
 
-    if (auto ret = model.read(ctx, ifs); is_bad(ret))
+    auto& cache = model_cache::instance();
+
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+
+        auto it = std::find_if(
+          cache.entries.begin(), cache.entries.end(), [&](const auto& elem) {
+              return elem.path == key;
+          });
+
+        if (it != cache.entries.end() && it->size == size &&
+            it->hash == hash) {
+            out = *it;
+            std::rotate(it, it + 1, cache.entries.end());
+            return status::success;
+        }
+    }
+
+    auto model = std::make_shared<Model>();
+    if (auto ret = model->read(ctx, ifs); is_bad(ret))
+        return ret;
+
+    auto compact = std::make_shared<Model>(*model);
+    compact->clear_options();
+
+    out = model_cache::entry{
+        key, size, hash, std::move(model), std::move(compact), {}
+    };
+    out.structure = std::make_shared<const solver_structure>(*out.compact);
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+
+    cache.entries.erase(
+      std::remove_if(cache.entries.begin(),
+                     cache.entries.end(),
+                     [&](const auto& elem) { return elem.path == key; }),
+      cache.entries.end());
+
+    if (cache.entries.size() == model_cache::capacity)
+        cache.entries.erase(cache.entries.begin());
+
+    cache.entries.emplace_back(out);
+
+    return status::success;
+}
+
+status
+make_model(context& ctx,
+           const std::string& model_file_path,
+           std::shared_ptr<const Model>& model)
+{
+    model_cache::entry entry;
+    if (auto ret = find_model(ctx, model_file_path, entry); is_bad(ret))
+        return ret;
+
+    model = std::move(entry.model);
+    return status::success;
+}
+
+status
+make_compiled_model(context& ctx,
+                    const std::string& model_file_path,
+                    std::shared_ptr<const Model>& model,
+                    std::shared_ptr<const solver_structure>& structure)
+{
+    model_cache::entry entry;
+    if (auto ret = find_model(ctx, model_file_path, entry); is_bad(ret))
         return ret;
 
+    model = std::move(entry.compact);
+    structure = std::move(entry.structure);
     return status::success;
 }
 
+status
+make_compiled_model(context& ctx,
+                    const std::string& model_file_path,
+                    std::shared_ptr<const Model>& model)
+{
+    std::shared_ptr<const solver_structure> structure;
+
+    return make_compiled_model(ctx, model_file_path, model, structure);
+}
+
 status
 make_options(context& ctx,
-             Model& model,
+             const Model& model,
              const std::string& options_file_path,
              Options& options)
 {
-    const auto ifs = input_file(options_file_path.c_str());
+    const auto ifs = input_file(options_file_path.c_str(), "rb");
     if (!ifs.is_open()) {
         ctx.data_1 = options_file_path;
         return ctx.status = status::file_error;
@@ -169,10 +313,12 @@ information(context& ctx,
             information_results& out) noexcept
 {
     try {
-        Model model;
-        if (auto ret = make_model(ctx, model_file_path, model); is_bad(ret))
+        std::shared_ptr<const Model> cached;
+        if (auto ret = make_model(ctx, model_file_path, cached); is_bad(ret))
             return ret;
 
+        const auto& model = *cached;
+
         out.basic_attribute_names.clear();
         out.basic_attribute_scale_value_numbers.clear();
 
@@ -208,42 +354,71 @@ is_valid_input_size(const size_t simulation,
            simulation == year && simulation == observed;
 }
 
+static void
+copy_column(const array_view& view, std::vector<int>& out)
+{
+    out.resize(view.size);
+
+    if (view.type == element_type::uint8) {
+        const auto* first = static_cast<const std::uint8_t*>(view.data);
+        std::copy(first, first + view.size, out.begin());
+    } else {
+        const auto* first = static_cast<const std::int32_t*>(view.data);
+        std::copy(first, first + view.size, out.begin());
+    }
+}
+
+/* Builds the options from the columns of a @e data or a @e data_view. The
+ * integer columns are read in place from the caller arrays. */
 static status
-make_options(context& ctx, const Model& model, const data& d, Options& opt)
+make_options(context& ctx,
+             const Model& model,
+             const std::vector<std::string>& simulations,
+             const std::vector<std::string>& places,
+             const array_view& departments,
+             const array_view& years,
+             const array_view& observed,
+             const array_view& scale_values,
+             Options& opt)
 {
     try {
-        const auto option_number = d.simulations.size();
+        const auto option_number = simulations.size();
 
         if (!is_valid_input_size(option_number,
-                                 d.places.size(),
-                                 d.departments.size(),
-                                 d.years.size(),
-                                 d.observed.size()))
+                                 places.size(),
+                                 departments.size,
+                                 years.size,
+                                 observed.size))
             return status::unconsistent_input_vector;
 
         opt.clear();
-        opt.simulations = d.simulations;
-        opt.places = d.places;
-        opt.departments = d.departments;
-        opt.years = d.years;
-        opt.observed = d.observed;
+        opt.simulations = simulations;
+        opt.places = places;
+        copy_column(departments, opt.departments);
+        copy_column(years, opt.years);
+        copy_column(observed, opt.observed);
 
         const auto attribute_number = model.get_basic_attribute().size();
 
         std::vector<size_t> ordered_att;
         reorder_basic_attribute(model, 0, ordered_att);
 
-        if (attribute_number * option_number != d.scale_values.size())
+        if (attribute_number * option_number != scale_values.size)
             return status::option_input_inconsistent;
 
+        std::vector<scale_id> limits(ordered_att.size());
+        for (size_t i = 0, e = ordered_att.size(); i != e; ++i)
+            limits[i] = model.attributes[ordered_att[i]].scale_size();
+
         opt.options.init(option_number, attribute_number);
         size_t optid = 0;
         size_t attid = 0;
-        for (auto& elem : d.scale_values) {
+        for (size_t i = 0, e = scale_values.size; i != e; ++i) {
+            const auto elem = scale_values[i];
             const auto attribute = ordered_att[attid];
-            const auto limit = model.attributes[attribute].scale_size();
+            const auto limit = limits[attid];
 
-            if (elem > limit) {
+            if (elem < 0 || elem >= limit) {
                 error(ctx,
                       "bad scale value: {} with a limit of {} for "
                       "attribute {}\n",
@@ -280,56 +455,263 @@ make_options(context& ctx, const Model& model, const data& d, Options& opt)
     }
 }
 
+static status
+make_options(context& ctx, const Model& model, const data& d, Options& opt)
+{
+    return make_options(ctx,
+                        model,
+                        d.simulations,
+                        d.places,
+                        d.departments,
+                        d.years,
+                        d.observed,
+                        d.scale_values,
+                        opt);
+}
+
+static status
+make_options(context& ctx,
+             const Model& model,
+             const data_view& d,
+             Options& opt)
+{
+    return make_options(ctx,
+                        model,
+                        d.simulations,
+                        d.places,
+                        d.departments,
+                        d.years,
+                        d.observed,
+                        d.scale_values,
+                        opt);
+}
+
+/* Rows evaluated by a thread of the parallel @e evaluate: fewer rows are
+ * faster on the calling thread than with a new thread. */
+static constexpr size_t evaluate_rows_per_thread = 4096;
+
+/* Evaluates the rows [@e begin, @e end) with its own @e solver and
+ * @e confusion matrix. The rows of different threads are disjoint: the
+ * writes into @e out do not overlap. The values of the aggregate
+ * attributes @e ids are copied from the solver pass into
+ * @e out.attributes. */
+static void
+evaluate_rows(const std::shared_ptr<const solver_structure>& structure,
+              const Options& options,
+              const std::vector<int>& ids,
+              size_t begin,
+              size_t end,
+              matrix<value>& confusion,
+              evaluation_results& out)
+{
+    solver_stack solver(structure);
+    const auto max_col = options.options.cols();
+    std::vector<std::uint8_t> values(ids.empty() ? 0 : structure->atts.size());
+
+    for (size_t opt = begin; opt != end; ++opt) {
+        out.observations[opt] = options.observed[opt];
+
+        if (ids.empty()) {
+            out.simulations[opt] = solver.solve(options.options.row(opt));
+        } else {
+            out.simulations[opt] =
+              solver.solve(options.options.row(opt), values.data());
+
+            for (size_t i = 0, e = ids.size(); i != e; ++i)
+                out.attributes(opt, i) = values[ids[i]];
+        }
+
+        confusion(out.observations[opt], out.simulations[opt])++;
+
+        for (size_t c = 0; c != max_col; ++c)
+            out.options(c, opt) = options.options(opt, c);
+    }
+}
+
+/* Returns the solver identifiers of the aggregate attributes selected by
+ * @e aggregates in the DEXi file order and fills their names. */
+static std::vector<int>
+select_aggregates(const Model& model,
+                  const solver_structure& structure,
+                  const std::vector<bool>* aggregates,
+                  std::vector<std::string>& names)
+{
+    std::vector<int> ids;
+    names.clear();
+    if (!aggregates)
+        return ids;
+
+    std::vector<int> id_of(model.attributes.size(), -1);
+    for (const auto& att : structure.atts)
+        id_of[static_cast<size_t>(att.att)] = att.id;
+
+    for (size_t i = 0, e = model.attributes.size(); i != e; ++i) {
+        if (id_of[i] < 0)
+            continue;
+
+        const bool selected = aggregates->empty() ||
+                              (i < aggregates->size() && (*aggregates)[i]);
+
+        if (selected) {
+            ids.emplace_back(id_of[i]);
+            names.emplace_back(model.attributes[i].name);
+        }
+    }
+
+    return ids;
+}
+
+/* Splits the rows in contiguous ranges, one per thread, and sums the
+ * confusion matrices of the threads. The kappa are computed from the sum. */
 static void
 evaluate([[maybe_unused]] context& ctx,
-         Model& model,
-         Options& options,
-         evaluation_results& out)
+         const Model& model,
+         const std::shared_ptr<const solver_structure>& structure,
+         const Options& options,
+         evaluation_results& out,
+         unsigned int thread,
+         const std::vector<bool>* aggregates)
 {
-    solver_stack solver(model);
     const auto max_opt = options.simulations.size();
+    const auto scale = model.attributes[0].scale.size();
     out.options.resize(options.options.cols(), max_opt);
     out.simulations.resize(max_opt, 0);
     out.observations.resize(max_opt, 0);
-    out.confusion.resize(
-      model.attributes[0].scale.size(), model.attributes[0].scale.size(), 0);
+    out.confusion.resize(scale, scale, 0);
+
+    const auto ids =
+      select_aggregates(model, *structure, aggregates, out.attribute_names);
+    out.attributes.resize(ids.empty() ? 0 : max_opt, ids.size());
+
+    const size_t workers = std::max<size_t>(
+      1,
+      std::min<size_t>(thread,
+                       (max_opt + evaluate_rows_per_thread - 1) /
+                         evaluate_rows_per_thread));
+
+    if (workers == 1) {
+        evaluate_rows(
+          structure, options, ids, 0, max_opt, out.confusion, out);
+    } else {
+        std::vector<matrix<value>> confusions(
+          workers - 1, matrix<value>(scale, scale, 0));
+        std::vector<std::exception_ptr> errors(workers - 1);
+        std::vector<std::thread> pool;
+        pool.reserve(workers - 1);
+
+        const size_t rows = (max_opt + workers - 1) / workers;
+        for (size_t i = 1; i != workers; ++i) {
+            const size_t begin = std::min(max_opt, i * rows);
+            const size_t end = std::min(max_opt, begin + rows);
+
+            pool.emplace_back([&, i, begin, end]() {
+                try {
+                    evaluate_rows(structure,
+                                  options,
+                                  ids,
+                                  begin,
+                                  end,
+                                  confusions[i - 1],
+                                  out);
+                } catch (...) {
+                    errors[i - 1] = std::current_exception();
+                }
+            });
+        }
 
-    for (size_t opt = 0; opt != max_opt; ++opt) {
-        out.observations[opt] = options.observed[opt];
-        out.simulations[opt] = solver.solve(options.options.row(opt));
-        out.confusion(out.observations[opt], out.simulations[opt])++;
-    }
+        std::exception_ptr error;
+        try {
+            evaluate_rows(
+              structure, options, ids, 0, rows, out.confusion, out);
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        for (auto& elem : pool)
+            elem.join();
 
-    weighted_kappa_calculator kappa_c(model.attributes[0].scale.size());
-    out.squared_weighted_kappa =
-      kappa_c.squared(out.observations, out.simulations);
-    out.linear_weighted_kappa =
-      kappa_c.linear(out.observations, out.simulations);
+        for (const auto& elem : errors)
+            if (elem && !error)
+                error = elem;
 
-    for (size_t r = 0, end_r = options.options.rows(); r != end_r; ++r)
-        for (size_t c = 0, end_c = options.options.cols(); c != end_c; ++c)
-            out.options(c, r) = options.options(r, c);
+        if (error)
+            std::rethrow_exception(error);
+
+        const auto size = static_cast<size_t>(scale);
+        for (const auto& confusion : confusions)
+            for (size_t r = 0; r != size; ++r)
+                for (size_t c = 0; c != size; ++c)
+                    out.confusion(r, c) += confusion(r, c);
+    }
+
+    weighted_kappa_calculator kappa_c(scale);
+    out.squared_weighted_kappa = kappa_c.squared(out.confusion);
+    out.linear_weighted_kappa = kappa_c.linear(out.confusion);
 }
 
 status
 evaluate(context& ctx,
          const std::string& model_file_path,
          const data& d,
-         evaluation_results& out) noexcept
+         evaluation_results& out,
+         unsigned int thread,
+         const std::vector<bool>* aggregates) noexcept
+{
+    try {
+        std::shared_ptr<const Model> compiled;
+        std::shared_ptr<const solver_structure> structure;
+        if (auto ret = make_compiled_model(
+              ctx, model_file_path, compiled, structure);
+            is_bad(ret))
+            return ret;
+
+        const auto& model = *compiled;
+
+        Options options;
+        if (auto ret = make_options(ctx, model, d, options); is_bad(ret))
+            return ret;
+
+        out.clear();
+        evaluate(
+          ctx, model, structure, options, out, thread, aggregates);
+        return ctx.status = status::success;
+    } catch (const std::bad_alloc& e) {
+        error(ctx, "c++ bad alloc: {}\n", e.what());
+        return ctx.status = status::not_enough_memory;
+    } catch (const std::exception& e) {
+        error(ctx, "c++ exception: {}\n", e.what());
+        return ctx.status = status::unknown_error;
+    } catch (...) {
+        error(ctx, "c++ unknown exception\n");
+        return ctx.status = status::unknown_error;
+    }
+}
+
+status
+evaluate(context& ctx,
+         const std::string& model_file_path,
+         const data_view& d,
+         evaluation_results& out,
+         unsigned int thread,
+         const std::vector<bool>* aggregates) noexcept
 {
     try {
-        Model model;
-        if (auto ret = make_model(ctx, model_file_path, model); is_bad(ret))
+        std::shared_ptr<const Model> compiled;
+        std::shared_ptr<const solver_structure> structure;
+        if (auto ret = make_compiled_model(
+              ctx, model_file_path, compiled, structure);
+            is_bad(ret))
             return ret;
 
-        model.clear_options();
+        const auto& model = *compiled;
 
         Options options;
         if (auto ret = make_options(ctx, model, d, options); is_bad(ret))
             return ret;
 
         out.clear();
-        evaluate(ctx, model, options, out);
+        evaluate(
+          ctx, model, structure, options, out, thread, aggregates);
         return ctx.status = status::success;
     } catch (const std::bad_alloc& e) {
         error(ctx, "c++ bad alloc: {}\n", e.what());
@@ -347,14 +729,19 @@ status
 evaluate(context& ctx,
          const std::string& model_file_path,
          const std::string& options_file_path,
-         evaluation_results& out) noexcept
+         evaluation_results& out,
+         unsigned int thread,
+         const std::vector<bool>* aggregates) noexcept
 {
     try {
-        Model model;
-        if (auto ret = make_model(ctx, model_file_path, model); is_bad(ret))
+        std::shared_ptr<const Model> compiled;
+        std::shared_ptr<const solver_structure> structure;
+        if (auto ret = make_compiled_model(
+              ctx, model_file_path, compiled, structure);
+            is_bad(ret))
             return ret;
 
-        model.clear_options();
+        const auto& model = *compiled;
 
         Options options;
         if (auto ret = make_options(ctx, model, options_file_path, options);
@@ -362,7 +749,58 @@ evaluate(context& ctx,
             return ret;
 
         out.clear();
-        evaluate(ctx, model, options, out);
+        evaluate(
+          ctx, model, structure, options, out, thread, aggregates);
+        return ctx.status = status::success;
+    } catch (const std::bad_alloc& e) {
+        error(ctx, "c++ bad alloc: {}\n", e.what());
+        return ctx.status = status::not_enough_memory;
+    } catch (const std::exception& e) {
+        error(ctx, "c++ exception: {}\n", e.what());
+        return ctx.status = status::unknown_error;
+    } catch (...) {
+        error(ctx, "c++ unknown exception\n");
+        return ctx.status = status::unknown_error;
+    }
+}
+
+status
+evaluate(context& ctx,
+         const std::string& model_file_path,
+         stream_reader_callback reader,
+         void* user_data_reader,
+         evaluation_block_callback callback,
+         void* user_data_callback,
+         size_t block_size,
+         unsigned int thread) noexcept
+{
+    try {
+        if (!reader || !callback || block_size == 0)
+            return ctx.status = status::unconsistent_input_vector;
+
+        std::shared_ptr<const Model> compiled;
+        std::shared_ptr<const solver_structure> structure;
+        if (auto ret = make_compiled_model(
+              ctx, model_file_path, compiled, structure);
+            is_bad(ret))
+            return ret;
+
+        const auto& model = *compiled;
+
+        options_stream stream(model, reader, user_data_reader);
+        if (auto ret = stream.read_header(ctx); is_bad(ret)) {
+            ctx.column = static_cast<int>(stream.error_at_column);
+            return ctx.status = ret;
+        }
+
+        evaluation_pipeline pipeline(ctx, model, structure, stream, thread);
+        if (auto ret = pipeline.run(callback, user_data_callback, block_size);
+            is_bad(ret)) {
+            ctx.line = static_cast<int>(stream.error_at_line);
+            ctx.column = static_cast<int>(stream.error_at_column);
+            return ctx.status = ret;
+        }
+
         return ctx.status = status::success;
     } catch (const std::bad_alloc& e) {
         error(ctx, "c++ bad alloc: {}\n", e.what());
@@ -376,6 +814,34 @@ evaluate(context& ctx,
     }
 }
 
+static size_t
+read_istream(char* buffer, size_t size, void* user_data)
+{
+    auto* is = static_cast<std::istream*>(user_data);
+    is->read(buffer, static_cast<std::streamsize>(size));
+
+    return static_cast<size_t>(is->gcount());
+}
+
+status
+evaluate(context& ctx,
+         const std::string& model_file_path,
+         std::istream& is,
+         evaluation_block_callback callback,
+         void* user_data_callback,
+         size_t block_size,
+         unsigned int thread) noexcept
+{
+    return evaluate(ctx,
+                    model_file_path,
+                    read_istream,
+                    &is,
+                    callback,
+                    user_data_callback,
+                    block_size,
+                    thread);
+}
+
 status
 adjustment(context& ctx,
            const std::string& model_file_path,
@@ -386,21 +852,24 @@ adjustment(context& ctx,
            void* user_data_interrupt,
            bool reduce,
            int limit,
-           [[maybe_unused]] unsigned int thread) noexcept
+           [[maybe_unused]] unsigned int thread,
+           unsigned int top,
+           line_order order) noexcept
 {
     try {
-        Model model;
-        if (auto ret = make_model(ctx, model_file_path, model); is_bad(ret))
+        std::shared_ptr<const Model> compiled;
+        if (auto ret = make_compiled_model(ctx, model_file_path, compiled);
+            is_bad(ret))
             return ret;
 
-        model.clear_options();
+        const auto& model = *compiled;
 
         Options options;
         if (auto ret = make_options(ctx, model, options_file_path, options);
             is_bad(ret))
             return ret;
 
-        efyj::adjustment_evaluator adj(ctx, model, options);
+        efyj::adjustment_evaluator adj(ctx, model, options, top, order);
         return interrupt
                  ? adj.run(interrupt,
                            user_data_interrupt,
@@ -436,20 +905,23 @@ adjustment(context& ctx,
            void* user_data_interrupt,
            bool reduce,
            int limit,
-           [[maybe_unused]] unsigned int thread) noexcept
+           [[maybe_unused]] unsigned int thread,
+           unsigned int top,
+           line_order order) noexcept
 {
     try {
-        Model model;
-        if (auto ret = make_model(ctx, model_file_path, model); is_bad(ret))
+        std::shared_ptr<const Model> compiled;
+        if (auto ret = make_compiled_model(ctx, model_file_path, compiled);
+            is_bad(ret))
             return ret;
 
-        model.clear_options();
+        const auto& model = *compiled;
 
         Options options;
         if (auto ret = make_options(ctx, model, d, options); is_bad(ret))
             return ret;
 
-        efyj::adjustment_evaluator adj(ctx, model, options);
+        efyj::adjustment_evaluator adj(ctx, model, options, top, order);
         return interrupt
                  ? adj.run(interrupt,
                            user_data_interrupt,
@@ -479,18 +951,20 @@ prediction(context& ctx,
            const std::string& options_file_path,
            result_callback callback,
            void* user_data_callback,
-           check_user_interrupt_callback /*interrupt*/,
-           void* /*user_data_interrupt*/,
+           check_user_interrupt_callback interrupt,
+           void* user_data_interrupt,
            bool reduce,
            int limit,
-           unsigned int thread) noexcept
+           unsigned int thread,
+           line_order order) noexcept
 {
     try {
-        Model model;
-        if (auto ret = make_model(ctx, model_file_path, model); is_bad(ret))
+        std::shared_ptr<const Model> compiled;
+        if (auto ret = make_compiled_model(ctx, model_file_path, compiled);
+            is_bad(ret))
             return ret;
 
-        model.clear_options();
+        const auto& model = *compiled;
 
         Options options;
         if (auto ret = make_options(ctx, model, options_file_path, options);
@@ -498,13 +972,28 @@ prediction(context& ctx,
             return ret;
 
         if (thread <= 1) {
-            efyj::prediction_evaluator pre(ctx, model, options);
-            pre.run(callback, user_data_callback, limit, 0.0, reduce, "");
+            efyj::prediction_evaluator pre(ctx, model, options, order);
+            pre.run(interrupt,
+                    user_data_interrupt,
+                    callback,
+                    user_data_callback,
+                    limit,
+                    0.0,
+                    reduce,
+                    "");
             return ctx.status = status::success;
         } else {
-            efyj::prediction_thread_evaluator pre(ctx, model, options);
-            pre.run(
-              callback, user_data_callback, limit, 0.0, reduce, thread, "");
+            efyj::prediction_thread_evaluator pre(
+              ctx, model, options, order);
+            pre.run(interrupt,
+                    user_data_interrupt,
+                    callback,
+                    user_data_callback,
+                    limit,
+                    0.0,
+                    reduce,
+                    thread,
+                    "");
             return ctx.status = status::success;
         }
     } catch (const std::bad_alloc& e) {
@@ -525,18 +1014,20 @@ prediction(context& ctx,
            const data& d,
            result_callback callback,
            void* user_data_callback,
-           check_user_interrupt_callback /*interrupt*/,
-           void* /*user_data_interrupt*/,
+           check_user_interrupt_callback interrupt,
+           void* user_data_interrupt,
            bool reduce,
            int limit,
-           unsigned int thread) noexcept
+           unsigned int thread,
+           line_order order) noexcept
 {
     try {
-        Model model;
-        if (auto ret = make_model(ctx, model_file_path, model); is_bad(ret))
+        std::shared_ptr<const Model> compiled;
+        if (auto ret = make_compiled_model(ctx, model_file_path, compiled);
+            is_bad(ret))
             return ret;
 
-        model.clear_options();
+        const auto& model = *compiled;
 
         Options options;
         if (auto ret = make_options(ctx, model, d, options); is_bad(ret))
@@ -546,13 +1037,28 @@ prediction(context& ctx,
             return status::option_input_inconsistent;
 
         if (thread <= 1) {
-            efyj::prediction_evaluator pre(ctx, model, options);
-            pre.run(callback, user_data_callback, limit, 0.0, reduce, "");
+            efyj::prediction_evaluator pre(ctx, model, options, order);
+            pre.run(interrupt,
+                    user_data_interrupt,
+                    callback,
+                    user_data_callback,
+                    limit,
+                    0.0,
+                    reduce,
+                    "");
             return ctx.status = status::success;
         } else {
-            efyj::prediction_thread_evaluator pre(ctx, model, options);
-            pre.run(
-              callback, user_data_callback, limit, 0.0, reduce, thread, "");
+            efyj::prediction_thread_evaluator pre(
+              ctx, model, options, order);
+            pre.run(interrupt,
+                    user_data_interrupt,
+                    callback,
+                    user_data_callback,
+                    limit,
+                    0.0,
+                    reduce,
+                    thread,
+                    "");
             return ctx.status = status::success;
         }
     } catch (const std::bad_alloc& e) {
@@ -583,10 +1089,12 @@ extract_options_to_file(context& ctx,
             return ctx.status = status::extract_option_same_input_files;
         }
 
-        Model model;
-        if (auto ret = make_model(ctx, model_file_path, model); is_bad(ret))
+        std::shared_ptr<const Model> cached;
+        if (auto ret = make_model(ctx, model_file_path, cached); is_bad(ret))
             return ret;
 
+        const auto& model = *cached;
+
         const auto ofs = output_file(output_file_path.c_str());
         if (!ofs.is_open()) {
             ctx.data_1 = output_file_path;
@@ -606,6 +1114,550 @@ extract_options_to_file(context& ctx,
     }
 }
 
+status
+load_model(context& ctx,
+           const std::string& model_file_path,
+           model_handle& out) noexcept
+{
+    try {
+        auto handle = std::make_shared<model_handle::impl>();
+        if (auto ret = make_compiled_model(
+              ctx, model_file_path, handle->model, handle->structure);
+            is_bad(ret))
+            return ret;
+
+        handle->fingerprint = model_fingerprint(*handle->model);
+        out = model_handle(std::move(handle));
+
+        return status::success;
+    } catch (const std::bad_alloc& e) {
+        error(ctx, "c++ bad alloc: {}\n", e.what());
+        return ctx.status = status::not_enough_memory;
+    } catch (const std::exception& e) {
+        error(ctx, "c++ exception: {}\n", e.what());
+        return ctx.status = status::unknown_error;
+    } catch (...) {
+        error(ctx, "c++ unknown exception\n");
+        return ctx.status = status::unknown_error;
+    }
+}
+
+status
+load_dataset(context& ctx,
+             const model_handle& model,
+             const std::string& options_file_path,
+             dataset_handle& out) noexcept
+{
+    try {
+        if (model.empty())
+            return ctx.status = status::internal_error;
+
+        auto handle = std::make_shared<dataset_handle::impl>();
+        if (auto ret = make_options(
+              ctx, *model.get()->model, options_file_path, handle->options);
+            is_bad(ret))
+            return ret;
+
+        handle->fingerprint = model.get()->fingerprint;
+        out = dataset_handle(std::move(handle));
+
+        return status::success;
+    } catch (const std::bad_alloc& e) {
+        error(ctx, "c++ bad alloc: {}\n", e.what());
+        return ctx.status = status::not_enough_memory;
+    } catch (const std::exception& e) {
+        error(ctx, "c++ exception: {}\n", e.what());
+        return ctx.status = status::unknown_error;
+    } catch (...) {
+        error(ctx, "c++ unknown exception\n");
+        return ctx.status = status::unknown_error;
+    }
+}
+
+status
+load_dataset(context& ctx,
+             const model_handle& model,
+             const data& d,
+             dataset_handle& out) noexcept
+{
+    try {
+        if (model.empty())
+            return ctx.status = status::internal_error;
+
+        auto handle = std::make_shared<dataset_handle::impl>();
+        if (auto ret =
+              make_options(ctx, *model.get()->model, d, handle->options);
+            is_bad(ret))
+            return ret;
+
+        handle->fingerprint = model.get()->fingerprint;
+        out = dataset_handle(std::move(handle));
+
+        return status::success;
+    } catch (const std::bad_alloc& e) {
+        error(ctx, "c++ bad alloc: {}\n", e.what());
+        return ctx.status = status::not_enough_memory;
+    } catch (const std::exception& e) {
+        error(ctx, "c++ exception: {}\n", e.what());
+        return ctx.status = status::unknown_error;
+    } catch (...) {
+        error(ctx, "c++ unknown exception\n");
+        return ctx.status = status::unknown_error;
+    }
+}
+
+status
+load_dataset(context& ctx,
+             const model_handle& model,
+             const data_view& d,
+             dataset_handle& out) noexcept
+{
+    try {
+        if (model.empty())
+            return ctx.status = status::internal_error;
+
+        auto handle = std::make_shared<dataset_handle::impl>();
+        if (auto ret =
+              make_options(ctx, *model.get()->model, d, handle->options);
+            is_bad(ret))
+            return ret;
+
+        handle->fingerprint = model.get()->fingerprint;
+        out = dataset_handle(std::move(handle));
+
+        return status::success;
+    } catch (const std::bad_alloc& e) {
+        error(ctx, "c++ bad alloc: {}\n", e.what());
+        return ctx.status = status::not_enough_memory;
+    } catch (const std::exception& e) {
+        error(ctx, "c++ exception: {}\n", e.what());
+        return ctx.status = status::unknown_error;
+    } catch (...) {
+        error(ctx, "c++ unknown exception\n");
+        return ctx.status = status::unknown_error;
+    }
+}
+
+/* A dataset handle can only be used with a model of the same fingerprint
+ * as the model used to read it. */
+static status
+check_handles(context& ctx,
+              const model_handle& model,
+              const dataset_handle& dataset) noexcept
+{
+    if (model.empty() || dataset.empty())
+        return ctx.status = status::internal_error;
+
+    if (model.get()->fingerprint != dataset.get()->fingerprint)
+        return ctx.status = status::dataset_model_mismatch;
+
+    return status::success;
+}
+
+status
+evaluate(context& ctx,
+         const model_handle& model,
+         const dataset_handle& dataset,
+         evaluation_results& out,
+         unsigned int thread,
+         const std::vector<bool>* aggregates) noexcept
+{
+    try {
+        if (auto ret = check_handles(ctx, model, dataset); is_bad(ret))
+            return ret;
+
+        out.clear();
+        evaluate(ctx,
+                 *model.get()->model,
+                 model.get()->structure,
+                 dataset.get()->options,
+                 out,
+                 thread,
+                 aggregates);
+        return ctx.status = status::success;
+    } catch (const std::bad_alloc& e) {
+        error(ctx, "c++ bad alloc: {}\n", e.what());
+        return ctx.status = status::not_enough_memory;
+    } catch (const std::exception& e) {
+        error(ctx, "c++ exception: {}\n", e.what());
+        return ctx.status = status::unknown_error;
+    } catch (...) {
+        error(ctx, "c++ unknown exception\n");
+        return ctx.status = status::unknown_error;
+    }
+}
+
+status
+adjustment(context& ctx,
+           const model_handle& model,
+           const dataset_handle& dataset,
+           result_callback callback,
+           void* user_data_callback,
+           check_user_interrupt_callback interrupt,
+           void* user_data_interrupt,
+           bool reduce,
+           int limit,
+           [[maybe_unused]] unsigned int thread,
+           unsigned int top,
+           line_order order) noexcept
+{
+    try {
+        if (auto ret = check_handles(ctx, model, dataset); is_bad(ret))
+            return ret;
+
+        efyj::adjustment_evaluator adj(ctx,
+                                       *model.get()->model,
+                                       dataset.get()->options,
+                                       top,
+                                       order);
+        return interrupt
+                 ? adj.run(interrupt,
+                           user_data_interrupt,
+                           callback,
+                           user_data_callback,
+                           limit,
+                           0.0,
+                           reduce,
+                           "")
+                 : adj.run(
+                     callback, user_data_callback, limit, 0.0, reduce, "");
+    } catch (const std::bad_alloc& e) {
+        error(ctx, "c++ bad alloc: {}\n", e.what());
+        return ctx.status = status::not_enough_memory;
+    } catch (const std::exception& e) {
+        error(ctx, "c++ exception: {}\n", e.what());
+        return ctx.status = status::unknown_error;
+    } catch (...) {
+        error(ctx, "c++ unknown exception\n");
+        return ctx.status = status::unknown_error;
+    }
+}
+
+status
+prediction(context& ctx,
+           const model_handle& model,
+           const dataset_handle& dataset,
+           result_callback callback,
+           void* user_data_callback,
+           check_user_interrupt_callback interrupt,
+           void* user_data_interrupt,
+           bool reduce,
+           int limit,
+           unsigned int thread,
+           line_order order) noexcept
+{
+    try {
+        if (auto ret = check_handles(ctx, model, dataset); is_bad(ret))
+            return ret;
+
+        const auto& mdl = *model.get()->model;
+        const auto& options = dataset.get()->options;
+
+        if (thread <= 1) {
+            efyj::prediction_evaluator pre(ctx, mdl, options, order);
+            pre.run(interrupt,
+                    user_data_interrupt,
+                    callback,
+                    user_data_callback,
+                    limit,
+                    0.0,
+                    reduce,
+                    "");
+        } else {
+            efyj::prediction_thread_evaluator pre(ctx, mdl, options, order);
+            pre.run(interrupt,
+                    user_data_interrupt,
+                    callback,
+                    user_data_callback,
+                    limit,
+                    0.0,
+                    reduce,
+                    thread,
+                    "");
+        }
+
+        return ctx.status = status::success;
+    } catch (const std::bad_alloc& e) {
+        error(ctx, "c++ bad alloc: {}\n", e.what());
+        return ctx.status = status::not_enough_memory;
+    } catch (const std::exception& e) {
+        error(ctx, "c++ exception: {}\n", e.what());
+        return ctx.status = status::unknown_error;
+    } catch (...) {
+        error(ctx, "c++ unknown exception\n");
+        return ctx.status = status::unknown_error;
+    }
+}
+
+void
+job::impl::release() noexcept
+{
+    state.cancelled.store(true, std::memory_order_relaxed);
+
+    if (id == std::this_thread::get_id())
+        thread.detach();
+    else
+        join();
+}
+
+void
+job::impl::join() noexcept
+{
+    if (id == std::this_thread::get_id())
+        return;
+
+    std::call_once(joined, [this]() {
+        if (thread.joinable())
+            thread.join();
+    });
+}
+
+job_progress
+job::progress() const noexcept
+{
+    job_progress ret;
+    if (!m_impl)
+        return ret;
+
+    const auto& state = m_impl->state;
+    ret.candidates = state.candidates.load(std::memory_order_relaxed);
+    ret.kappa = state.kappa.load(std::memory_order_relaxed);
+    ret.step = state.step.load(std::memory_order_relaxed);
+    ret.steps = state.steps.load(std::memory_order_relaxed);
+    ret.cancelled = state.is_cancelled();
+    ret.done = m_impl->done.load(std::memory_order_acquire);
+    ret.elapsed = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - m_impl->start)
+                    .count();
+
+    // The candidates are evaluated at a steady rate: the remaining time is
+    // the time spent so far scaled by the remaining candidates.
+    const auto expected = state.expected.load(std::memory_order_relaxed);
+    if (ret.done)
+        ret.remaining = 0.0;
+    else if (ret.candidates > 0 && expected > 0.0)
+        ret.remaining =
+          std::max(0.0,
+                   (expected - static_cast<double>(ret.candidates)) *
+                     ret.elapsed / static_cast<double>(ret.candidates));
+
+    return ret;
+}
+
+void
+job::cancel() noexcept
+{
+    if (m_impl)
+        m_impl->state.cancelled.store(true, std::memory_order_relaxed);
+}
+
+status
+job::wait(context& ctx) noexcept
+{
+    if (!m_impl || m_impl->id == std::this_thread::get_id())
+        return ctx.status = status::internal_error;
+
+    m_impl->join();
+
+    const auto& job_ctx = m_impl->ctx;
+    ctx.line = job_ctx.line;
+    ctx.column = job_ctx.column;
+    ctx.size = job_ctx.size;
+
+    try {
+        ctx.data_1 = job_ctx.data_1;
+    } catch (...) {
+    }
+
+    return ctx.status = job_ctx.status;
+}
+
+/* Runs @e f(context, progress) in the thread of a new job. The context of
+ * the job is a copy of @e ctx. The thread and the copies of the job share
+ * the @e impl; the last copy of the job releases the thread. */
+template<typename Function>
+static status
+start_job(context& ctx, job& out, Function f)
+{
+    auto shared = std::make_shared<job::impl>();
+    shared->ctx = ctx;
+    shared->start = std::chrono::steady_clock::now();
+
+    auto* j = shared.get();
+    std::shared_ptr<job::impl> handle(
+      j, [shared](job::impl* ptr) { ptr->release(); });
+
+    j->thread = std::thread([j, shared, f]() {
+        try {
+            j->ctx.status = f(j->ctx, j->state);
+        } catch (const std::bad_alloc& e) {
+            error(j->ctx, "c++ bad alloc: {}\n", e.what());
+            j->ctx.status = status::not_enough_memory;
+        } catch (const std::exception& e) {
+            error(j->ctx, "c++ exception: {}\n", e.what());
+            j->ctx.status = status::unknown_error;
+        } catch (...) {
+            error(j->ctx, "c++ unknown exception\n");
+            j->ctx.status = status::unknown_error;
+        }
+
+        j->done.store(true, std::memory_order_release);
+    });
+    j->id = j->thread.get_id();
+
+    out = job(std::move(handle));
+    return ctx.status = status::success;
+}
+
+static bool
+continue_job(const result& /*r*/, void* /*user_data*/)
+{
+    return true;
+}
+
+status
+start_adjustment(context& ctx,
+                 const model_handle& model,
+                 const dataset_handle& dataset,
+                 result_callback callback,
+                 void* user_data_callback,
+                 bool reduce,
+                 int limit,
+                 job& out,
+                 unsigned int top,
+                 line_order order) noexcept
+{
+    try {
+        if (auto ret = check_handles(ctx, model, dataset); is_bad(ret))
+            return ret;
+
+        if (!callback)
+            callback = continue_job;
+
+        return start_job(ctx, out, [=](context& job_ctx, progress& state) {
+            efyj::adjustment_evaluator adj(job_ctx,
+                                           *model.get()->model,
+                                           dataset.get()->options,
+                                           top,
+                                           order);
+            adj.m_progress = &state;
+
+            return adj.run(
+              callback, user_data_callback, limit, 0.0, reduce, "");
+        });
+    } catch (const std::bad_alloc& e) {
+        error(ctx, "c++ bad alloc: {}\n", e.what());
+        return ctx.status = status::not_enough_memory;
+    } catch (const std::exception& e) {
+        error(ctx, "c++ exception: {}\n", e.what());
+        return ctx.status = status::unknown_error;
+    } catch (...) {
+        error(ctx, "c++ unknown exception\n");
+        return ctx.status = status::unknown_error;
+    }
+}
+
+status
+start_prediction(context& ctx,
+                 const model_handle& model,
+                 const dataset_handle& dataset,
+                 result_callback callback,
+                 void* user_data_callback,
+                 bool reduce,
+                 int limit,
+                 unsigned int thread,
+                 job& out,
+                 line_order order) noexcept
+{
+    try {
+        if (auto ret = check_handles(ctx, model, dataset); is_bad(ret))
+            return ret;
+
+        if (!callback)
+            callback = continue_job;
+
+        return start_job(ctx, out, [=](context& job_ctx, progress& state) {
+            const auto& mdl = *model.get()->model;
+            const auto& options = dataset.get()->options;
+
+            if (thread <= 1) {
+                efyj::prediction_evaluator pre(job_ctx, mdl, options, order);
+                pre.m_progress = &state;
+                return pre.run(
+                  callback, user_data_callback, limit, 0.0, reduce, "");
+            }
+
+            efyj::prediction_thread_evaluator pre(
+              job_ctx, mdl, options, order);
+            pre.m_progress = &state;
+            return pre.run(
+              callback, user_data_callback, limit, 0.0, reduce, thread, "");
+        });
+    } catch (const std::bad_alloc& e) {
+        error(ctx, "c++ bad alloc: {}\n", e.what());
+        return ctx.status = status::not_enough_memory;
+    } catch (const std::exception& e) {
+        error(ctx, "c++ exception: {}\n", e.what());
+        return ctx.status = status::unknown_error;
+    } catch (...) {
+        error(ctx, "c++ unknown exception\n");
+        return ctx.status = status::unknown_error;
+    }
+}
+
+status
+convert_options_to_file(context& ctx,
+                        const std::string& model_file_path,
+                        const std::string& options_file_path,
+                        const std::string& output_file_path) noexcept
+{
+    try {
+        debug(ctx,
+              "[efyj] convert options from csv file {} to dataset file {}",
+              options_file_path,
+              output_file_path);
+
+        if (model_file_path == output_file_path ||
+            options_file_path == output_file_path) {
+            ctx.data_1 = output_file_path;
+            return ctx.status = status::extract_option_same_input_files;
+        }
+
+        std::shared_ptr<const Model> cached;
+        if (auto ret = make_model(ctx, model_file_path, cached); is_bad(ret))
+            return ret;
+
+        const auto& model = *cached;
+
+        Options options;
+        if (auto ret = make_options(ctx, model, options_file_path, options);
+            is_bad(ret))
+            return ret;
+
+        const auto ofs = output_file(output_file_path.c_str(), "wb");
+        if (!ofs.is_open()) {
+            ctx.data_1 = output_file_path;
+            return ctx.status = status::file_error;
+        }
+
+        if (auto ret = options.write_binary(ofs, model); is_bad(ret)) {
+            ctx.data_1 = output_file_path;
+            return ctx.status = ret;
+        }
+
+        return status::success;
+    } catch (const std::bad_alloc& e) {
+        error(ctx, "c++ bad alloc: {}\n", e.what());
+        return ctx.status = status::not_enough_memory;
+    } catch (const std::exception& e) {
+        error(ctx, "c++ exception: {}\n", e.what());
+        return ctx.status = status::unknown_error;
+    } catch (...) {
+        error(ctx, "c++ unknown exception\n");
+        return ctx.status = status::unknown_error;
+    }
+}
+
 status
 extract_options(context& ctx,
                 const std::string& model_file_path,
@@ -615,10 +1667,12 @@ extract_options(context& ctx,
         debug(
           ctx, "[efyj] extract options from DEXi file {}", model_file_path);
 
-        Model model;
-        if (auto ret = make_model(ctx, model_file_path, model); is_bad(ret))
+        std::shared_ptr<const Model> cached;
+        if (auto ret = make_model(ctx, model_file_path, cached); is_bad(ret))
             return ret;
 
+        const auto& model = *cached;
+
         Options opts;
         if (auto ret = get_options_model(model, opts); is_bad(ret))
             return ret;
@@ -661,10 +1715,12 @@ extract_options(context& ctx,
         debug(
           ctx, "[efyj] extract options from DEXi file {}", model_file_path);
 
-        Model model;
-        if (auto ret = make_model(ctx, model_file_path, model); is_bad(ret))
+        std::shared_ptr<const Model> cached;
+        if (auto ret = make_model(ctx, model_file_path, cached); is_bad(ret))
             return ret;
 
+        const auto& model = *cached;
+
         Options options;
         if (auto ret = make_options(ctx, model, options_file_path, options);
             is_bad(ret))
@@ -716,10 +1772,13 @@ merge_options_to_file(context& ctx,
             return ctx.status = status::merge_option_same_inputoutput;
         }
 
-        Model model;
-        if (auto ret = make_model(ctx, model_file_path, model); is_bad(ret))
+        std::shared_ptr<const Model> cached;
+        if (auto ret = make_model(ctx, model_file_path, cached); is_bad(ret))
             return ret;
 
+        /* The options of the file are replaced in a copy of the model. */
+        Model model = *cached;
+
         Options options;
         if (auto ret = make_options(ctx, model, options_file_path, options);
             is_bad(ret))
@@ -763,10 +1822,13 @@ merge_options(context& ctx,
             return ctx.status = status::merge_option_same_inputoutput;
         }
 
-        Model model;
-        if (auto ret = make_model(ctx, model_file_path, model); is_bad(ret))
+        std::shared_ptr<const Model> cached;
+        if (auto ret = make_model(ctx, model_file_path, cached); is_bad(ret))
             return ret;
 
+        /* The options of the file are replaced in a copy of the model. */
+        Model model = *cached;
+
         Options options;
         if (auto ret = make_options(ctx, model, d, options); is_bad(ret))
             return ret;
@@ -24,15 +24,76 @@
 
 #include "model.hpp"
 #include "options.hpp"
+#include "progress.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 namespace efyj {
 
+struct solver_structure;
+
+struct model_handle::impl
+{
+    std::shared_ptr<const Model> model; ///< model without its options.
+    std::shared_ptr<const solver_structure> structure;
+    std::uint64_t fingerprint;
+};
+
+struct dataset_handle::impl
+{
+    Options options;
+    std::uint64_t fingerprint; ///< fingerprint of the model used to read.
+};
+
+struct job::impl
+{
+    context ctx; ///< copy of the caller context used by the computation.
+    efyj::progress state;
+    std::chrono::steady_clock::time_point start;
+    std::atomic<bool> done{ false };
+    std::thread thread;
+    std::thread::id id; ///< identifier of @e thread.
+    std::once_flag joined;
+
+    /** Cancels the computation and joins its thread. Called from the
+     * computation itself (a callback dropping the last @e job), the thread
+     * is detached: it owns the @e impl until its end. */
+    void release() noexcept;
+
+    /** Joins the thread, does nothing from the computation itself. */
+    void join() noexcept;
+};
+
+/** Returns in @e model the DEXi file @e model_file_path with its options.
+ * The models are kept in an in-process cache keyed by canonical path and
+ * shared while the size and the content hash of the file are unchanged:
+ * the model must not be modified. */
+status
+make_model(context& ctx,
+           const std::string& model_file_path,
+           std::shared_ptr<const Model>& model);
+
+/** Same as above but returns the model without its options, used by the
+ * evaluations, and its compiled solver structure, both built once per
+ * cache entry. */
+status
+make_compiled_model(context& ctx,
+                    const std::string& model_file_path,
+                    std::shared_ptr<const Model>& model,
+                    std::shared_ptr<const solver_structure>& structure);
+
 status
-make_model(context& ctx, const std::string& model_file_path, Model& model);
+make_compiled_model(context& ctx,
+                    const std::string& model_file_path,
+                    std::shared_ptr<const Model>& model);
 
 status
 make_options(context& ctx,
-             Model& model,
+             const Model& model,
              const std::string& options_file_path,
              Options& options);
 
@@ -0,0 +1,196 @@
+/* Copyright (C) 2016-2021 INRAE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <thread>
+
+#include "evaluation-pipeline.hpp"
+#include "post.hpp"
+#include "private.hpp"
+
+namespace efyj {
+
+evaluation_pipeline::evaluation_pipeline(
+  context& ctx,
+  const Model& model,
+  const std::shared_ptr<const solver_structure>& structure,
+  options_stream& stream,
+  unsigned int threads)
+  : m_context(ctx)
+  , m_model(model)
+  , m_stream(stream)
+{
+    m_workers.reserve(std::max(threads, 1u));
+    for (unsigned int i = 0; i < std::max(threads, 1u); ++i)
+        m_workers.emplace_back(std::make_unique<worker>(structure));
+}
+
+void
+evaluation_pipeline::parse(size_t block_size) noexcept
+{
+    try {
+        size_t next = 0;
+
+        while (!m_stream.eof()) {
+            auto& input = m_workers[next % m_workers.size()]->input;
+            auto* slot = input.back(m_stop);
+            if (!slot)
+                return;
+
+            if (auto ret = m_stream.read(m_context, block_size, slot->rows);
+                is_bad(ret)) {
+                m_parser_status = ret;
+                break;
+            }
+
+            /* A block of skipped lines is not sent to the workers. */
+            if (slot->rows.size() == 0)
+                continue;
+
+            slot->last = false;
+            input.push();
+            ++next;
+        }
+    } catch (...) {
+        m_parser_exception = std::current_exception();
+    }
+
+    /* The marker follows the last block in each ring: the writer finds it
+     * at the position of the first missing block. */
+    for (auto& w : m_workers) {
+        auto* slot = w->input.back(m_stop);
+        if (!slot)
+            return;
+
+        slot->last = true;
+        w->input.push();
+    }
+}
+
+void
+evaluation_pipeline::evaluate(worker& w) noexcept
+{
+    const auto cols = m_stream.columns();
+
+    try {
+        for (;;) {
+            auto* in = w.input.front(m_stop);
+            if (!in)
+                return;
+
+            auto* out = w.output.back(m_stop);
+            if (!out)
+                return;
+
+            std::swap(*in, *out);
+            w.input.pop();
+
+            if (!out->last) {
+                const auto& rows = out->rows;
+                out->simulated.resize(rows.size());
+
+                for (size_t row = 0, e = rows.size(); row != e; ++row)
+                    out->simulated[row] =
+                      w.solver.solve(rows.options.data() + row * cols);
+            }
+
+            const bool last = out->last;
+            w.output.push();
+
+            if (last)
+                return;
+        }
+    } catch (...) {
+        w.exception = std::current_exception();
+        m_stop.store(true);
+    }
+}
+
+status
+evaluation_pipeline::run(evaluation_block_callback callback,
+                         void* user_data_callback,
+                         size_t block_size)
+{
+    const auto scale_size = m_model.attributes[0].scale.size();
+    weighted_kappa_calculator kappa_c(static_cast<int>(scale_size));
+    evaluation_block out;
+    out.confusion.resize(scale_size, scale_size, 0);
+    out.total_rows = 0;
+
+    std::vector<std::thread> threads;
+    threads.reserve(m_workers.size() + 1);
+    threads.emplace_back([this, block_size]() { parse(block_size); });
+    for (auto& w : m_workers)
+        threads.emplace_back([this, &w]() { evaluate(*w); });
+
+    std::exception_ptr exception;
+
+    try {
+        for (size_t next = 0;; ++next) {
+            auto& output = m_workers[next % m_workers.size()]->output;
+            auto* slot = output.front(m_stop);
+            if (!slot || slot->last)
+                break;
+
+            /* The vectors of the previous block go back to the rings. */
+            auto& rows = slot->rows;
+            std::swap(out.identifiers, rows.simulations);
+            std::swap(out.places, rows.places);
+            std::swap(out.departments, rows.departments);
+            std::swap(out.years, rows.years);
+            std::swap(out.observations, rows.observed);
+            std::swap(out.simulations, slot->simulated);
+            output.pop();
+
+            for (size_t row = 0, e = out.size(); row != e; ++row)
+                out.confusion(out.observations[row], out.simulations[row])++;
+
+            out.first_row = out.total_rows;
+            out.total_rows += out.size();
+            out.linear_weighted_kappa = kappa_c.linear(out.confusion);
+            out.squared_weighted_kappa = kappa_c.squared(out.confusion);
+
+            if (!callback(out, user_data_callback))
+                break;
+        }
+    } catch (...) {
+        exception = std::current_exception();
+    }
+
+    /* Wakes up the stages waiting for a slot after an early stop. */
+    m_stop.store(true);
+    for (auto& thread : threads)
+        thread.join();
+
+    if (exception)
+        std::rethrow_exception(exception);
+
+    for (auto& w : m_workers)
+        if (w->exception)
+            std::rethrow_exception(w->exception);
+
+    if (m_parser_exception)
+        std::rethrow_exception(m_parser_exception);
+
+    return m_parser_status;
+}
+
+} // namespace efyj
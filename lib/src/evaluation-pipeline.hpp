@@ -0,0 +1,200 @@
+/* Copyright (C) 2016-2021 INRAE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef ORG_VLEPROJECT_EFYJ_DETAILS_EVALUATION_PIPELINE_HPP
+#define ORG_VLEPROJECT_EFYJ_DETAILS_EVALUATION_PIPELINE_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "model.hpp"
+#include "options.hpp"
+#include "solver-stack.hpp"
+
+namespace efyj {
+
+/** A @e block_ring is a bounded single-producer/single-consumer queue of
+ * reusable slots. The producer fills the slot returned by @e back() then
+ * calls @e push(), the consumer reads the slot returned by @e front() then
+ * calls @e pop(). Both wait while the ring is full or empty and return
+ * nullptr if @e stop is set in the meantime. A waiting side spins a few
+ * times then sleeps until the other side notifies it: a stage waiting for
+ * a slow reader does not keep a core busy.
+ */
+template<typename T, size_t Capacity>
+class block_ring
+{
+public:
+    T* back(const std::atomic<bool>& stop) noexcept
+    {
+        const auto tail = m_tail.load(std::memory_order_relaxed);
+
+        if (!wait(stop, [this, tail]() {
+                return tail - m_head.load(std::memory_order_acquire) !=
+                       Capacity;
+            }))
+            return nullptr;
+
+        return &m_slots[tail % Capacity];
+    }
+
+    void push() noexcept
+    {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_release);
+        notify();
+    }
+
+    T* front(const std::atomic<bool>& stop) noexcept
+    {
+        const auto head = m_head.load(std::memory_order_relaxed);
+
+        if (!wait(stop, [this, head]() {
+                return head != m_tail.load(std::memory_order_acquire);
+            }))
+            return nullptr;
+
+        return &m_slots[head % Capacity];
+    }
+
+    void pop() noexcept
+    {
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_release);
+        notify();
+    }
+
+private:
+    static constexpr int spin_number = 64;
+
+    /* The stop flag is set without notification: the sleeping side polls
+     * it at this resolution. */
+    static constexpr std::chrono::milliseconds stop_resolution{ 10 };
+
+    std::array<T, Capacity> m_slots;
+    alignas(64) std::atomic<size_t> m_head{ 0 }; ///< next slot to read.
+    alignas(64) std::atomic<size_t> m_tail{ 0 }; ///< next slot to fill.
+    std::mutex m_mutex;
+    std::condition_variable m_ready;
+
+    template<typename Predicate>
+    bool wait(const std::atomic<bool>& stop, Predicate ready) noexcept
+    {
+        for (int i = 0; i != spin_number; ++i) {
+            if (ready())
+                return true;
+
+            if (stop.load(std::memory_order_relaxed))
+                return false;
+
+            std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!ready()) {
+            if (stop.load(std::memory_order_relaxed))
+                return false;
+
+            m_ready.wait_for(lock, stop_resolution);
+        }
+
+        return true;
+    }
+
+    /* Taking the mutex after the index update orders the notification
+     * after the predicate check of a side going to sleep. */
+    void notify() noexcept
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+        }
+
+        m_ready.notify_one();
+    }
+};
+
+/** A block of rows moving through the pipeline. The slots are swapped
+ * between the rings to reuse their memory. */
+struct pipeline_block
+{
+    options_block rows;
+    std::vector<int> simulated;
+    bool last = false; ///< end of the stream marker.
+};
+
+/** The @e evaluation_pipeline evaluates a CSV options stream in three
+ * stages: a thread parses the blocks of rows, the workers evaluate them
+ * and the calling thread sends them to the callback. The block @e i is
+ * evaluated by the worker @e i modulo the number of workers: each worker
+ * has an input and an output ring and the blocks are sent in file order.
+ */
+struct evaluation_pipeline
+{
+    static constexpr size_t ring_capacity = 4;
+
+    using ring = block_ring<pipeline_block, ring_capacity>;
+
+    struct worker
+    {
+        solver_stack solver;
+        ring input;
+        ring output;
+        std::exception_ptr exception;
+
+        explicit worker(std::shared_ptr<const solver_structure> structure)
+          : solver(std::move(structure))
+        {}
+    };
+
+    context& m_context;
+    const Model& m_model;
+    options_stream& m_stream;
+
+    std::vector<std::unique_ptr<worker>> m_workers;
+    std::atomic<bool> m_stop{ false };
+    std::exception_ptr m_parser_exception;
+    status m_parser_status = status::success;
+
+    evaluation_pipeline(
+      context& ctx,
+      const Model& model,
+      const std::shared_ptr<const solver_structure>& structure,
+      options_stream& stream,
+      unsigned int threads);
+
+    status run(evaluation_block_callback callback,
+               void* user_data_callback,
+               size_t block_size);
+
+private:
+    void parse(size_t block_size) noexcept;
+    void evaluate(worker& w) noexcept;
+};
+
+} // namespace efyj
+
+#endif
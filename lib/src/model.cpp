@@ -20,12 +20,16 @@
  */
 
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <deque>
 #include <initializer_list>
 #include <limits>
 #include <optional>
 #include <stack>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
@@ -1006,6 +1010,112 @@ Model::write(context& ctx, const output_file& os)
     return dw.write();
 }
 
+std::uint64_t
+model_fingerprint(const Model& model) noexcept
+{
+    std::uint64_t hash = UINT64_C(14695981039346656037);
+
+    auto update = [&hash](std::string_view str) {
+        for (const char c : str) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= UINT64_C(1099511628211);
+        }
+
+        hash ^= 0xff;
+        hash *= UINT64_C(1099511628211);
+    };
+
+    auto update_attribute = [&update](const attribute& att) {
+        update(att.name);
+        for (const auto& value : att.scale.scale)
+            update(value.name);
+        update({});
+    };
+
+    for (const auto& att : model.attributes)
+        if (att.is_basic())
+            update_attribute(att);
+
+    if (!model.attributes.empty())
+        update_attribute(model.attributes[0]);
+
+    return hash;
+}
+
+model_lookup::model_lookup(const Model& model)
+{
+    /* The scale values of the basic attributes are followed by the scale
+     * values of the root attribute, the observed values of the options. */
+    auto push_scale = [this](const attribute& att) {
+        const auto first = m_values.size();
+
+        for (size_t i = 0, e = att.scale.scale.size(); i != e; ++i)
+            m_values.push_back(
+              { att.scale.scale[i].name, static_cast<int>(i) });
+
+        std::sort(m_values.begin() + first, m_values.end());
+        m_start.emplace_back(m_values.size());
+    };
+
+    m_start.emplace_back(0);
+
+    for (const auto& att : model.attributes) {
+        if (att.is_basic()) {
+            m_attributes.push_back(
+              { att.name, static_cast<int>(m_attributes.size()) });
+            push_scale(att);
+        }
+    }
+
+    if (!model.attributes.empty())
+        push_scale(model.attributes[0]);
+
+    std::sort(m_attributes.begin(), m_attributes.end());
+}
+
+std::optional<int>
+model_lookup::find_attribute(std::string_view name) const noexcept
+{
+    const entry key{ name, 0 };
+    auto it = std::lower_bound(m_attributes.begin(), m_attributes.end(), key);
+
+    if (it != m_attributes.end() && it->name == name)
+        return it->id;
+
+    return std::nullopt;
+}
+
+std::optional<scale_id>
+model_lookup::find_scale_value(size_t att, std::string_view name) const
+  noexcept
+{
+    assert(att + 1 < m_start.size());
+
+    const auto first = m_values.begin() + m_start[att];
+    const auto last = m_values.begin() + m_start[att + 1];
+    const entry key{ name, 0 };
+
+    if (auto it = std::lower_bound(first, last, key);
+        it != last && it->name == name)
+        return it->id;
+
+    scale_id value = 0;
+    if (name.empty() || name.size() > 3)
+        return std::nullopt;
+
+    for (const char c : name) {
+        if (c < '0' || c > '9')
+            return std::nullopt;
+
+        value = value * 10 + (c - '0');
+    }
+
+    if (value < static_cast<scale_id>(last - first))
+        return value;
+
+    return std::nullopt;
+}
+
 void
 Model::clear()
 {
@@ -1028,85 +1138,235 @@ Model::clear_options()
         att.options.clear();
 }
 
+model_writer::~model_writer() noexcept
+{
+    try {
+        finish();
+    } catch (...) {
+    }
+}
+
+status
+model_writer::init(context& ctx, const std::string& output_directory)
+{
+    directory = output_directory;
+    std::error_code ec;
+
+    if (!std::filesystem::is_directory(directory, ec))
+        directory = std::filesystem::current_path(ec);
+
+    m_context = &ctx;
+
+    /* The journal uses its own buffer: the writer thread does not allocate
+     * while the search runs. */
+    m_buffer.resize(BUFSIZ);
+    m_journal = std::tmpfile();
+    if (!m_journal) {
+        error(ctx, "Fail to create the journal\n");
+        ctx.data_1 = directory.string();
+        return ctx.status = status::file_error;
+    }
+
+    std::setvbuf(m_journal, m_buffer.data(), _IOFBF, m_buffer.size());
+    m_thread = std::thread([this]() { run(); });
+
+    return status::success;
+}
+
 status
 model_writer::store(context& ctx, const Model& model, const result& result)
 {
-    Model copied_model(model);
+    if (!m_journal)
+        return status::success;
 
-    const auto id = result.modifiers.size();
-    const auto filename = fmt::format("{}.dxi", id);
-    std::filesystem::path file = directory / filename;
+    m_context = &ctx;
+    m_model = &model;
 
-    for (const auto& elem : result.modifiers) {
-        assert(elem.attribute >= 0);
-        assert(static_cast<size_t>(elem.attribute) <
-               copied_model.attributes.size());
+    const auto tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == capacity)
+        wait_written(tail - capacity + 1);
 
-        auto& att = copied_model.attributes[elem.attribute];
-        fmt::print("[{}, {}, {}] \n",
-                   copied_model.attributes[elem.attribute].name,
-                   elem.line,
-                   elem.value);
+    auto& slot = m_ring[tail % capacity];
+    slot.kappa = result.kappa;
+    slot.modifiers.assign(result.modifiers.begin(), result.modifiers.end());
 
-        assert(!att.functions.low.empty());
-        assert(elem.line >= 0);
-        assert(static_cast<size_t>(elem.line) < att.functions.low.size());
-        assert(elem.value >= 0);
-        assert(elem.value < att.scale_size());
+    m_tail.store(tail + 1, std::memory_order_release);
+    m_wakeup.notify_one();
 
-        char value = '0';
-        value += static_cast<char>(elem.value);
+    return status::success;
+}
 
-        att.functions.low[elem.line] = value;
+void
+model_writer::run() noexcept
+{
+    for (;;) {
+        const auto head = m_head.load(std::memory_order_relaxed);
+
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            if (m_stop.load(std::memory_order_acquire) &&
+                head == m_tail.load(std::memory_order_acquire))
+                return;
+
+            /* store does not take the mutex: a missed notification only
+             * delays the journal until the timeout. */
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeup.wait_for(lock, std::chrono::milliseconds(10));
+            continue;
+        }
+
+        write(m_ring[head % capacity]);
+        m_head.store(head + 1, std::memory_order_release);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+        }
+        m_written.notify_one();
     }
-    fmt::print("\n");
+}
 
-    copied_model.write(ctx, output_file{ file.string().c_str() });
+void
+model_writer::write(const record& r) noexcept
+{
+    fmt::print(m_journal, "{};{:.10f}", r.modifiers.size(), r.kappa);
 
-    return status::success;
+    for (const auto& elem : r.modifiers)
+        fmt::print(
+          m_journal, ";{}-{}-{}", elem.attribute, elem.line, elem.value);
+
+    std::fputc('\n', m_journal);
 }
 
-status
-model_writer::store(context& ctx,
-                    const Model& model,
-                    const std::vector<std::tuple<int, int, int>>& updaters)
+void
+model_writer::wait_written(size_t head) noexcept
 {
-    Model copied_model(model);
+    m_wakeup.notify_one();
 
-    const auto id = updaters.size();
-    const auto filename = fmt::format("{}.dxi", id);
-    std::filesystem::path file = directory / filename;
+    for (int i = 0; i != 64; ++i) {
+        if (m_head.load(std::memory_order_acquire) >= head)
+            return;
 
-    for (const auto& elem : updaters) {
-        const int attribute = std::get<0>(elem);
-        const int line = std::get<1>(elem);
-        const int value = std::get<2>(elem);
+        std::this_thread::yield();
+    }
 
-        assert(attribute >= 0);
-        assert(static_cast<size_t>(attribute) <
-               copied_model.attributes.size());
+    /* run takes the mutex before the notification: the wait cannot miss
+     * it. The writer thread is woken again in case it missed the store. */
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_head.load(std::memory_order_acquire) < head) {
+        m_wakeup.notify_one();
+        m_written.wait_for(lock, std::chrono::milliseconds(10));
+    }
+}
 
-        auto& att = copied_model.attributes[attribute];
-        fmt::print("[{}, {}, {}] \n",
-                   copied_model.attributes[attribute].name,
-                   line,
-                   value);
+void
+model_writer::drain() noexcept
+{
+    wait_written(m_tail.load(std::memory_order_relaxed));
+}
+
+std::string
+model_writer::journal()
+{
+    std::string content;
+    if (!m_journal)
+        return content;
 
-        assert(!att.functions.low.empty());
-        assert(line >= 0);
-        assert(static_cast<size_t>(line) < att.functions.low.size());
-        assert(value >= 0);
-        assert(value < att.scale_size());
+    drain();
 
-        char v = '0';
-        v += static_cast<char>(value);
+    /* The writer thread is idle until the next store: the journal is read
+     * and the position restored at its end for the next records. */
+    char buffer[BUFSIZ];
+    size_t len;
+
+    std::fflush(m_journal);
+    std::rewind(m_journal);
+    while ((len = std::fread(buffer, 1, BUFSIZ, m_journal)) > 0)
+        content.append(buffer, len);
+    std::fseek(m_journal, 0, SEEK_END);
+
+    return content;
+}
 
-        att.functions.low[line] = v;
+status
+model_writer::finish()
+{
+    if (m_thread.joinable()) {
+        m_stop.store(true, std::memory_order_release);
+        m_wakeup.notify_one();
+        m_thread.join();
     }
-    fmt::print("\n");
 
-    copied_model.write(ctx, output_file{ file.string().c_str() });
+    if (!m_journal)
+        return status::success;
 
-    return status::success;
+    const auto ret = materialize();
+
+    std::fclose(m_journal);
+    m_journal = nullptr;
+
+    return ret;
+}
+
+status
+model_writer::materialize()
+{
+    if (!m_journal || !m_model || !m_context)
+        return status::success;
+
+    const auto content = journal();
+
+    /* The modifiers of a result are patched in a copy of the model and
+     * restored once the DEXi file is written. */
+    Model copy = *m_model;
+    std::vector<std::tuple<int, int, char>> saved;
+    std::vector<std::string_view> columns;
+    std::string_view text = content;
+    auto ret = status::success;
+
+    while (!text.empty()) {
+        const auto pos = text.find('\n');
+        tokenize(text.substr(0, pos), columns, ';');
+        text.remove_prefix(pos == std::string_view::npos ? text.size()
+                                                         : pos + 1);
+
+        if (columns.size() < 2)
+            continue;
+
+        saved.clear();
+        for (size_t i = 2, e = columns.size(); i != e; ++i) {
+            const std::string token(columns[i]);
+            int attribute, line, value;
+
+            if (std::sscanf(
+                  token.c_str(), "%d-%d-%d", &attribute, &line, &value) != 3)
+                continue;
+
+            assert(attribute >= 0);
+            assert(static_cast<size_t>(attribute) < copy.attributes.size());
+
+            auto& att = copy.attributes[attribute];
+
+            assert(!att.functions.low.empty());
+            assert(line >= 0);
+            assert(static_cast<size_t>(line) < att.functions.low.size());
+            assert(value >= 0);
+            assert(value < att.scale_size());
+
+            saved.emplace_back(attribute, line, att.functions.low[line]);
+            att.functions.low[line] = static_cast<char>('0' + value);
+        }
+
+        const auto file =
+          directory / fmt::format("{}.dxi", std::string(columns[0]));
+        if (const auto w =
+              copy.write(*m_context, output_file{ file.string().c_str() });
+            is_bad(w))
+            ret = w;
+
+        for (auto it = saved.rbegin(), end = saved.rend(); it != end; ++it)
+            copy.attributes[std::get<0>(*it)].functions.low[std::get<1>(*it)] =
+              std::get<2>(*it);
+    }
+
+    return ret;
 }
 } // namespace efyj
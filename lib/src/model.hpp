@@ -23,13 +23,20 @@
 #define ORG_VLEPROJECT_EFYJ_MODEL_HPP
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <deque>
 #include <filesystem>
 #include <initializer_list>
 #include <limits>
+#include <mutex>
 #include <optional>
 #include <stack>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -93,7 +100,7 @@ struct scales
     bool interval = false;
     std::vector<scalevalue> scale;
 
-    std::optional<scale_id> find_scale_value(const std::string& name) const
+    std::optional<scale_id> find_scale_value(std::string_view name) const
     {
         for (size_t i = 0, e = scale.size(); i != e; ++i) {
             if (scale[i].name == name) {
@@ -208,26 +215,130 @@ struct Model
     }
 };
 
-struct model_writer
+/** Computes a hash of the names of the basic attributes, of their scale
+ * values and of the scale values of the root attribute. A dataset read
+ * with a model is valid for any model with the same fingerprint. */
+std::uint64_t
+model_fingerprint(const Model& model) noexcept;
+
+/** Finds the basic attributes and their scale values from their names.
+ * The names of a model are sorted once and searched with a binary search.
+ * The lookup references the names of the model: the model must outlive
+ * the lookup and must not be modified. */
+class model_lookup
 {
-    std::filesystem::path directory;
-
-    status init(const std::string& output_directory)
+public:
+    explicit model_lookup(const Model& model);
+
+    /** Returns the index of the basic attribute @e name in the order of
+     * @c Model::get_basic_attribute(). */
+    std::optional<int> find_attribute(std::string_view name) const noexcept;
+
+    /** Returns the scale value @e name of the basic attribute @e att. If no
+     * scale value has this name, a decimal index lower than the scale size
+     * is accepted. */
+    std::optional<scale_id> find_scale_value(size_t att,
+                                             std::string_view name) const
+      noexcept;
+
+    /** Returns the scale value @e name of the root attribute. */
+    std::optional<scale_id> find_observed(std::string_view name) const
+      noexcept
     {
-        directory = output_directory;
-        std::error_code ec;
+        return find_scale_value(m_start.size() - 2, name);
+    }
 
-        if (!std::filesystem::is_directory(directory, ec))
-            directory = std::filesystem::current_path(ec);
+    scale_id scale_size(size_t att) const noexcept
+    {
+        assert(att + 1 < m_start.size());
 
-        return status::success;
+        return static_cast<scale_id>(m_start[att + 1] - m_start[att]);
     }
 
+private:
+    struct entry
+    {
+        std::string_view name;
+        int id;
+
+        bool operator<(const entry& other) const noexcept
+        {
+            return name < other.name;
+        }
+    };
+
+    std::vector<entry> m_attributes; ///< basic attribute names.
+    std::vector<entry> m_values;     ///< scale values sorted per attribute.
+    std::vector<size_t> m_start;     ///< first value of each attribute.
+};
+
+/** Records the results of the adjustment and prediction steps without
+ * blocking the search. @e store pushes the modifiers of a result into a
+ * single-producer single-consumer ring, a writer thread appends them to a
+ * temporary journal file, one line per result:
+ * `n;kappa;attribute-line-value;...`. Each writer has its own journal,
+ * removed when it is closed, so concurrent computations do not share it.
+ * The DEXi files `<n>.dxi` of the output directory are written from the
+ * journal by @e materialize, on request, or by @e finish, called by the
+ * destructor.
+ */
+class model_writer
+{
+public:
+    std::filesystem::path directory;
+
+    model_writer() = default;
+    model_writer(const model_writer&) = delete;
+    model_writer& operator=(const model_writer&) = delete;
+
+    ~model_writer() noexcept;
+
+    /** Opens the journal and starts the writer thread. Returns
+     * @c file_error if the journal cannot be created. */
+    status init(context& ctx, const std::string& output_directory);
+
     status store(context& ctx, const Model& model, const result& result);
 
-    status store(context& ctx,
-                 const Model& model,
-                 const std::vector<std::tuple<int, int, int>>& updaters);
+    /** Waits until the writer thread has written the stored results and
+     * returns the content of the journal. Must be called from the thread
+     * of @e store. */
+    std::string journal();
+
+    /** Writes the DEXi file `<n>.dxi` of each result of the journal. Must
+     * be called from the thread of @e store. */
+    status materialize();
+
+    /** Waits for the writer thread, writes the DEXi files of the journal
+     * and closes it. */
+    status finish();
+
+private:
+    struct record
+    {
+        double kappa;
+        std::vector<modifier> modifiers;
+    };
+
+    static constexpr size_t capacity = 64;
+
+    std::array<record, capacity> m_ring;
+    std::atomic<size_t> m_head{ 0 }; ///< next record of the writer thread.
+    std::atomic<size_t> m_tail{ 0 }; ///< next record of @e store.
+    std::atomic<bool> m_stop{ false };
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;  ///< wakes up the writer thread.
+    std::condition_variable m_written; ///< wakes up @e store or @e drain.
+    std::thread m_thread;
+
+    std::FILE* m_journal = nullptr;
+    std::vector<char> m_buffer;
+    context* m_context = nullptr;
+    const Model* m_model = nullptr;
+
+    void run() noexcept;
+    void write(const record& r) noexcept;
+    void wait_written(size_t head) noexcept;
+    void drain() noexcept;
 };
 
 bool
@@ -20,14 +20,32 @@
  */
 
 #include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <exception>
+#include <iterator>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 
 #include "options.hpp"
 #include "private.hpp"
 #include "utils.hpp"
 
 #include <cassert>
+#include <cctype>
 #include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <io.h>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 namespace efyj {
 
@@ -44,88 +62,699 @@ get_basic_attribute(const Model& model)
     return ret;
 }
 
-static std::optional<int>
-get_basic_attribute_id(const std::vector<const attribute*>& att,
-                       const std::string& name)
+/* A read-only view of the whole content of an input file. The file is
+ * mapped into memory when possible, otherwise (pipe, special file) it is
+ * read into a buffer. */
+class mapped_file
 {
-    for (size_t i = 0, e = att.size(); i != e; ++i)
-        if (att[i]->name == name)
-            return std::make_optional(static_cast<int>(i));
+private:
+    std::string m_buffer;
+    const char* m_data = nullptr;
+    size_t m_size = 0;
 
-    return std::nullopt;
-}
+#ifdef _WIN32
+    HANDLE m_mapping = nullptr;
+#endif
 
-struct line_reader
-{
-    line_reader(FILE* is_)
-      : is(is_)
+    bool map(std::FILE* is) noexcept
+    {
+#ifdef _WIN32
+        auto file = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(is)));
+        LARGE_INTEGER size;
+
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size) ||
+            size.QuadPart <= 0)
+            return false;
+
+        m_mapping =
+          CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!m_mapping)
+            return false;
+
+        auto* view = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!view) {
+            CloseHandle(m_mapping);
+            m_mapping = nullptr;
+            return false;
+        }
+
+        m_data = static_cast<const char*>(view);
+        m_size = static_cast<size_t>(size.QuadPart);
+        return true;
+#else
+        const int fd = fileno(is);
+        struct stat st;
+
+        if (fd < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode) ||
+            st.st_size <= 0)
+            return false;
+
+        const auto size = static_cast<size_t>(st.st_size);
+        auto* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view == MAP_FAILED)
+            return false;
+
+        posix_madvise(view, size, POSIX_MADV_SEQUENTIAL);
+        m_data = static_cast<const char*>(view);
+        m_size = size;
+        return true;
+#endif
+    }
+
+    void unmap() noexcept
+    {
+        if (m_data == m_buffer.data())
+            return;
+
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mapping);
+#else
+        munmap(const_cast<char*>(m_data), m_size);
+#endif
+    }
+
+public:
+    mapped_file(std::FILE* is)
+    {
+        if (map(is))
+            return;
+
+        char buffer[BUFSIZ];
+        size_t len;
+
+        while ((len = std::fread(buffer, 1, BUFSIZ, is)) > 0)
+            m_buffer.append(buffer, len);
+
+        m_data = m_buffer.data();
+        m_size = m_buffer.size();
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    ~mapped_file() noexcept
     {
+        unmap();
     }
 
-    bool is_end() const
+    std::string_view view() const noexcept
     {
-        return feof(is) || ferror(is);
+        return std::string_view(m_data, m_size);
+    }
+};
+
+/* Removes the line @e str from the front of @e text and returns it without
+ * its end of line characters. */
+static std::string_view
+next_line(std::string_view& text) noexcept
+{
+    std::string_view str;
+
+    if (const auto pos = text.find('\n'); pos == std::string_view::npos) {
+        str = text;
+        text = std::string_view();
+    } else {
+        str = text.substr(0, pos);
+        text.remove_prefix(pos + 1);
     }
 
-    std::optional<std::string> getline()
+    if (!str.empty() && str.back() == '\r')
+        str.remove_suffix(1);
+
+    return str;
+}
+
+/* Reads an integer like the `%d' format of scanf: leading spaces are
+ * skipped and trailing characters are ignored. */
+static bool
+parse_integer(std::string_view str, int& value) noexcept
+{
+    while (!str.empty() && std::isspace(static_cast<unsigned char>(str[0])))
+        str.remove_prefix(1);
+
+    if (!str.empty() && str[0] == '+')
+        str.remove_prefix(1);
+
+    return std::from_chars(str.data(), str.data() + str.size(), value).ec ==
+           std::errc();
+}
+
+/* A rejected line of the CSV data: skipped lines are only reported,
+ * the first unknown scale value stops the read. */
+struct csv_issue
+{
+    enum class type
     {
-        // If the next line is already available in the m_buffer, we return a
-        // substring of the m_buffer and update the m_buffer.
+        column_number,
+        malformed_integer,
+        unknown_observed,
+        unknown_option
+    };
+
+    type kind;
+    size_t line;   ///< line index in the chunk.
+    size_t column; ///< column index or number of columns.
+    std::string_view value;
+    const attribute* att;
+};
+
+/* Parses a newline-aligned part of the CSV data into its own column
+ * buffers. The chunks are concatenated in file order by the caller. */
+struct csv_chunk
+{
+    std::string_view text;
+    size_t lines = 0;
+
+    options_block block;
 
-        auto newline_pos = m_buffer.find_first_of('\n');
-        if (newline_pos != std::string::npos) {
-            auto ret = m_buffer.substr(0, newline_pos);
+    std::vector<csv_issue> issues;
+    bool failed = false;
 
-            if (newline_pos >= m_buffer.size())
-                m_buffer.clear();
-            else
-                m_buffer = m_buffer.substr(newline_pos + 1, std::string::npos);
+    std::exception_ptr exception;
 
-            return std::make_optional(ret);
+    void parse(const model_lookup& lookup,
+               const std::vector<const attribute*>& atts,
+               const std::vector<int>& convertheader,
+               size_t id) noexcept
+    {
+        try {
+            do_parse(lookup, atts, convertheader, id);
+        } catch (...) {
+            exception = std::current_exception();
         }
+    }
+
+private:
+    void do_parse(const model_lookup& lookup,
+                  const std::vector<const attribute*>& atts,
+                  const std::vector<int>& convertheader,
+                  size_t id)
+    {
+        const size_t expected = atts.size() + id + 1;
+        std::vector<std::string_view> columns;
+        std::string_view remaining = text;
 
-        // We need to append data to the buffer.
+        columns.reserve(expected);
 
-        char buffer[BUFSIZ];
+        for (; !remaining.empty(); ++lines) {
+            tokenize(next_line(remaining), columns, ';');
 
-        do {
-            if (is_end()) {
-                m_buffer.clear();
-                return {};
+            if (columns.size() != expected) {
+                issues.push_back({ csv_issue::type::column_number,
+                                   lines,
+                                   columns.size(),
+                                   {},
+                                   nullptr });
+                continue;
             }
 
-            auto len = fread(buffer, 1, BUFSIZ - 1, is);
-            buffer[len] = '\0';
-
-            if (len == 0) {
-                auto ret = std::move(m_buffer);
-                ret += '\n';
+            auto opt_obs = lookup.find_observed(columns.back());
+            if (!opt_obs) {
+                issues.push_back({ csv_issue::type::unknown_observed,
+                                   lines,
+                                   columns.size(),
+                                   columns.back(),
+                                   nullptr });
+                failed = true;
+                return;
+            }
 
-                return std::make_optional(ret);
-            } else {
-                auto* newline = strchr(buffer, '\n');
-                if (newline == nullptr) {
-                    m_buffer.append(buffer);
-                } else {
-                    m_buffer.append(buffer, newline);
-                    auto ret = std::move(m_buffer);
-                    m_buffer.assign(newline + 1);
+            int department, year;
+            if (!parse_integer(columns[id - 1], year) ||
+                !parse_integer(columns[id - 2], department)) {
+                issues.push_back({ csv_issue::type::malformed_integer,
+                                   lines,
+                                   id - 1,
+                                   {},
+                                   nullptr });
+                continue;
+            }
 
-                    return std::make_optional(ret);
+            const auto row = block.options.size();
+            block.options.resize(row + atts.size());
+
+            for (size_t i = id, e = id + atts.size(); i != e; ++i) {
+                const size_t attid = convertheader[i - id];
+                auto opt_option = lookup.find_scale_value(attid, columns[i]);
+
+                if (!opt_option) {
+                    issues.push_back({ csv_issue::type::unknown_option,
+                                       lines,
+                                       i,
+                                       columns[i],
+                                       atts[attid] });
+                    failed = true;
+                    return;
                 }
+
+                block.options[row + attid] = *opt_option;
             }
-        } while (!is_end());
 
-        auto ret = std::move(m_buffer);
-        ret += '\n';
+            block.simulations.emplace_back(columns[0]);
+            if (id == 4)
+                block.places.emplace_back(columns[1]);
 
-        return std::make_optional(ret);
+            block.departments.push_back(department);
+            block.years.push_back(year);
+            block.observed.push_back(*opt_obs);
+        }
     }
+};
 
-    FILE* is;
-    std::string m_buffer;
+/* Splits @e text into at most @e number parts. Each part, except the last,
+ * ends with a newline character. */
+static std::vector<csv_chunk>
+split_chunks(std::string_view text, size_t number)
+{
+    std::vector<csv_chunk> chunks;
+    chunks.reserve(number);
+
+    const size_t length = text.size() / number;
+
+    while (!text.empty()) {
+        size_t pos = std::string_view::npos;
+
+        if (chunks.size() + 1 < number && length < text.size()) {
+            pos = text.find('\n', length);
+            if (pos != std::string_view::npos)
+                ++pos;
+        }
+
+        auto& chunk = chunks.emplace_back();
+        chunk.text = text.substr(0, pos);
+        text.remove_prefix(chunk.text.size());
+    }
+
+    return chunks;
+}
+
+/* Reads the header @e line of the CSV options: @e id is the index of the
+ * first scale value column (4 with a place column, 3 otherwise) and
+ * @e convertheader the basic attribute of each scale value column. */
+static status
+parse_header(context& ctx,
+             std::string_view line,
+             const model_lookup& lookup,
+             std::vector<int>& convertheader,
+             size_t& id,
+             size_t& error_at_column)
+{
+    std::vector<std::string_view> columns;
+    tokenize(line, columns, ';');
+
+    if (columns.size() == convertheader.size() + 4) {
+        id = 3;
+    } else if (columns.size() == convertheader.size() + 5) {
+        id = 4;
+    } else {
+        return status::csv_parser_column_number_incorrect;
+    }
+
+    for (size_t i = id, e = id + convertheader.size(); i != e; ++i) {
+        debug(ctx,
+              "Try to get_basic_atribute_id column index: {} string: `{}`\n",
+              i,
+              columns[i]);
+
+        auto opt_att_id = lookup.find_attribute(columns[i]);
+        if (!opt_att_id) {
+            error(
+              ctx, "Fail to found attribute `{}' in DExi file\n", columns[i]);
+            error_at_column = i;
+            return status::csv_parser_basic_attribute_unknown;
+        }
+
+        convertheader[i - id] = *opt_att_id;
+    }
+
+    return status::success;
+}
+
+/* Logs the rejected lines of @e chunk. Line numbers start at zero after
+ * the header, @e first_line is the number of the first line of the chunk.
+ * Returns false if the chunk stops at an unknown scale value. */
+static bool
+report_issues(context& ctx,
+              const csv_chunk& chunk,
+              size_t first_line,
+              size_t expected)
+{
+    for (const auto& issue : chunk.issues) {
+        const size_t line_number = first_line + issue.line;
+
+        switch (issue.kind) {
+        case csv_issue::type::column_number:
+            error(ctx,
+                  "Options: error in csv file line {}:"
+                  " not correct number of column {}"
+                  " (expected: {})\n",
+                  line_number,
+                  issue.column,
+                  expected);
+            break;
+
+        case csv_issue::type::malformed_integer:
+            error(ctx,
+                  "Options: error in csv file line {}."
+                  " Malformed year or department\n",
+                  line_number);
+            break;
+
+        case csv_issue::type::unknown_observed:
+            error(ctx,
+                  "Options: error in csv file line {}:"
+                  " unknown scale value `{}'\n",
+                  line_number,
+                  issue.value);
+            break;
+
+        case csv_issue::type::unknown_option:
+            error(ctx,
+                  "Options: error in csv file line {}: "
+                  "unknown scale value `{}' for attribute `{}'\n",
+                  line_number,
+                  issue.value,
+                  issue.att->name);
+            break;
+        }
+    }
+
+    return !chunk.failed;
+}
+
+/* The binary dataset format: a header followed by sections aligned on 8
+ * bytes. The scale values and the observations are stored in 8-bit
+ * columns, the department, year and place columns are stored as their
+ * precomputed option_groups with the value of each group. */
+constexpr char dataset_magic[8] = { 'E', 'F', 'Y', 'J', 'D', 'A', 'T', 'A' };
+constexpr std::uint32_t dataset_version = 1;
+constexpr std::uint32_t dataset_byte_order = 0x01020304;
+
+struct dataset_header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint64_t fingerprint;
+    std::uint64_t rows;
+    std::uint32_t cols;
+    std::uint32_t departments; ///< number of department groups.
+    std::uint32_t years;       ///< number of year groups.
+    std::uint32_t places;      ///< number of place groups or 0.
+    std::uint64_t simulation_bytes;
+    std::uint64_t place_bytes;
 };
 
+static_assert(sizeof(dataset_header) == 64);
+static_assert(sizeof(int) == sizeof(std::int32_t));
+
+class dataset_writer
+{
+private:
+    std::FILE* m_os;
+    size_t m_pos = 0;
+    bool m_good = true;
+
+public:
+    dataset_writer(std::FILE* os) noexcept
+      : m_os(os)
+    {
+    }
+
+    bool good() const noexcept
+    {
+        return m_good;
+    }
+
+    void write(const void* data, size_t size) noexcept
+    {
+        static const char zeros[8] = {};
+
+        if (size > 0 && std::fwrite(data, 1, size, m_os) != size)
+            m_good = false;
+
+        m_pos += size;
+
+        if (const size_t padding = (8 - m_pos % 8) % 8; padding) {
+            if (std::fwrite(zeros, 1, padding, m_os) != padding)
+                m_good = false;
+
+            m_pos += padding;
+        }
+    }
+
+    template<typename T>
+    void write(const std::vector<T>& vec) noexcept
+    {
+        write(vec.data(), vec.size() * sizeof(T));
+    }
+
+    template<typename Function>
+    void write_strings(size_t size, Function get)
+    {
+        std::vector<std::uint64_t> offsets(size + 1, 0);
+        std::string bytes;
+
+        for (size_t i = 0; i != size; ++i) {
+            bytes += get(i);
+            offsets[i + 1] = bytes.size();
+        }
+
+        write(offsets);
+        write(bytes.data(), bytes.size());
+    }
+
+    void write_groups(const option_groups& groups)
+    {
+        write(groups.group);
+        write(groups.start);
+        write(groups.members);
+    }
+};
+
+class dataset_reader
+{
+private:
+    std::string_view m_data;
+    size_t m_pos = 0;
+
+public:
+    dataset_reader(std::string_view data) noexcept
+      : m_data(data)
+    {
+    }
+
+    /* Returns the next @e size bytes or nullptr if the file is too short. */
+    const char* take(std::uint64_t size) noexcept
+    {
+        if (size > m_data.size() - m_pos)
+            return nullptr;
+
+        const char* ret = m_data.data() + m_pos;
+        m_pos += static_cast<size_t>(size);
+        m_pos = std::min(m_data.size(), m_pos + (8 - m_pos % 8) % 8);
+
+        return ret;
+    }
+
+    template<typename T>
+    bool read(std::vector<T>& vec, std::uint64_t size)
+    {
+        if (size > m_data.size() / sizeof(T))
+            return false;
+
+        const char* data = take(size * sizeof(T));
+        if (!data)
+            return false;
+
+        vec.resize(static_cast<size_t>(size));
+        if (size > 0)
+            std::memcpy(vec.data(), data, vec.size() * sizeof(T));
+
+        return true;
+    }
+
+    bool read_strings(std::vector<std::string>& vec,
+                      std::uint64_t size,
+                      std::uint64_t bytes_size)
+    {
+        std::vector<std::uint64_t> offsets;
+        if (!read(offsets, size + 1) || offsets.front() != 0 ||
+            offsets.back() != bytes_size)
+            return false;
+
+        const char* bytes = take(bytes_size);
+        if (!bytes)
+            return false;
+
+        vec.resize(static_cast<size_t>(size));
+        for (size_t i = 0, e = vec.size(); i != e; ++i) {
+            if (offsets[i] > offsets[i + 1])
+                return false;
+
+            vec[i].assign(bytes + offsets[i], offsets[i + 1] - offsets[i]);
+        }
+
+        return true;
+    }
+
+    bool read_groups(option_groups& groups,
+                     std::uint64_t rows,
+                     std::uint64_t size)
+    {
+        if (!read(groups.group, rows) || !read(groups.start, size + 1) ||
+            !read(groups.members, rows))
+            return false;
+
+        if (groups.start.front() != 0 ||
+            static_cast<std::uint64_t>(groups.start.back()) != rows)
+            return false;
+
+        for (size_t i = 0; i != size; ++i)
+            if (groups.start[i] > groups.start[i + 1])
+                return false;
+
+        for (const auto g : groups.group)
+            if (g < 0 || static_cast<std::uint64_t>(g) >= size)
+                return false;
+
+        for (const auto m : groups.members)
+            if (m < 0 || static_cast<std::uint64_t>(m) >= rows)
+                return false;
+
+        return true;
+    }
+};
+
+/* Reads a binary dataset. The subdataset groups are stored in the file,
+ * only the 8-bit columns are expanded. */
+static status
+read_dataset(context& ctx,
+             std::string_view file,
+             const Model& model,
+             Options& opts)
+{
+    dataset_header header;
+    dataset_reader reader(file);
+
+    if (const char* data = reader.take(sizeof(header)); !data) {
+        error(ctx, "Options: dataset header truncated\n");
+        return status::dataset_format_error;
+    } else {
+        std::memcpy(&header, data, sizeof(header));
+    }
+
+    if (header.version != dataset_version ||
+        header.byte_order != dataset_byte_order) {
+        error(ctx,
+              "Options: unsupported dataset version {} or byte order\n",
+              header.version);
+        return status::dataset_format_error;
+    }
+
+    const auto atts = get_basic_attribute(model);
+    if (header.fingerprint != model_fingerprint(model) ||
+        header.cols != atts.size()) {
+        error(ctx, "Options: dataset converted with another model\n");
+        return status::dataset_model_mismatch;
+    }
+
+    info(ctx,
+         "Starts to map dataset ({} options, {} attributes)\n",
+         header.rows,
+         header.cols);
+
+    const auto rows = header.rows;
+    const auto cols = header.cols;
+    std::vector<std::uint8_t> values, observed;
+    std::vector<int> departments, years;
+    std::vector<std::string> places;
+
+    if (rows > file.size() || !reader.read(values, rows * cols) ||
+        !reader.read(observed, rows) ||
+        !reader.read_groups(
+          opts.department_groups, rows, header.departments) ||
+        !reader.read(departments, header.departments) ||
+        !reader.read_groups(opts.year_groups, rows, header.years) ||
+        !reader.read(years, header.years) ||
+        (header.places > 0 &&
+         (!reader.read_groups(opts.place_groups, rows, header.places) ||
+          !reader.read_strings(places, header.places, header.place_bytes))) ||
+        !reader.read(opts.subdataset_sizes, rows) ||
+        !reader.read(opts.id_subdataset_reduced, rows) ||
+        !reader.read_strings(
+          opts.simulations, rows, header.simulation_bytes)) {
+        error(ctx, "Options: dataset truncated or corrupted\n");
+        opts.clear();
+        return status::dataset_format_error;
+    }
+
+    /* A learning subdataset excludes at least its option. The subdataset
+     * identifiers are numbered in the order of their first option, as in
+     * init_dataset: the prediction uses them as fold indices. */
+    int next_identifier = 0;
+    for (size_t i = 0; i != rows; ++i) {
+        const auto size = opts.subdataset_sizes[i];
+        const auto id = opts.id_subdataset_reduced[i];
+
+        if (size < 0 || static_cast<std::uint64_t>(size) >= rows || id < 0 ||
+            id > next_identifier) {
+            error(ctx, "Options: dataset subdatasets corrupted\n");
+            opts.clear();
+            return status::dataset_format_error;
+        }
+
+        if (id == next_identifier)
+            ++next_identifier;
+    }
+
+    const auto observed_size = model.attributes[0].scale_size();
+    opts.observed.resize(observed.size());
+    for (size_t i = 0, e = observed.size(); i != e; ++i) {
+        if (observed[i] >= observed_size) {
+            opts.clear();
+            return status::dataset_format_error;
+        }
+
+        opts.observed[i] = observed[i];
+    }
+
+    opts.options.init(static_cast<size_t>(rows), cols);
+    for (size_t c = 0; c != cols; ++c) {
+        const auto* column = values.data() + c * rows;
+        const auto limit = atts[c]->scale_size();
+
+        for (size_t r = 0; r != rows; ++r) {
+            if (column[r] >= limit) {
+                opts.clear();
+                return status::dataset_format_error;
+            }
+
+            opts.options(r, c) = column[r];
+        }
+    }
+
+    opts.departments.resize(opts.department_groups.group.size());
+    for (size_t i = 0, e = opts.departments.size(); i != e; ++i)
+        opts.departments[i] = departments[opts.department_groups.group[i]];
+
+    opts.years.resize(opts.year_groups.group.size());
+    for (size_t i = 0, e = opts.years.size(); i != e; ++i)
+        opts.years[i] = years[opts.year_groups.group[i]];
+
+    opts.places.resize(opts.place_groups.group.size());
+    for (size_t i = 0, e = opts.places.size(); i != e; ++i)
+        opts.places[i] = places[opts.place_groups.group[i]];
+
+    if (!opts.check()) {
+        opts.clear();
+        return status::dataset_format_error;
+    }
+
+    return status::success;
+}
+
 #if 0
 Options::Options(const data& d)
   : simulations(d.simulations)
@@ -195,164 +824,311 @@ Options::save(const char* filename) noexcept
     }
 }
 
+status
+Options::write_binary(const output_file& os, const Model& model) const
+{
+    const size_t rows = simulations.size();
+    const size_t cols = options.cols();
+
+    if (rows == 0)
+        return status::csv_parser_init_dataset_simulation_empty;
+
+    dataset_header header = {};
+    std::memcpy(header.magic, dataset_magic, sizeof(header.magic));
+    header.version = dataset_version;
+    header.byte_order = dataset_byte_order;
+    header.fingerprint = model_fingerprint(model);
+    header.rows = rows;
+    header.cols = static_cast<std::uint32_t>(cols);
+    header.departments =
+      static_cast<std::uint32_t>(department_groups.start.size() - 1);
+    header.years = static_cast<std::uint32_t>(year_groups.start.size() - 1);
+    header.places = places.empty() ? 0u
+                                   : static_cast<std::uint32_t>(
+                                       place_groups.start.size() - 1);
+
+    for (const auto& str : simulations)
+        header.simulation_bytes += str.size();
+
+    for (size_t g = 0; g != header.places; ++g)
+        header.place_bytes +=
+          places[place_groups.members[place_groups.start[g]]].size();
+
+    dataset_writer writer(os.get());
+    writer.write(&header, sizeof(header));
+
+    {
+        std::vector<std::uint8_t> values(rows * cols);
+        for (size_t c = 0; c != cols; ++c)
+            for (size_t r = 0; r != rows; ++r)
+                values[c * rows + r] =
+                  static_cast<std::uint8_t>(options(r, c));
+
+        writer.write(values);
+    }
+
+    writer.write(std::vector<std::uint8_t>(observed.begin(), observed.end()));
+
+    /* The value of a group is the value of its first member. */
+    auto group_values = [](const option_groups& groups,
+                           const std::vector<int>& column) {
+        std::vector<int> ret(groups.start.size() - 1);
+        for (size_t g = 0, e = ret.size(); g != e; ++g)
+            ret[g] = column[groups.members[groups.start[g]]];
+
+        return ret;
+    };
+
+    writer.write_groups(department_groups);
+    writer.write(group_values(department_groups, departments));
+    writer.write_groups(year_groups);
+    writer.write(group_values(year_groups, years));
+
+    if (header.places > 0) {
+        writer.write_groups(place_groups);
+        writer.write_strings(header.places, [this](size_t g) {
+            return std::string_view(
+              places[place_groups.members[place_groups.start[g]]]);
+        });
+    }
+
+    writer.write(subdataset_sizes);
+    writer.write(id_subdataset_reduced);
+    writer.write_strings(
+      rows, [this](size_t i) { return std::string_view(simulations[i]); });
+
+    return writer.good() ? status::success : status::file_error;
+}
+
 status
 Options::read(context& ctx, const input_file& is, const Model& model)
+{
+    return read(ctx, is, model, std::thread::hardware_concurrency());
+}
+
+status
+Options::read(context& ctx,
+              const input_file& is,
+              const Model& model,
+              unsigned threads)
 {
     clear();
 
     std::vector<const attribute*> atts = get_basic_attribute(model);
+    const model_lookup lookup(model);
     std::vector<int> convertheader(atts.size(), 0);
-    std::vector<std::string> columns;
-    std::string line;
     size_t id;
 
-    line_reader ls(is.get());
+    mapped_file file(is.get());
+    std::string_view text = file.view();
     error_at_line = 0;
     error_at_column = 0;
 
+    if (text.size() >= sizeof(dataset_magic) &&
+        std::memcmp(text.data(), dataset_magic, sizeof(dataset_magic)) == 0)
+        return read_dataset(ctx, text, model, *this);
+
+    if (text.empty()) {
+        info(ctx, "Fail to read header\n");
+        return status::csv_parser_file_error;
+    }
+
+    if (auto ret = parse_header(
+          ctx, next_line(text), lookup, convertheader, id, error_at_column);
+        is_bad(ret))
+        return ret;
+
+    info(ctx, "Starts to read data (atts.size() = {}\n", atts.size());
+
+    /* Small files are parsed by the calling thread, larger files are split
+     * into one newline-aligned chunk per thread. */
+    constexpr size_t chunk_min_size = 1 << 20;
+    const size_t concurrency = std::max(1u, threads);
+    auto chunks = split_chunks(
+      text,
+      std::clamp(text.size() / chunk_min_size, size_t{ 1 }, concurrency));
+
     {
-        auto opt_line = ls.getline();
-        if (!opt_line) {
-            info(ctx, "Fail to read header\n");
-            return status::csv_parser_file_error;
-        }
+        std::vector<std::thread> workers;
+        workers.reserve(chunks.size());
 
-        line = *opt_line;
+        for (size_t i = 1; i < chunks.size(); ++i)
+            workers.emplace_back([&, i]() {
+                chunks[i].parse(lookup, atts, convertheader, id);
+            });
 
-        tokenize(line, columns, ";", false);
+        if (!chunks.empty())
+            chunks[0].parse(lookup, atts, convertheader, id);
 
-        if (columns.size() == atts.size() + 4) {
-            id = 3;
-        } else if (columns.size() == atts.size() + 5) {
-            id = 4;
-        } else {
-            return status::csv_parser_column_number_incorrect;
-        }
+        for (auto& worker : workers)
+            worker.join();
     }
 
-    for (size_t i = id, e = id + atts.size(); i != e; ++i) {
-        debug(ctx,
-              "Try to get_basic_atribute_id column index: {} string: `{}`\n",
-              i,
-              columns[i]);
+    /* Reports the rejected lines in file order and stops at the first
+     * unknown scale value. */
+    size_t rows = 0, first_line = 0;
+    for (auto& chunk : chunks) {
+        if (chunk.exception)
+            std::rethrow_exception(chunk.exception);
 
-        auto opt_att_id = get_basic_attribute_id(atts, columns[i]);
-        if (!opt_att_id) {
-            error(
-              ctx, "Fail to found attribute `{}' in DExi file\n", columns[i]);
-            error_at_column = static_cast<int>(i);
-            return status::csv_parser_basic_attribute_unknown;
+        if (!report_issues(ctx, chunk, first_line, atts.size() + id + 1)) {
+            error_at_line = first_line + chunk.issues.back().line;
+            error_at_column = chunk.issues.back().column;
+            return status::csv_parser_scale_value_unknown;
         }
 
-        convertheader[i - id] = *opt_att_id;
+        first_line += chunk.lines;
+        rows += chunk.block.size();
     }
 
-    info(ctx, "Starts to read data (atts.size() = {}\n", atts.size());
+    simulations.reserve(rows);
+    if (id == 4)
+        places.reserve(rows);
+    departments.reserve(rows);
+    years.reserve(rows);
+    observed.reserve(rows);
+    options.init(rows, atts.size());
+
+    size_t row = 0;
+    for (auto& chunk : chunks) {
+        auto& block = chunk.block;
+
+        std::move(block.simulations.begin(),
+                  block.simulations.end(),
+                  std::back_inserter(simulations));
+        std::move(block.places.begin(),
+                  block.places.end(),
+                  std::back_inserter(places));
+        departments.insert(departments.end(),
+                           block.departments.begin(),
+                           block.departments.end());
+        years.insert(years.end(), block.years.begin(), block.years.end());
+        observed.insert(
+          observed.end(), block.observed.begin(), block.observed.end());
+
+        for (size_t i = 0, e = block.size(); i != e; ++i, ++row)
+            for (size_t j = 0, f = atts.size(); j != f; ++j)
+                options(row, j) = block.options[i * f + j];
+    }
+
+    init_dataset();
+    check();
 
-    options.init(atts.size());
-    options.push_line();
-    int line_number = -1;
+    return status::success;
+}
 
-    while (true) {
-        auto opt_line = ls.getline();
-        if (!opt_line)
-            break;
+options_stream::options_stream(const Model& model,
+                               stream_reader_callback reader,
+                               void* user_data)
+  : m_atts(get_basic_attribute(model))
+  , m_lookup(model)
+  , m_convertheader(m_atts.size(), 0)
+  , m_reader(reader)
+  , m_user_data(user_data)
+{}
+
+/* Appends the next bytes of the stream to the buffer after removing the
+ * lines already read. */
+bool
+options_stream::fill()
+{
+    constexpr size_t read_size = 1 << 16;
 
-        line = *opt_line;
-        line_number++;
+    m_buffer.erase(0, m_position);
+    m_position = 0;
 
-        tokenize(line, columns, ";", false);
-        if (columns.size() != atts.size() + id + 1) {
-            error(ctx,
-                  "Options: error in csv file line {}:"
-                  " not correct number of column {}"
-                  " (expected: {})\n",
-                  line_number,
-                  columns.size(),
-                  atts.size() + id + 1);
-            continue;
-        }
+    const auto size = m_buffer.size();
+    m_buffer.resize(size + read_size);
 
-        debug(ctx, "try to found scale-value: {}\n", columns.back());
-        auto opt_obs =
-          model.attributes[0].scale.find_scale_value(columns.back());
+    const auto bytes =
+      m_reader(m_buffer.data() + size, read_size, m_user_data);
+    m_buffer.resize(size + bytes);
 
-        if (!opt_obs) {
-            error(
-              ctx,
-              "Options: error in csv file line {}: unknown scale value `{}'\n",
-              line_number,
-              columns.back());
+    if (bytes == 0)
+        m_eof = true;
 
-            error_at_line = line_number;
-            error_at_column = static_cast<int>(columns.size());
-            return status::csv_parser_scale_value_unknown;
+    return bytes > 0;
+}
+
+/* Finds the end of the line starting at the offset @e from of the current
+ * position. @e end is the offset after the end of line character. */
+bool
+options_stream::find_line(size_t from, size_t& end)
+{
+    for (;;) {
+        const auto pos = m_buffer.find('\n', m_position + from);
+
+        if (pos != std::string::npos) {
+            end = pos + 1 - m_position;
+            return true;
         }
 
-        int obs = *opt_obs;
-        int department, year;
-
-        {
-            debug(ctx,
-                  "read year `{}` and department `{}`\n",
-                  columns[id - 1],
-                  columns[id - 2]);
-            auto len1 = sscanf(columns[id - 1].c_str(), "%d", &year);
-            auto len2 = sscanf(columns[id - 1].c_str(), "%d", &department);
-
-            if (len1 != 1 || len2 != 1) {
-                error(ctx,
-                      "Options: error in csv file line {}."
-                      " Malformed year or department\n",
-                      line_number);
-                continue;
-            }
+        if (m_eof) {
+            end = m_buffer.size() - m_position;
+            return end > from;
         }
 
-        simulations.push_back(columns[0]);
-        if (id == 4)
-            places.push_back(columns[1]);
-
-        departments.push_back(department);
-        years.push_back(year);
-        observed.push_back(obs);
-
-        debug(ctx, "read loop {} to {}\n", id, id + atts.size());
-        for (size_t i = id, e = id + atts.size(); i != e; ++i) {
-            size_t attid = convertheader[i - id];
-
-            debug(ctx,
-                  "  attribute: `{}` columns: `{}`\n",
-                  atts[attid]->name,
-                  columns[i]);
-            auto opt_option = atts[attid]->scale.find_scale_value(columns[i]);
-            if (!opt_option) {
-                error(ctx,
-                      "Options: error in csv file line {}: "
-                      "unknown scale value `{}' for attribute `{}'\n",
-                      line_number,
-                      columns[i].c_str(),
-                      atts[attid]->name.c_str());
-
-                error_at_line = line_number;
-                error_at_column = static_cast<int>(i);
-                return status::csv_parser_scale_value_unknown;
-            }
+        fill();
+    }
+}
 
-            options(options.rows() - 1, attid) = *opt_option;
-        }
+status
+options_stream::read_header(context& ctx)
+{
+    error_at_line = 0;
+    error_at_column = 0;
 
-        options.push_line();
+    size_t end;
+    if (!find_line(0, end)) {
+        info(ctx, "Fail to read header\n");
+        return status::csv_parser_file_error;
     }
 
-    options.pop_line();
+    std::string_view text(m_buffer.data() + m_position, end);
+    m_position += end;
 
-    init_dataset();
-    check();
+    return parse_header(
+      ctx, next_line(text), m_lookup, m_convertheader, m_id, error_at_column);
+}
+
+status
+options_stream::read(context& ctx, size_t rows, options_block& block)
+{
+    size_t end = 0;
+    for (size_t i = 0; i != rows && find_line(end, end); ++i)
+        ;
+
+    /* The chunk parses into the memory of the previous block. */
+    csv_chunk chunk;
+    chunk.text = std::string_view(m_buffer.data() + m_position, end);
+    std::swap(chunk.block, block);
+    chunk.block.clear();
+    chunk.parse(m_lookup, m_atts, m_convertheader, m_id);
+    std::swap(chunk.block, block);
+    m_position += end;
+
+    if (chunk.exception)
+        std::rethrow_exception(chunk.exception);
+
+    if (!report_issues(ctx, chunk, m_line, m_atts.size() + m_id + 1)) {
+        error_at_line = m_line + chunk.issues.back().line;
+        error_at_column = chunk.issues.back().column;
+        return status::csv_parser_scale_value_unknown;
+    }
+
+    m_line += chunk.lines;
 
     return status::success;
 }
 
+/* Builds a hash map key from a pair of group identifiers. */
+static constexpr std::uint64_t
+pair_key(int a, int b) noexcept
+{
+    return (static_cast<std::uint64_t>(a) << 32) |
+           static_cast<std::uint64_t>(static_cast<std::uint32_t>(b));
+}
+
 status
 Options::init_dataset()
 {
@@ -361,50 +1137,89 @@ Options::init_dataset()
     if (size == 0)
         return status::csv_parser_init_dataset_simulation_empty;
 
-    subdataset.resize(size);
-    for (auto& elem : subdataset)
-        elem.clear();
+    if (!is_numeric_castable<int>(size))
+        return status::csv_parser_init_dataset_cast_error;
+
+    department_groups.init(departments);
+    year_groups.init(years);
+
+    if (places.empty())
+        place_groups.clear();
+    else
+        place_groups.init(places);
+
+    /* The excluded lines of an option are the union of its department,
+     * year and place groups. The size of the union is computed with the
+     * inclusion-exclusion principle from the sizes of the groups and of
+     * their intersections. The intersection of the three groups is the
+     * set of options with the same key and defines the subdataset
+     * identifier. */
+    std::unordered_map<std::uint64_t, int> dy, dp, yp, dyp;
+    std::vector<int> dy_id(size), keys(size);
+
+    dy.reserve(size);
+    if (!places.empty()) {
+        dp.reserve(size);
+        yp.reserve(size);
+        dyp.reserve(size);
+    }
+
+    {
+        std::unordered_map<std::uint64_t, int> ids;
+        ids.reserve(size);
 
-    if (places.empty()) {
         for (size_t i = 0; i != size; ++i) {
-            for (size_t j = 0; j != size; ++j) {
-                if (i != j && departments[i] != departments[j] &&
-                    years[i] != years[j]) {
-                    subdataset[i].emplace_back(static_cast<int>(j));
-                }
-            }
+            const auto key =
+              pair_key(department_groups.group[i], year_groups.group[i]);
+
+            dy_id[i] = ids.emplace(key, static_cast<int>(ids.size()))
+                         .first->second;
         }
-    } else {
-        for (size_t i = 0; i != size; ++i) {
-            for (size_t j = 0; j != size; ++j) {
-                if (i != j && departments[i] != departments[j] &&
-                    places[i] != places[j] && years[i] != years[j]) {
-                    subdataset[i].emplace_back(static_cast<int>(j));
-                }
-            }
+    }
+
+    for (size_t i = 0; i != size; ++i) {
+        const int d = department_groups.group[i];
+        const int y = year_groups.group[i];
+
+        ++dy[pair_key(d, y)];
+
+        if (!places.empty()) {
+            const int p = place_groups.group[i];
+
+            ++dp[pair_key(d, p)];
+            ++yp[pair_key(y, p)];
+            ++dyp[pair_key(dy_id[i], p)];
         }
     }
 
-    {
-        std::vector<std::vector<int>> reduced;
-        id_subdataset_reduced.resize(subdataset.size(), 0);
-
-        for (size_t i = 0, e = subdataset.size(); i != e; ++i) {
-            auto it =
-              std::find(reduced.cbegin(), reduced.cend(), subdataset[i]);
-
-            if (it == reduced.cend()) {
-                id_subdataset_reduced[i] = (int)reduced.size();
-                reduced.push_back(subdataset[i]);
-            } else {
-                if (!is_numeric_castable<int>(
-                      std::distance(reduced.cbegin(), it)))
-                    return status::csv_parser_init_dataset_cast_error;
-
-                id_subdataset_reduced[i] =
-                  static_cast<int>(std::distance(reduced.cbegin(), it));
-            }
+    subdataset_sizes.resize(size);
+    id_subdataset_reduced.resize(size);
+
+    std::unordered_map<std::uint64_t, int> ids;
+    ids.reserve(size);
+
+    for (size_t i = 0; i != size; ++i) {
+        const int d = department_groups.group[i];
+        const int y = year_groups.group[i];
+
+        int excluded = department_groups.size(d) + year_groups.size(y) -
+                       dy.find(pair_key(d, y))->second;
+
+        std::uint64_t key = static_cast<std::uint64_t>(dy_id[i]);
+
+        if (!places.empty()) {
+            const int p = place_groups.group[i];
+
+            key = pair_key(dy_id[i], p);
+            excluded += place_groups.size(p) -
+                        dp.find(pair_key(d, p))->second -
+                        yp.find(pair_key(y, p))->second +
+                        dyp.find(key)->second;
         }
+
+        subdataset_sizes[i] = static_cast<int>(size) - excluded;
+        id_subdataset_reduced[i] =
+          ids.emplace(key, static_cast<int>(ids.size())).first->second;
     }
 
     return status::success;
@@ -419,7 +1234,7 @@ Options::check()
              simulations.size() != observed.size() ||
              !(simulations.size() == places.size() || places.empty()) ||
              simulations.size() != id_subdataset_reduced.size() ||
-             subdataset.size() != simulations.size());
+             subdataset_sizes.size() != simulations.size());
 }
 
 void
@@ -432,7 +1247,10 @@ Options::clear() noexcept
     std::vector<int>().swap(observed);
 
     DynArray().swap(options);
-    std::vector<std::vector<int>>().swap(subdataset);
+    department_groups.clear();
+    year_groups.clear();
+    place_groups.clear();
+    std::vector<int>().swap(subdataset_sizes);
     std::vector<int>().swap(id_subdataset_reduced);
 }
 } // namespace efyj
@@ -23,6 +23,9 @@
 #define ORG_VLEPROJECT_EFYj_OPTIONS_HPP
 
 #include <optional>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
 
 #include <efyj/efyj.hpp>
 #include <efyj/matrix.hpp>
@@ -32,6 +35,74 @@
 
 namespace efyj {
 
+/** @e option_groups interns the values of one key column (department, year
+ * or place) of the options and stores the options of each group in a
+ * compressed rows format.
+ */
+struct option_groups
+{
+    std::vector<int> group;   ///< group identifier of each option.
+    std::vector<int> start;   ///< options of group g are in members
+    std::vector<int> members; ///< [start[g], start[g + 1]).
+
+    template<typename T>
+    void init(const std::vector<T>& keys)
+    {
+        using key_type = std::conditional_t<std::is_same_v<T, std::string>,
+                                            std::string_view,
+                                            T>;
+
+        std::unordered_map<key_type, int> ids;
+        ids.reserve(keys.size());
+
+        group.resize(keys.size());
+        start.clear();
+
+        for (size_t i = 0, e = keys.size(); i != e; ++i) {
+            auto ret = ids.emplace(key_type(keys[i]),
+                                   static_cast<int>(start.size()));
+            if (ret.second)
+                start.emplace_back(0);
+
+            group[i] = ret.first->second;
+            ++start[group[i]];
+        }
+
+        /* Converts the group sizes into the positions of the groups. */
+        int position = 0;
+        for (auto& elem : start) {
+            const int size = elem;
+            elem = position;
+            position += size;
+        }
+        start.emplace_back(position);
+
+        members.resize(keys.size());
+        std::vector<int> next(start.begin(), start.end() - 1);
+        for (size_t i = 0, e = keys.size(); i != e; ++i)
+            members[next[group[i]]++] = static_cast<int>(i);
+    }
+
+    int size(int g) const noexcept
+    {
+        return start[g + 1] - start[g];
+    }
+
+    template<typename Function>
+    void for_each(int g, Function f) const
+    {
+        for (int i = start[g], e = start[g + 1]; i != e; ++i)
+            f(members[i]);
+    }
+
+    void clear() noexcept
+    {
+        std::vector<int>().swap(group);
+        std::vector<int>().swap(start);
+        std::vector<int>().swap(members);
+    }
+};
+
 /** @e The Options class stores the complete option file. (i) A lot of
  * vectors to store simulations identifiers, places, departements, years and
  * observation, (ii) the complete matrix of option and a ordered structure to
@@ -59,17 +130,41 @@ public:
 
     void save(const char* filename) noexcept;
 
-    const std::vector<int>& get_subdataset(int id) const noexcept
+    /** Calls @e f for each line removed from the learning options of the
+     * option @e id: all lines sharing its department, its year or its
+     * place (the option itself included). Each line is visited once. */
+    template<typename Function>
+    void for_each_excluded(int id, Function f) const
     {
         assert(id >= 0);
-        assert(static_cast<size_t>(id) < subdataset.size());
+        assert(static_cast<size_t>(id) < simulations.size());
+
+        const int d = department_groups.group[id];
+        const int y = year_groups.group[id];
+
+        department_groups.for_each(d, f);
+        year_groups.for_each(y, [this, d, &f](int j) {
+            if (department_groups.group[j] != d)
+                f(j);
+        });
 
-        return subdataset[id];
+        if (!places.empty()) {
+            place_groups.for_each(
+              place_groups.group[id], [this, d, y, &f](int j) {
+                  if (department_groups.group[j] != d &&
+                      year_groups.group[j] != y)
+                      f(j);
+              });
+        }
     }
 
-    const std::vector<std::vector<int>>& get_subdataset() const noexcept
+    /** Returns the number of learning options of the option @e id. */
+    int subdataset_size(int id) const noexcept
     {
-        return subdataset;
+        assert(id >= 0);
+        assert(static_cast<size_t>(id) < subdataset_sizes.size());
+
+        return subdataset_sizes[id];
     }
 
     size_t size() const noexcept
@@ -91,8 +186,8 @@ public:
                observed.empty();
     }
 
-    /** Reads CSV from the input stream and ensures correspondence between
-     * the readed data and the model.
+    /** Reads CSV or binary dataset from the input stream and ensures
+     * correspondence between the readed data and the model.
      *
      * @param context use to log message if necessary.
      * @param [in] is input stream where read the CSV data.
@@ -102,10 +197,27 @@ public:
      */
     status read(context& ctx, const input_file& is, const Model& model);
 
+    /** Same as @e read but CSV files larger than 1 MiB are split into at
+     * most @e threads chunks parsed in parallel. */
+    status read(context& ctx,
+                const input_file& is,
+                const Model& model,
+                unsigned threads);
+
+    /** Writes the options, the observations and the subdataset groups in
+     * the binary dataset format read by @e read.
+     *
+     * @param [in] os output stream opened in binary mode.
+     * @param [in] model used to read the options.
+     *
+     * @return status of the write operation.
+     */
+    status write_binary(const output_file& os, const Model& model) const;
+
     bool have_subdataset() const
     {
-        for (const auto& elem : subdataset)
-            if (elem.empty())
+        for (const auto elem : subdataset_sizes)
+            if (elem == 0)
                 return false;
 
         return true;
@@ -122,19 +234,107 @@ public:
     bool check();
 
     /// \e init_dataset is called after \e read(...) or \e set(...)
-    /// functions to initialize the \e subdataset and \e
-    /// id_subdataset_reduced variables.
+    /// functions to initialize the groups, \e subdataset_sizes and \e
+    /// id_subdataset_reduced variables. Subdatasets are not stored: the
+    /// subdataset of an option is the complete dataset without the lines
+    /// visited by \e for_each_excluded.
     status init_dataset();
 
-    /// \e subdataset stores a list of line that defines the learning
-    /// options for each options. \e subdataset.size() equals \e
-    /// simulations.size()
-    std::vector<std::vector<int>> subdataset;
+    option_groups department_groups;
+    option_groups year_groups;
+    option_groups place_groups;
+
+    /// \e subdataset_sizes stores the number of learning options for each
+    /// options.
+    std::vector<int> subdataset_sizes;
 
     /// \e id_subdataset_reduced stores indices for each options. Index
-    /// may appear several times if the learning options are equals.
+    /// may appear several times if the learning options are equals
+    /// (options with the same department, year and place).
     std::vector<int> id_subdataset_reduced;
 };
+
+/** @e options_block stores rows of a CSV options file. The scale values of
+ * the row @e r are stored in @e options from @e r * cols to (@e r + 1) *
+ * cols in the order of the basic attributes of the model.
+ */
+struct options_block
+{
+    std::vector<std::string> simulations;
+    std::vector<std::string> places;
+    std::vector<int> departments;
+    std::vector<int> years;
+    std::vector<int> observed;
+    std::vector<int> options;
+
+    size_t size() const noexcept
+    {
+        return observed.size();
+    }
+
+    /** Removes the rows but keeps the allocated memory. */
+    void clear() noexcept
+    {
+        simulations.clear();
+        places.clear();
+        departments.clear();
+        years.clear();
+        observed.clear();
+        options.clear();
+    }
+};
+
+/** @e options_stream reads a CSV options file by blocks of rows from a
+ * reader callback. Only the rows of the current block and the incomplete
+ * last line are kept in memory.
+ */
+class options_stream
+{
+public:
+    size_t error_at_line = 0;   ///< when read error, these attributes store
+    size_t error_at_column = 0; ///< line and column indices.
+
+    options_stream(const Model& model,
+                   stream_reader_callback reader,
+                   void* user_data);
+
+    /** Reads the header line and builds the conversion between the
+     * columns and the basic attributes of the model. */
+    status read_header(context& ctx);
+
+    /** Reads the next @e rows lines into @e block. Lines with a bad number
+     * of columns or bad department or year are logged and skipped, the
+     * block can be empty before the end of the stream. */
+    status read(context& ctx, size_t rows, options_block& block);
+
+    /** Returns true when all the lines are read. */
+    bool eof() const noexcept
+    {
+        return m_eof && m_position == m_buffer.size();
+    }
+
+    /** Returns the number of basic attributes (the columns of the
+     * options of a block). */
+    size_t columns() const noexcept
+    {
+        return m_atts.size();
+    }
+
+private:
+    bool fill();
+    bool find_line(size_t from, size_t& end);
+
+    std::vector<const attribute*> m_atts;
+    model_lookup m_lookup;
+    std::vector<int> m_convertheader;
+    std::string m_buffer;
+    size_t m_position = 0;
+    size_t m_line = 0;
+    size_t m_id = 0;
+    stream_reader_callback m_reader;
+    void* m_user_data;
+    bool m_eof = false;
+};
 }
 
 #endif
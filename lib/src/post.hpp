@@ -22,6 +22,8 @@
 #ifndef INRA_EFYj_POST_HPP
 #define INRA_EFYj_POST_HPP
 
+#include <algorithm>
+#include <tuple>
 #include <vector>
 
 #include <fmt/color.h>
@@ -29,7 +31,9 @@
 
 #include <efyj/efyj.hpp>
 
+#include <cassert>
 #include <cmath>
+#include <cstdint>
 
 namespace efyj {
 
@@ -146,6 +150,33 @@ public:
         return post();
     }
 
+    /** Computes the linear weighted kappa from a confusion matrix
+     * (observed in rows, simulated in columns). */
+    double linear(const matrix<int>& confusion) noexcept
+    {
+        pre(confusion);
+
+        for (int i = 0; i != NC; ++i)
+            for (int j = 0; j != NC; ++j)
+                weighted(i, j) = std::abs(i - j);
+
+        return post();
+    }
+
+    /** Computes the squared weighted kappa from a confusion matrix
+     * (observed in rows, simulated in columns). The result is the same as
+     * @e squared() with the vectors used to build the matrix. */
+    double squared(const matrix<int>& confusion) noexcept
+    {
+        pre(confusion);
+
+        for (int i = 0; i != NC; ++i)
+            for (int j = 0; j != NC; ++j)
+                weighted(i, j) = std::abs(i - j) * std::abs(i - j);
+
+        return post();
+    }
+
 private:
     matrix<double> observed;
     matrix<double> distributions;
@@ -180,6 +211,37 @@ private:
                 expected(i, j) = distributions(i, 0) * distributions(j, 1);
     }
 
+    void pre(const matrix<int>& confusion) noexcept
+    {
+        assert(confusion.rows() == static_cast<size_t>(NC) &&
+               confusion.columns() == static_cast<size_t>(NC) &&
+               "weighted_kappa_calculator bad confusion matrix size");
+
+        std::fill(distributions.begin(), distributions.end(), 0.0);
+        double size = 0.0;
+
+        for (int i = 0; i != NC; ++i) {
+            for (int j = 0; j != NC; ++j) {
+                const double count = confusion(i, j);
+
+                observed(i, j) = count;
+                distributions(i, 0) += count;
+                distributions(j, 1) += count;
+                size += count;
+            }
+        }
+
+        for (auto& elem : observed)
+            elem /= size;
+
+        for (auto& elem : distributions)
+            elem /= size;
+
+        for (int i = 0; i != (int)NC; ++i)
+            for (int j = 0; j != (int)NC; ++j)
+                expected(i, j) = distributions(i, 0) * distributions(j, 1);
+    }
+
     double post() noexcept
     {
         auto sum_expected = mult_and_sum(weighted, expected);
@@ -189,6 +251,233 @@ private:
         return 1.0;
     }
 };
+
+/**
+ * @details The @e kappa_cache class stores the kappa already computed for a
+ *     simulated vector. Many line modifiers produce exactly the same
+ *     simulated root values, the cache uses a 64 bits signature of the
+ *     simulated vector (computed with @e combine during the solve loop) to
+ *     skip the kappa computation. The table is a bounded open addressing hash
+ *     table: when the probe window is full, the home slot is replaced.
+ */
+class kappa_cache
+{
+public:
+    static constexpr std::uint64_t seed = 14695981039346656037ULL;
+
+    kappa_cache(std::size_t capacity = 4096)
+      : m_keys(std::max(next_power_of_two(capacity), probe_window), 0)
+      , m_values(m_keys.size(), 0.0)
+      , m_mask(m_keys.size() - 1)
+    {}
+
+    static constexpr std::uint64_t combine(std::uint64_t hash,
+                                           int value) noexcept
+    {
+        return (hash ^ static_cast<std::uint64_t>(value)) * 1099511628211ULL;
+    }
+
+    template<typename Vector>
+    static std::uint64_t signature(const Vector& simulated) noexcept
+    {
+        std::uint64_t ret = seed;
+
+        for (const auto value : simulated)
+            ret = combine(ret, value);
+
+        return ret;
+    }
+
+    void clear() noexcept
+    {
+        std::fill(m_keys.begin(), m_keys.end(), 0);
+    }
+
+    bool find(std::uint64_t hash, double& kappa) const noexcept
+    {
+        const auto key = make_key(hash);
+        auto slot = make_slot(key);
+
+        for (std::size_t i = 0; i != probe_window; ++i) {
+            if (m_keys[slot] == key) {
+                kappa = m_values[slot];
+                return true;
+            }
+
+            if (m_keys[slot] == 0)
+                return false;
+
+            slot = (slot + 1) & m_mask;
+        }
+
+        return false;
+    }
+
+    void insert(std::uint64_t hash, double kappa) noexcept
+    {
+        const auto key = make_key(hash);
+        const auto home = make_slot(key);
+        auto slot = home;
+
+        for (std::size_t i = 0; i != probe_window; ++i) {
+            if (m_keys[slot] == 0 || m_keys[slot] == key) {
+                m_keys[slot] = key;
+                m_values[slot] = kappa;
+                return;
+            }
+
+            slot = (slot + 1) & m_mask;
+        }
+
+        m_keys[home] = key;
+        m_values[home] = kappa;
+    }
+
+private:
+    static constexpr std::size_t probe_window = 8;
+
+    std::vector<std::uint64_t> m_keys;
+    std::vector<double> m_values;
+    std::size_t m_mask;
+
+    static constexpr std::size_t next_power_of_two(std::size_t n) noexcept
+    {
+        std::size_t ret = 1;
+        while (ret < n)
+            ret <<= 1;
+
+        return ret;
+    }
+
+    /* The key 0 is reserved to mark empty slots. */
+    static constexpr std::uint64_t make_key(std::uint64_t hash) noexcept
+    {
+        return hash ? hash : 1;
+    }
+
+    std::size_t make_slot(std::uint64_t key) const noexcept
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+
+        return static_cast<std::size_t>(key) & m_mask;
+    }
+};
+
+/**
+ * @details The @e top_candidates class keeps the @e capacity best candidates
+ *     of a step into a fixed-capacity min-heap: the worst retained candidate
+ *     is on the front and is replaced when a better one is found. Candidates
+ *     are ordered by kappa then by enumeration ordinal (the first enumerated
+ *     wins) so the retained set does not depend on the heap layout.
+ */
+class top_candidates
+{
+public:
+    struct candidate
+    {
+        std::vector<std::tuple<int, int, int>> updaters;
+        double kappa;
+        unsigned long long int ordinal;
+    };
+
+    top_candidates(std::size_t capacity)
+      : m_capacity(capacity)
+    {
+        m_candidates.reserve(capacity);
+    }
+
+    std::size_t capacity() const noexcept
+    {
+        return m_capacity;
+    }
+
+    std::size_t size() const noexcept
+    {
+        return m_size;
+    }
+
+    /* The candidates are kept to reuse the memory of their updaters. */
+    void clear() noexcept
+    {
+        m_size = 0;
+    }
+
+    /* Cheap test to call before building the updaters of a candidate. */
+    bool accept(double kappa, unsigned long long int ordinal) const noexcept
+    {
+        if (m_size < m_capacity)
+            return true;
+
+        return m_capacity > 0 &&
+               better(kappa, ordinal, m_candidates.front());
+    }
+
+    void push(double kappa,
+              unsigned long long int ordinal,
+              const std::vector<std::tuple<int, int, int>>& updaters)
+    {
+        const auto first = m_candidates.begin();
+
+        if (m_size < m_capacity) {
+            if (m_size == m_candidates.size())
+                m_candidates.emplace_back();
+
+            assign(m_candidates[m_size++], kappa, ordinal, updaters);
+            std::push_heap(first, first + m_size, compare);
+            return;
+        }
+
+        std::pop_heap(first, first + m_size, compare);
+        assign(m_candidates[m_size - 1], kappa, ordinal, updaters);
+        std::push_heap(first, first + m_size, compare);
+    }
+
+    /* Sorts the candidates from the best to the worst. The heap is no
+     * longer valid after this call and @e clear() must be called before the
+     * next @e push(). */
+    void sort()
+    {
+        std::sort_heap(
+          m_candidates.begin(), m_candidates.begin() + m_size, compare);
+    }
+
+    const candidate& operator[](std::size_t i) const noexcept
+    {
+        assert(i < m_size);
+
+        return m_candidates[i];
+    }
+
+private:
+    std::vector<candidate> m_candidates;
+    std::size_t m_capacity;
+    std::size_t m_size = 0;
+
+    static void assign(candidate& elem,
+                       double kappa,
+                       unsigned long long int ordinal,
+                       const std::vector<std::tuple<int, int, int>>& updaters)
+    {
+        elem.updaters.assign(updaters.begin(), updaters.end());
+        elem.kappa = kappa;
+        elem.ordinal = ordinal;
+    }
+
+    static bool better(double kappa,
+                       unsigned long long int ordinal,
+                       const candidate& other) noexcept
+    {
+        return kappa > other.kappa ||
+               (kappa == other.kappa && ordinal < other.ordinal);
+    }
+
+    static bool compare(const candidate& lhs, const candidate& rhs) noexcept
+    {
+        return better(lhs.kappa, lhs.ordinal, rhs);
+    }
+};
 }
 
 #endif
@@ -19,264 +19,473 @@
  * IN THE SOFTWARE.
  */
 
-#include <chrono>
-#include <iterator>
-#include <map>
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <thread>
 
-#include "model.hpp"
-#include "options.hpp"
-#include "post.hpp"
 #include "prediction-thread.hpp"
-#include "private.hpp"
-#include "solver-stack.hpp"
 #include "utils.hpp"
 
-#include <chrono>
-#include <mutex>
-#include <thread>
-
 namespace efyj {
 
-template<typename Solver>
-static bool
-init_worker(Solver& solver, const int thread_id)
+prediction_worker::prediction_worker(const for_each_model_solver& solver_,
+                                     const Model& model,
+                                     const Options& options,
+                                     size_t folds)
+  : solver(solver_)
+  , kappa_c(model.attributes[0].scale.size())
+  , simulated(options.options.rows())
+  , confusion(model.attributes[0].scale.size(),
+              model.attributes[0].scale.size())
+  , fold_confusion(model.attributes[0].scale.size(),
+                   model.attributes[0].scale.size())
+  , fold_kappa(folds)
+  , fold_candidate(folds)
+  , fold_modifiers(folds)
+  , fold_updaters(folds)
+{}
+
+prediction_thread_evaluator::prediction_thread_evaluator(context& ctx,
+                                                         const Model& model,
+                                                         const Options& options,
+                                                         line_order order)
+  : m_context(ctx)
+  , m_model(model)
+  , m_options(options)
+  , m_globalsimulated(options.observed.size(), 0)
+  , solver(ctx, model)
+  , kappa_c(model.attributes[0].scale.size())
+  , m_order(order)
+  , m_stop(false)
+  , m_next_subtree(0)
 {
-    for (auto i = 0; i < thread_id; ++i)
-        if (solver.next_line() == false)
-            return false;
+    for (int opt = 0, e = static_cast<int>(options.size()); opt != e; ++opt) {
+        const auto fold = static_cast<size_t>(options.identifier(opt));
+
+        if (fold >= m_fold_first.size()) {
+            m_fold_first.resize(fold + 1, -1);
+            m_fold_options.resize(fold + 1);
+        }
+
+        if (m_fold_first[fold] < 0)
+            m_fold_first[fold] = opt;
 
-    return true;
+        m_fold_options[fold].emplace_back(opt);
+    }
+
+    m_fold_kappa.resize(m_fold_first.size(), 0.0);
 }
 
-static void
-parallel_prediction_worker(context& ctx,
-                           const Model& model,
-                           const Options& options,
-                           const unsigned int thread_id,
-                           const unsigned int thread_number,
-                           const bool& stop,
-                           Results& results)
+bool
+prediction_thread_evaluator::is_valid() const noexcept
 {
-    std::vector<int> m_globalsimulated(options.observed.size());
-    std::vector<int> m_simulated(options.observed.size());
-    std::vector<std::vector<scale_id>> m_globalfunctions, m_functions;
-    std::vector<std::tuple<int, int, int>> m_globalupdaters, m_updaters;
+    return m_options.have_subdataset();
+}
 
-    for_each_model_solver solver(ctx, model);
-    weighted_kappa_calculator kappa_c(model.attributes[0].scale.size());
-    solver.reduce(options);
+/* Number of combinations of @e k elements among @e n. A double is enough to
+ * estimate the cost of a subtree. */
+static double
+binomial(size_t n, size_t k) noexcept
+{
+    if (k > n)
+        return 0.0;
 
-    size_t step = 1;
-    size_t max_step = solver.get_attribute_line_tuple_limit();
-    unsigned long m_loop = 0;
-    double m_kappa = 0.0;
+    double ret = 1.0;
+    for (size_t i = 0; i != k; ++i)
+        ret = ret * static_cast<double>(n - i) / static_cast<double>(i + 1);
 
-    while (step != max_step) {
-        m_kappa = 0;
-        m_globalupdaters.clear();
+    return ret;
+}
 
-        solver.init_walkers(step);
+/** Builds the subtrees of the @e step. The subtree starting at the position
+ * @e p contains C(n - p - 1, step - 1) line combinations and the first
+ * walker takes scale size values in each. The subtrees are explored from
+ * the most to the least expensive so that the last ones, taken when the
+ * other workers are idle, are short.
+ */
+void
+prediction_thread_evaluator::schedule(size_t step)
+{
+    const size_t n = solver.line_number();
 
-        if (init_worker(solver, thread_id) == false) {
-            ++step;
-            continue;
-        }
+    m_subtrees.clear();
+    if (step == 0 || step > n)
+        return;
 
-        bool isend = false;
-        while (isend == false) {
-            if (stop)
-                return;
+    std::vector<double> cost(n - step + 1);
+    for (size_t p = 0, e = cost.size(); p != e; ++p) {
+        m_subtrees.emplace_back(p);
+        cost[p] = binomial(n - p - 1, step - 1) * solver.line_scale_size(p);
+    }
 
-            std::fill(m_globalsimulated.begin(), m_globalsimulated.end(), 0);
+    std::stable_sort(
+      m_subtrees.begin(), m_subtrees.end(), [&cost](size_t lhs, size_t rhs) {
+          return cost[lhs] > cost[rhs];
+      });
+}
 
-            for (auto opt = 0, endopt = length(options); opt != endopt; ++opt) {
-                double kappa = 0.;
+/** Explores the subtrees of the @e step until the schedule is empty. The
+ * search is the same as the @e prediction_evaluator one: the first candidate
+ * of a fold is accepted if it reaches the best kappa of the previous step,
+ * the next ones if they are better or equal with a lower ordinal.
+ */
+void
+prediction_thread_evaluator::search(prediction_worker& worker,
+                                    size_t step,
+                                    cancellation_check& stop)
+{
+    const size_t max_opt = m_options.simulations.size();
+    const size_t max_fold = m_fold_first.size();
+    auto& solver = worker.solver;
+
+    std::copy(m_fold_kappa.begin(), m_fold_kappa.end(),
+              worker.fold_kappa.begin());
+    for (auto& elem : worker.fold_updaters)
+        elem.clear();
+
+    worker.loop = 0;
+    solver.restore();
+
+    for (;;) {
+        const size_t next = m_next_subtree.fetch_add(1);
+        if (next >= m_subtrees.size())
+            return;
+
+        /* The subtrees are not explored in the enumeration order: an
+         * already seen simulated vector may come from a candidate with a
+         * greater ordinal, so the cache is only valid in a subtree. */
+        const size_t first = m_subtrees[next];
+        solver.init_walkers(step, first);
+        worker.m_kappa_cache.clear();
+
+        size_t line = 0;
+        do {
+            solver.init_next_value();
+            size_t value = 0;
+
+            do {
+                auto signature = kappa_cache::seed;
+                for (size_t opt = 0; opt != max_opt; ++opt) {
+                    worker.simulated[opt] =
+                      solver.solve(m_options.options.row(opt));
+                    signature =
+                      kappa_cache::combine(signature, worker.simulated[opt]);
+                }
 
-                solver.init_next_value();
+                double seen;
+                if (!worker.m_kappa_cache.find(signature, seen)) {
+                    worker.m_kappa_cache.insert(signature, 0.0);
+
+                    std::fill(
+                      worker.confusion.begin(), worker.confusion.end(), 0);
+                    for (size_t opt = 0; opt != max_opt; ++opt)
+                        ++worker.confusion(m_options.observed[opt],
+                                           worker.simulated[opt]);
+
+                    for (size_t fold = 0; fold != max_fold; ++fold) {
+                        worker.fold_confusion = worker.confusion;
+                        m_options.for_each_excluded(
+                          m_fold_first[fold], [this, &worker](int x) {
+                              --worker.fold_confusion(m_options.observed[x],
+                                                      worker.simulated[x]);
+                          });
+
+                        auto localkappa =
+                          worker.kappa_c.squared(worker.fold_confusion);
+                        worker.loop++;
+
+                        const prediction_worker::candidate current{ first,
+                                                                    line,
+                                                                    value };
+                        const bool accept =
+                          worker.fold_updaters[fold].empty()
+                            ? localkappa > 0.0 &&
+                                localkappa >= worker.fold_kappa[fold]
+                            : localkappa > worker.fold_kappa[fold] ||
+                                (localkappa == worker.fold_kappa[fold] &&
+                                 current < worker.fold_candidate[fold]);
+
+                        if (accept) {
+                            solver.get_modifiers(worker.fold_modifiers[fold]);
+                            solver.updaters(worker.fold_updaters[fold]);
+                            worker.fold_kappa[fold] = localkappa;
+                            worker.fold_candidate[fold] = current;
+                        }
+                    }
+                }
 
-                do {
-                    std::fill(m_simulated.begin(), m_simulated.end(), 0);
+                ++value;
 
-                    for (auto x : options.get_subdataset(opt))
-                        m_simulated[x] = solver.solve(options.options.row(x));
+                if (stop()) {
+                    m_stop.store(true, std::memory_order_relaxed);
+                    return;
+                }
+            } while (solver.next_value() == true);
 
-                    auto ret = kappa_c.squared(options.observed, m_simulated);
-                    m_loop++;
+            if (m_progress && !m_progress->advance(value)) {
+                m_stop.store(true, std::memory_order_relaxed);
+                return;
+            }
 
-                    if (ret > kappa) {
-                        solver.get_functions(m_functions);
-                        m_updaters = solver.updaters();
-                        kappa = ret;
-                    }
-                } while (solver.next_value() == true);
+            ++line;
+        } while (solver.next_line(1) == true);
+    }
+}
 
-                solver.set_functions(m_functions);
-                m_globalsimulated[opt] = solver.solve(options.options.row(opt));
-            }
+/** Selects for each fold the best candidate of all the workers: the highest
+ * kappa and, for equal kappa, the first candidate in the enumeration order.
+ * This is the candidate the @e prediction_evaluator keeps. Then fills
+ * @e m_globalsimulated like @e prediction_evaluator::simulate_folds.
+ */
+long int
+prediction_thread_evaluator::merge()
+{
+    long int loop = 0;
+    for (const auto& worker : m_workers)
+        loop += worker.loop;
 
-            // We need to send results here.
+    for (size_t fold = 0, e = m_fold_first.size(); fold != e; ++fold) {
+        prediction_worker* best = nullptr;
 
-            auto ret = kappa_c.squared(options.observed, m_globalsimulated);
-            m_loop++;
+        for (auto& worker : m_workers) {
+            if (worker.fold_updaters[fold].empty())
+                continue;
 
-            if (ret > m_kappa) {
-                m_kappa = ret;
-                m_globalupdaters = solver.updaters();
-                m_globalfunctions = m_functions;
-            }
+            if (!best || worker.fold_kappa[fold] > best->fold_kappa[fold] ||
+                (worker.fold_kappa[fold] == best->fold_kappa[fold] &&
+                 worker.fold_candidate[fold] < best->fold_candidate[fold]))
+                best = &worker;
+        }
 
-            for (unsigned int i = 0; i < thread_number; ++i) {
-                if (solver.next_line() == false) {
-                    results.push(static_cast<int>(step),
-                                 m_kappa,
-                                 m_loop,
-                                 m_globalupdaters);
-                    isend = true;
-                    break;
-                }
-            }
+        if (best) {
+            m_fold_kappa[fold] = best->fold_kappa[fold];
+            m_modifiers.swap(best->fold_modifiers[fold]);
+            m_updaters = best->fold_updaters[fold];
         }
 
-        step++;
+        solver.set_modifiers(m_modifiers);
+        for (auto opt : m_fold_options[fold])
+            m_globalsimulated[opt] = solver.solve(m_options.options.row(opt));
     }
-}
 
-prediction_thread_evaluator::prediction_thread_evaluator(context& ctx,
-                                                         const Model& model,
-                                                         const Options& options)
-  : m_context(ctx)
-  , m_model(model)
-  , m_options(options)
-  , m_globalsimulated(options.observed.size(), 0)
-  , simulated(options.options.rows())
-  , observed(options.options.rows())
-  , solver(ctx, model)
-  , kappa_c(model.attributes[0].scale.size())
-{}
+    return loop;
+}
 
-bool
-prediction_thread_evaluator::is_valid() const noexcept
+status
+prediction_thread_evaluator::run(result_callback callback,
+                                 void* user_data_callback,
+                                 int line_limit,
+                                 double time_limit,
+                                 int reduce_mode,
+                                 unsigned int threads,
+                                 const std::string& output_directory)
 {
-    return m_options.have_subdataset();
+    return run(nullptr,
+               nullptr,
+               callback,
+               user_data_callback,
+               line_limit,
+               time_limit,
+               reduce_mode,
+               threads,
+               output_directory);
 }
 
 status
-prediction_thread_evaluator::run(
-  result_callback /*callback*/,
-  void* /*user_data_callback*/,
-  [[maybe_unused]] int line_limit,
-  [[maybe_unused]] double time_limit,
-  [[maybe_unused]] int reduce_mode,
-  unsigned int threads,
-  [[maybe_unused]] const std::string& output_directory)
+prediction_thread_evaluator::run(check_user_interrupt_callback interrupt,
+                                 void* user_data_interrupt,
+                                 result_callback callback,
+                                 void* user_data_callback,
+                                 int line_limit,
+                                 double time_limit,
+                                 int reduce_mode,
+                                 unsigned int threads,
+                                 const std::string& output_directory)
 {
-    info(m_context, "[Computation starts with %u thread(s)]\n", threads);
-
-    Results results(m_context, m_model, threads);
-    bool stop = false;
-
-    std::vector<std::thread> workers{ threads };
-
-    for (auto i = 0u; i != threads; ++i) {
-        workers[i] = std::thread(parallel_prediction_worker,
-                                 std::ref(m_context),
-                                 std::cref(m_model),
-                                 std::cref(m_options),
-                                 i,
-                                 threads,
-                                 std::cref(stop),
-                                 std::ref(results));
-    }
+    model_writer writer;
+    if (auto ret = writer.init(m_context, output_directory); is_bad(ret))
+        return ret;
 
-    /* Here try to read outputs of compuation from prediction workers. */
-    /* TODO what use? */
+    info(m_context, "[Output directory]\n{}\n", writer.directory.string());
 
-    /* Stop work and wait for all prediction workers. */
-    /* TODO stop = true; */
+    result ret;
 
-    for (auto& w : workers)
-        w.join();
+    info(m_context, "[Computation starts with {} thread(s)]\n", threads);
 
-    return status::success;
-}
+    if (reduce_mode)
+        solver.reduce(m_options);
 
-Results::Results(context& ctx, const Model& mdl, unsigned int threads)
-  : m_context(ctx)
-  , m_model(mdl)
-  , m_threads(threads)
-  , m_start(std::chrono::system_clock::now())
-{
-    m_results.reserve(32);
-    m_results.resize(1u);
+    solver.sort_lines(m_options, m_order);
 
-    m_level.reserve(32);
-    m_level.resize(1u);
-    m_level[0] = threads;
-}
+    solver.get_functions(m_globalfunctions);
+    assert(!m_globalfunctions.empty() &&
+           "prediction can not determine function");
 
-status
-Results::init(const std::string& output_directory)
-{
-    if (auto ret = m_writer.init(output_directory); is_bad(ret))
-        return ret;
+    const size_t max_step =
+      max_value(line_limit, solver.get_attribute_line_tuple_limit());
 
-    info(m_context, "[Output directory]\n{}\n", m_writer.directory.string());
+    assert(max_step > 0 && "prediction: can not determine limit");
 
-    return status::success;
-}
+    if (m_progress)
+        m_progress->start(max_step, solver.candidate_number(max_step));
 
-void
-Results::emplace_result(int i,
-                        double kappa,
-                        unsigned long loop,
-                        const std::vector<std::tuple<int, int, int>>& updaters)
-{
-    assert(static_cast<size_t>(i) < m_level.size() &&
-           static_cast<size_t>(i) < m_results.size());
+    const auto deadline = make_deadline(time_limit);
 
-    m_results[i].kappa = kappa;
-    m_results[i].loop += loop;
-    m_results[i].updaters = updaters;
-}
+    m_stop.store(false);
+    m_workers.clear();
+    m_workers.reserve(std::max(threads, 1u));
+    for (unsigned int i = 0; i < std::max(threads, 1u); ++i)
+        m_workers.emplace_back(solver, m_model, m_options, m_fold_first.size());
 
-void
-Results::push(int step,
-              double kappa,
-              unsigned long loop,
-              const std::vector<std::tuple<int, int, int>>& updaters)
-{
-    std::lock_guard<std::mutex> locker(m_container_mutex);
-
-    assert(step >= 1);
-
-    if (static_cast<size_t>(step - 1) >= m_results.size()) {
-        /* A new level (threshold) is reached we append new elements
-           to the level and results vectors. */
-        m_level.emplace_back(static_cast<int>(m_threads - 1));
-        m_results.emplace_back();
-
-        emplace_result(
-          static_cast<int>(m_results.size()) - 1, kappa, loop, updaters);
-    } else {
-        if (m_results[step - 1].kappa < kappa)
-            emplace_result(step - 1, kappa, loop, updaters);
-        else
-            m_results[step - 1].loop += loop;
+    info(m_context, "[Computation starts 1/{}]\n", max_step);
+
+    {
+        m_start = std::chrono::system_clock::now();
+        for (size_t opt = 0; opt != m_options.size(); ++opt)
+            m_globalsimulated[opt] = solver.solve(m_options.options.row(opt));
+
+        auto kappa = kappa_c.squared(m_options.observed, m_globalsimulated);
+
+        m_end = std::chrono::system_clock::now();
+
+        info(m_context,
+             "| line updated | kappa | kappa computed "
+             "| time (s) | tuple (attribute, line, value) updated |\n");
+
+        info(m_context,
+             "| {} | {:13.10f} | {} | {} | [] |\n",
+             0,
+             kappa,
+             1,
+             std::chrono::duration<double>(m_end - m_start).count());
+
+        ret.kappa = kappa;
+        ret.time = std::chrono::duration<double>(m_end - m_start).count();
+        ret.kappa_computed = 1;
+
+        if (!is_numeric_castable<unsigned long>(m_options.size()))
+            return status::option_too_many;
+
+        ret.function_computed = static_cast<unsigned long>(m_options.size());
+
+        writer.store(m_context, m_model, ret);
+
+        if (m_progress)
+            m_progress->end_step(kappa);
+
+        if (!callback(ret, user_data_callback))
+            return status::success;
     }
 
-    m_end = std::chrono::system_clock::now();
-    auto duration = std::chrono::duration<double>(m_end - m_start).count();
+    for (size_t step = 1; step <= max_step; ++step) {
+        m_start = std::chrono::system_clock::now();
+
+        if (m_progress)
+            m_progress->begin_step(step);
+
+        schedule(step);
+        m_next_subtree.store(0);
+
+        {
+            /* The first worker reaching the deadline stops the others. The
+             * calling thread runs the first worker, then checks the
+             * interrupt callback until the other workers end. An exception
+             * of a worker, of the callback or of a thread creation stops
+             * the workers before it is rethrown. */
+            std::vector<std::thread> pool;
+            pool.reserve(m_workers.size() - 1);
+            std::vector<std::exception_ptr> errors(m_workers.size());
+            std::atomic<size_t> running{ m_workers.size() - 1 };
+
+            try {
+                for (size_t i = 1, e = m_workers.size(); i != e; ++i)
+                    pool.emplace_back(
+                      [this, i, step, deadline, &running, &errors]() {
+                          try {
+                              cancellation_check stop(&m_stop, deadline);
+                              search(m_workers[i], step, stop);
+                          } catch (...) {
+                              m_stop.store(true);
+                              errors[i] = std::current_exception();
+                          }
+
+                          running.fetch_sub(1);
+                      });
+
+                cancellation_check stop(
+                  &m_stop, deadline, interrupt, user_data_interrupt);
+                search(m_workers[0], step, stop);
+
+                while (interrupt && running.load() != 0 && !stop.poll())
+                    std::this_thread::sleep_for(
+                      cancellation_check::resolution);
+
+                if (stop.stopped())
+                    m_stop.store(true);
+            } catch (...) {
+                m_stop.store(true);
+                errors[0] = std::current_exception();
+            }
+
+            for (auto& thread : pool)
+                thread.join();
 
-    info(m_context,
-         "| {} | {:13.10f} | {} | {} |",
-         step,
-         m_results[step - 1].kappa,
-         m_results[step - 1].loop,
-         duration);
+            for (const auto& error : errors)
+                if (error)
+                    std::rethrow_exception(error);
+        }
+
+        /* A step interrupted by the time limit or by a job cancellation is
+         * incomplete: its result may differ from the sequential one and is
+         * not reported. */
+        if (m_stop.load())
+            break;
+
+        long int loop = merge();
+
+        auto line_kappa =
+          kappa_c.squared(m_options.observed, m_globalsimulated);
+        m_end = std::chrono::system_clock::now();
+
+        auto time = std::chrono::duration<double>(m_end - m_start).count();
+        loop++;
+
+        ret.kappa = line_kappa;
+        ret.time = time;
+        ret.kappa_computed = static_cast<unsigned long int>(loop);
+        ret.function_computed = static_cast<unsigned long int>(0);
+        ret.modifiers.clear();
+
+        info(m_context,
+             "| {} | {:13.10f} | {} | {} | ",
+             step,
+             ret.kappa,
+             loop,
+             time);
+
+        for (const auto& elem : m_updaters) {
+            ret.modifiers.emplace_back(
+              std::get<0>(elem), std::get<1>(elem), std::get<2>(elem));
+            info(m_context,
+                 "[{},{},{}] ",
+                 std::get<0>(elem),
+                 std::get<1>(elem),
+                 std::get<2>(elem));
+        }
 
-    m_writer.store(m_context, m_model, m_results[step - 1].updaters);
-    // print(m_context, m_results[step - 1].updaters);
-    info(m_context, "\n");
+        info(m_context, "\n");
+
+        writer.store(m_context, m_model, ret);
+
+        if (m_progress)
+            m_progress->end_step(ret.kappa);
+
+        if (!callback(ret, user_data_callback))
+            break;
+    }
+
+    return status::success;
 }
 
 } // namespace efyj
@@ -22,21 +22,50 @@
 #ifndef ORG_VLEPROJECT_EFYJ_DETAILS_PREDICTION_THREAD_HPP
 #define ORG_VLEPROJECT_EFYJ_DETAILS_PREDICTION_THREAD_HPP
 
+#include <atomic>
 #include <chrono>
-#include <iterator>
-#include <map>
+#include <tuple>
 
+#include "cancellation.hpp"
 #include "model.hpp"
 #include "options.hpp"
 #include "post.hpp"
 #include "private.hpp"
+#include "progress.hpp"
 #include "solver-stack.hpp"
 
-#include <mutex>
-#include <thread>
-
 namespace efyj {
 
+/** A @e prediction_worker owns a copy of the reduced and sorted solver and
+ * explores the subtrees of a step, i.e. the line combinations sharing the
+ * position of their first walker, taken from the evaluator schedule. For
+ * each fold, it keeps the best kappa found, the ordinal (first walker,
+ * line combination in the subtree, value combination) of the candidate
+ * which produced it and its modifiers. The best kappa starts from the one
+ * of the previous step.
+ */
+struct prediction_worker
+{
+    using candidate = std::tuple<size_t, size_t, size_t>;
+
+    for_each_model_solver solver;
+    weighted_kappa_calculator kappa_c;
+    kappa_cache m_kappa_cache;
+    std::vector<int> simulated;
+    matrix<int> confusion, fold_confusion;
+
+    std::vector<double> fold_kappa;
+    std::vector<candidate> fold_candidate;
+    std::vector<std::vector<line_modifier>> fold_modifiers;
+    std::vector<std::vector<std::tuple<int, int, int>>> fold_updaters;
+    long int loop = 0;
+
+    prediction_worker(const for_each_model_solver& solver_,
+                      const Model& model,
+                      const Options& options,
+                      size_t folds);
+};
+
 struct prediction_thread_evaluator
 {
     context& m_context;
@@ -46,16 +75,33 @@ struct prediction_thread_evaluator
     std::chrono::time_point<std::chrono::system_clock> m_start, m_end;
     std::vector<int> m_globalsimulated;
     std::vector<std::tuple<int, int, int>> m_updaters;
-    std::vector<std::vector<int>> m_globalfunctions, m_functions;
-    std::vector<int> simulated;
-    std::vector<int> observed;
+    std::vector<std::vector<int>> m_globalfunctions;
+    std::vector<line_modifier> m_modifiers;
     for_each_model_solver solver;
     weighted_kappa_calculator kappa_c;
-    unsigned long long int m_loop = 0;
+    line_order m_order;
+
+    /* Optional progress published to the job of @e start_prediction. */
+    progress* m_progress = nullptr;
+
+    /* Same folds as the @e prediction_evaluator: the first option using a
+     * distinct learning subdataset and all the options using it. */
+    std::vector<int> m_fold_first;
+    std::vector<std::vector<int>> m_fold_options;
+    std::vector<double> m_fold_kappa;
+
+    std::vector<prediction_worker> m_workers;
+    std::atomic<bool> m_stop;
+
+    /* Positions of the first walker of the step subtrees sorted by
+     * decreasing estimated cost and the next subtree to explore. */
+    std::vector<size_t> m_subtrees;
+    std::atomic<size_t> m_next_subtree;
 
     prediction_thread_evaluator(context& ctx,
                                 const Model& model,
-                                const Options& options);
+                                const Options& options,
+                                line_order order = line_order::table);
 
     bool is_valid() const noexcept;
 
@@ -66,41 +112,27 @@ struct prediction_thread_evaluator
                int reduce_mode,
                unsigned int threads,
                const std::string& output_directory);
-};
-
-class Results
-{
-    model_writer m_writer;
-    context& m_context;
-    const Model& m_model;
-    std::mutex m_container_mutex;
-
-    struct Result
-    {
-        double kappa;
-        unsigned long loop;
-        std::vector<std::tuple<int, int, int>> updaters;
-    };
-
-    std::vector<Result> m_results;
-    std::vector<int> m_level;
-    const unsigned int m_threads;
-    std::chrono::time_point<std::chrono::system_clock> m_start, m_end;
 
-public:
-    Results(context& ctx, const Model& mdl, unsigned int threads);
+    /** The first worker runs on the calling thread and is the only one to
+     * call @e interrupt, which may throw to stop the computation. */
+    status run(check_user_interrupt_callback interrupt,
+               void* user_data_interrupt,
+               result_callback callback,
+               void* user_data_callback,
+               int line_limit,
+               double time_limit,
+               int reduce_mode,
+               unsigned int threads,
+               const std::string& output_directory);
 
-    status init(const std::string& output_directory);
+private:
+    void schedule(size_t step);
 
-    void emplace_result(int i,
-                        double kappa,
-                        unsigned long loop,
-                        const std::vector<std::tuple<int, int, int>>& updaters);
+    void search(prediction_worker& worker,
+                size_t step,
+                cancellation_check& stop);
 
-    void push(int step,
-              double kappa,
-              unsigned long loop,
-              const std::vector<std::tuple<int, int, int>>& updaters);
+    long int merge();
 };
 
 } // namespace efyj
@@ -28,16 +28,39 @@ namespace efyj {
 
 prediction_evaluator::prediction_evaluator(context& ctx,
                                            const Model& model,
-                                           const Options& options)
+                                           const Options& options,
+                                           line_order order)
   : m_context(ctx)
   , m_model(model)
   , m_options(options)
   , m_globalsimulated(options.observed.size(), 0)
   , simulated(options.options.rows())
-  , observed(options.options.rows())
   , solver(ctx, model)
   , kappa_c(model.attributes[0].scale.size())
-{}
+  , m_order(order)
+  , m_confusion(model.attributes[0].scale.size(),
+                model.attributes[0].scale.size())
+  , m_fold_confusion(model.attributes[0].scale.size(),
+                     model.attributes[0].scale.size())
+{
+    for (int opt = 0, e = static_cast<int>(options.size()); opt != e; ++opt) {
+        const auto fold = static_cast<size_t>(options.identifier(opt));
+
+        if (fold >= m_fold_first.size()) {
+            m_fold_first.resize(fold + 1, -1);
+            m_fold_options.resize(fold + 1);
+        }
+
+        if (m_fold_first[fold] < 0)
+            m_fold_first[fold] = opt;
+
+        m_fold_options[fold].emplace_back(opt);
+    }
+
+    m_fold_kappa.resize(m_fold_first.size(), 0.0);
+    m_fold_modifiers.resize(m_fold_first.size());
+    m_fold_updaters.resize(m_fold_first.size());
+}
 
 bool
 prediction_evaluator::is_valid() const noexcept
@@ -45,173 +68,125 @@ prediction_evaluator::is_valid() const noexcept
     return m_options.have_subdataset();
 }
 
-status
-prediction_evaluator::run(result_callback callback,
-                          void* user_data_callback,
-                          int line_limit,
-                          double /*time_limit*/,
-                          int reduce_mode,
-                          const std::string& output_directory)
+/** A walker of the step @e k + 1 can keep the default value of its line, so
+ * the candidates of the step @e k + 1 include those of the step @e k and the
+ * best kappa of a fold at step @e k is a lower bound for the step @e k + 1.
+ * The first candidate of a fold is accepted if it reaches this bound, the
+ * next ones if they are strictly better: the kept candidate is the first
+ * one reaching the best kappa of the step, as in a search starting from
+ * zero, without copying the intermediate candidates.
+ */
+bool
+prediction_evaluator::improves(size_t fold, double kappa) const noexcept
 {
-    model_writer writer;
-    if (auto ret = writer.init(output_directory); is_bad(ret))
-        return ret;
+    if (m_fold_updaters[fold].empty())
+        return kappa > 0.0 && kappa >= m_fold_kappa[fold];
 
-    info(m_context, "[Output directory]\n{}\n", writer.directory.string());
-
-    result ret;
-
-    info(m_context, "[Computation starts]\n");
-
-    if (reduce_mode)
-        solver.reduce(m_options);
-
-    solver.get_functions(m_globalfunctions);
-    assert(!m_globalfunctions.empty() &&
-           "prediction can not determine function");
+    return kappa > m_fold_kappa[fold];
+}
 
-    const size_t max_step =
-      max_value(line_limit, solver.get_attribute_line_tuple_limit());
+long int
+prediction_evaluator::search(size_t step, cancellation_check& stop)
+{
     const size_t max_opt = m_options.simulations.size();
-
-    assert(max_step > 0 && "prediction: can not determine limit");
-
-    info(m_context, "[Computation starts 1/{}]\n", max_step);
-
-    {
-        m_start = std::chrono::system_clock::now();
-        for (size_t opt = 0; opt != m_options.size(); ++opt)
-            m_globalsimulated[opt] = solver.solve(m_options.options.row(opt));
-
-        auto kappa = kappa_c.squared(m_options.observed, m_globalsimulated);
-
-        m_end = std::chrono::system_clock::now();
-
-        info(m_context,
-             "| line updated | kappa | kappa computed "
-             "| time (s) | tuple (attribute, line, value) updated |\n");
-
-        info(m_context,
-             "| {} | {:13.10f} | {} | {} | [] |\n",
-             0,
-             kappa,
-             1,
-             std::chrono::duration<double>(m_end - m_start).count());
-
-        ret.kappa = kappa;
-        ret.time = std::chrono::duration<double>(m_end - m_start).count();
-        ret.kappa_computed = 1;
-
-        if (!is_numeric_castable<unsigned long>(m_options.size()))
-            return status::option_too_many;
-
-        ret.function_computed = static_cast<unsigned long>(m_options.size());
-
-        writer.store(m_context, m_model, ret);
-
-        if (!callback(ret, user_data_callback))
-            return status::success;
-    }
-
-    for (size_t step = 1; step <= max_step; ++step) {
-        m_start = std::chrono::system_clock::now();
-        long int loop = 0;
-
-        std::fill(m_globalsimulated.begin(), m_globalsimulated.end(), 0);
-
-        // This cache stores best function found for the same
-        // subdataset. This cache drastically improves computation time if
-        // their is few subdataset.
-        std::map<size_t, std::vector<std::vector<scale_id>>> cache;
-
-        for (int opt = 0, e = static_cast<int>(max_opt); opt != e; ++opt) {
-
-            {
-                auto it = cache.find(m_options.identifier(opt));
-                if (it != cache.end()) {
-                    solver.set_functions(it->second);
-                    m_globalsimulated[opt] =
-                      solver.solve(m_options.options.row(opt));
-                    continue;
-                }
+    const size_t max_fold = m_fold_first.size();
+    long int loop = 0;
+
+    for (auto& elem : m_fold_updaters)
+        elem.clear();
+
+    solver.restore();
+    solver.init_walkers(step);
+    m_kappa_cache.clear();
+
+    do {
+        unsigned long long int values = 0;
+        solver.init_next_value();
+
+        do {
+            ++values;
+            auto signature = kappa_cache::seed;
+            for (size_t opt = 0; opt != max_opt; ++opt) {
+                simulated[opt] = solver.solve(m_options.options.row(opt));
+                signature = kappa_cache::combine(signature, simulated[opt]);
             }
 
-            solver.set_functions(m_globalfunctions);
-            solver.init_walkers(step);
-            double kappa = 0;
-
-            do {
-                solver.init_next_value();
-
-                do {
-                    const auto size = m_options.get_subdataset(opt).size();
-                    simulated.resize(size, 0);
-                    observed.resize(size, 0);
-                    assert(size > 0);
-
-                    for (size_t i = 0; i != size; ++i) {
-                        auto id = m_options.get_subdataset(opt)[i];
-                        observed[i] = m_options.observed[id];
-                        simulated[i] = solver.solve(m_options.options.row(id));
-                    }
-
-                    auto localkappa = kappa_c.squared(observed, simulated);
+            // An already seen simulated vector gives the same kappa for
+            // each fold and can not be strictly better.
+            double seen;
+            if (!m_kappa_cache.find(signature, seen)) {
+                m_kappa_cache.insert(signature, 0.0);
+
+                std::fill(m_confusion.begin(), m_confusion.end(), 0);
+                for (size_t opt = 0; opt != max_opt; ++opt)
+                    ++m_confusion(m_options.observed[opt], simulated[opt]);
+
+                for (size_t fold = 0; fold != max_fold; ++fold) {
+                    m_fold_confusion = m_confusion;
+                    m_options.for_each_excluded(
+                      m_fold_first[fold], [this](int id) {
+                          --m_fold_confusion(m_options.observed[id],
+                                             simulated[id]);
+                      });
+
+                    auto localkappa = kappa_c.squared(m_fold_confusion);
                     loop++;
 
-                    if (localkappa > kappa) {
-                        solver.get_functions(m_functions);
-                        m_updaters = solver.updaters();
-                        kappa = localkappa;
+                    if (improves(fold, localkappa)) {
+                        solver.get_modifiers(m_fold_modifiers[fold]);
+                        solver.updaters(m_fold_updaters[fold]);
+                        m_fold_kappa[fold] = localkappa;
                     }
+                }
+            }
 
-                } while (solver.next_value() == true);
-            } while (solver.next_line() == true);
-
-            solver.set_functions(m_functions);
-            m_globalsimulated[opt] = solver.solve(m_options.options.row(opt));
+            if (stop())
+                return loop;
+        } while (solver.next_value() == true);
 
-            cache[m_options.identifier(opt)] = m_functions;
-        }
+        if (m_progress)
+            m_progress->advance(values);
+    } while (solver.next_line() == true);
 
-        auto line_kappa =
-          kappa_c.squared(m_options.observed, m_globalsimulated);
-        m_end = std::chrono::system_clock::now();
-
-        auto time = std::chrono::duration<double>(m_end - m_start).count();
-        loop++;
-
-        ret.kappa = line_kappa;
-        ret.time = time;
-        ret.kappa_computed = static_cast<unsigned long int>(loop);
-        ret.function_computed = static_cast<unsigned long int>(0);
-        ret.modifiers.clear();
-
-        info(m_context,
-             "| {} | {:13.10f} | {} | {} | ",
-             step,
-             ret.kappa,
-             loop,
-             time);
+    return loop;
+}
 
-        for (const auto& elem : m_updaters) {
-            ret.modifiers.emplace_back(
-              std::get<0>(elem), std::get<1>(elem), std::get<2>(elem));
-            info(m_context,
-                 "[{},{},{}] ",
-                 std::get<0>(elem),
-                 std::get<1>(elem),
-                 std::get<2>(elem));
+/** Fills @e m_globalsimulated with the best function of each fold. Like the
+ * previous fold by fold search, a fold without better candidate reuses the
+ * function of the previous fold and the reported updaters are those of the
+ * last fold with a better candidate.
+ */
+void
+prediction_evaluator::simulate_folds()
+{
+    for (size_t fold = 0, e = m_fold_first.size(); fold != e; ++fold) {
+        if (!m_fold_updaters[fold].empty()) {
+            m_modifiers.swap(m_fold_modifiers[fold]);
+            m_updaters = m_fold_updaters[fold];
         }
 
-        info(m_context, "\n");
-
-        writer.store(m_context, m_model, ret);
-
-        if (!callback(ret, user_data_callback))
-            break;
+        solver.set_modifiers(m_modifiers);
+        for (auto opt : m_fold_options[fold])
+            m_globalsimulated[opt] = solver.solve(m_options.options.row(opt));
     }
+}
 
-    return status::success;
+status
+prediction_evaluator::run(result_callback callback,
+                          void* user_data_callback,
+                          int line_limit,
+                          double time_limit,
+                          int reduce_mode,
+                          const std::string& output_directory)
+{
+    return run(nullptr,
+               nullptr,
+               callback,
+               user_data_callback,
+               line_limit,
+               time_limit,
+               reduce_mode,
+               output_directory);
 }
 
 status
@@ -220,12 +195,12 @@ prediction_evaluator::run(check_user_interrupt_callback interrupt,
                           result_callback callback,
                           void* user_data_callback,
                           int line_limit,
-                          double /*time_limit*/,
+                          double time_limit,
                           int reduce_mode,
                           const std::string& output_directory)
 {
     model_writer writer;
-    if (auto ret = writer.init(output_directory); is_bad(ret))
+    if (auto ret = writer.init(m_context, output_directory); is_bad(ret))
         return ret;
 
     info(m_context, "[Output directory]\n{}\n", writer.directory.string());
@@ -237,16 +212,20 @@ prediction_evaluator::run(check_user_interrupt_callback interrupt,
     if (reduce_mode)
         solver.reduce(m_options);
 
+    solver.sort_lines(m_options, m_order);
+
     solver.get_functions(m_globalfunctions);
     assert(!m_globalfunctions.empty() &&
            "prediction can not determine function");
 
     const size_t max_step =
       max_value(line_limit, solver.get_attribute_line_tuple_limit());
-    const size_t max_opt = m_options.simulations.size();
 
     assert(max_step > 0 && "prediction: can not determine limit");
 
+    if (m_progress)
+        m_progress->start(max_step, solver.candidate_number(max_step));
+
     info(m_context, "[Computation starts 1/{}]\n", max_step);
 
     {
@@ -280,83 +259,34 @@ prediction_evaluator::run(check_user_interrupt_callback interrupt,
 
         writer.store(m_context, m_model, ret);
 
+        if (m_progress)
+            m_progress->end_step(kappa);
+
         if (!callback(ret, user_data_callback))
             return status::success;
     }
 
-    interrupt(user_data_interrupt);
-    std::chrono::time_point<std::chrono::system_clock> int_start, int_now;
+    if (interrupt)
+        interrupt(user_data_interrupt);
+
+    cancellation_check stop(m_progress ? &m_progress->cancelled : nullptr,
+                            make_deadline(time_limit),
+                            interrupt,
+                            user_data_interrupt);
 
     for (size_t step = 1; step <= max_step; ++step) {
         m_start = std::chrono::system_clock::now();
-        int_start = m_start;
-
-        long int loop = 0;
 
-        std::fill(m_globalsimulated.begin(), m_globalsimulated.end(), 0);
+        if (m_progress)
+            m_progress->begin_step(step);
 
-        // This cache stores best function found for the same
-        // subdataset. This cache drastically improves computation time if
-        // their is few subdataset.
-        std::map<size_t, std::vector<std::vector<scale_id>>> cache;
+        long int loop = search(step, stop);
 
-        for (int opt = 0, e = static_cast<int>(max_opt); opt != e; ++opt) {
-
-            {
-                auto it = cache.find(m_options.identifier(opt));
-                if (it != cache.end()) {
-                    solver.set_functions(it->second);
-                    m_globalsimulated[opt] =
-                      solver.solve(m_options.options.row(opt));
-                    continue;
-                }
-            }
-
-            solver.set_functions(m_globalfunctions);
-            solver.init_walkers(step);
-            double kappa = 0;
-
-            do {
-                solver.init_next_value();
-
-                do {
-                    const auto size = m_options.get_subdataset(opt).size();
-                    simulated.resize(size, 0);
-                    observed.resize(size, 0);
-                    assert(size > 0);
-
-                    for (size_t i = 0; i != size; ++i) {
-                        auto id = m_options.get_subdataset(opt)[i];
-                        observed[i] = m_options.observed[id];
-                        simulated[i] = solver.solve(m_options.options.row(id));
-                    }
-
-                    auto localkappa = kappa_c.squared(observed, simulated);
-                    loop++;
-
-                    if (localkappa > kappa) {
-                        solver.get_functions(m_functions);
-                        m_updaters = solver.updaters();
-                        kappa = localkappa;
-                    }
-
-                    int_now = std::chrono::system_clock::now();
-                    auto time =
-                      std::chrono::duration<double>(int_now - int_start)
-                        .count();
-                    if (time > 4.) {
-                        interrupt(user_data_interrupt);
-                        int_now = int_start = std::chrono::system_clock::now();
-                    }
-
-                } while (solver.next_value() == true);
-            } while (solver.next_line() == true);
+        /* A cancelled step is incomplete and is not reported. */
+        if (stop.stopped())
+            break;
 
-            solver.set_functions(m_functions);
-            m_globalsimulated[opt] = solver.solve(m_options.options.row(opt));
-
-            cache[m_options.identifier(opt)] = m_functions;
-        }
+        simulate_folds();
 
         auto line_kappa =
           kappa_c.squared(m_options.observed, m_globalsimulated);
@@ -392,6 +322,9 @@ prediction_evaluator::run(check_user_interrupt_callback interrupt,
 
         writer.store(m_context, m_model, ret);
 
+        if (m_progress)
+            m_progress->end_step(ret.kappa);
+
         if (!callback(ret, user_data_callback))
             break;
     }
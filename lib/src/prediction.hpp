@@ -25,10 +25,12 @@
 #include <chrono>
 #include <map>
 
+#include "cancellation.hpp"
 #include "model.hpp"
 #include "options.hpp"
 #include "post.hpp"
 #include "private.hpp"
+#include "progress.hpp"
 #include "solver-stack.hpp"
 
 namespace efyj {
@@ -42,16 +44,38 @@ struct prediction_evaluator
     std::chrono::time_point<std::chrono::system_clock> m_start, m_end;
     std::vector<int> m_globalsimulated;
     std::vector<std::tuple<int, int, int>> m_updaters;
-    std::vector<std::vector<int>> m_globalfunctions, m_functions;
+    std::vector<std::vector<int>> m_globalfunctions;
+    std::vector<line_modifier> m_modifiers;
     std::vector<int> simulated;
-    std::vector<int> observed;
     for_each_model_solver solver;
     weighted_kappa_calculator kappa_c;
+    kappa_cache m_kappa_cache;
     unsigned long long int m_loop = 0;
+    line_order m_order;
+
+    /* Optional progress published to the job of @e start_prediction. */
+    progress* m_progress = nullptr;
+
+    /* A fold is a distinct learning subdataset. It is represented by the
+     * first option using it and the options excluded from the complete
+     * dataset. The confusion matrix of a fold is the confusion matrix of
+     * the complete dataset minus the excluded options contributions. */
+    std::vector<int> m_fold_first;
+    std::vector<std::vector<int>> m_fold_options;
+    matrix<int> m_confusion, m_fold_confusion;
+
+    /* The best kappa of each fold is kept from one step to the next one,
+     * the best functions are stored as modifiers of @e m_globalfunctions
+     * and the updaters are empty if the step has no candidate for the
+     * fold. */
+    std::vector<double> m_fold_kappa;
+    std::vector<std::vector<line_modifier>> m_fold_modifiers;
+    std::vector<std::vector<std::tuple<int, int, int>>> m_fold_updaters;
 
     prediction_evaluator(context& ctx,
                          const Model& model,
-                         const Options& options);
+                         const Options& options,
+                         line_order order = line_order::table);
 
     bool is_valid() const noexcept;
 
@@ -70,6 +94,13 @@ struct prediction_evaluator
                double time_limit,
                int reduce_mode,
                const std::string& output_directory);
+
+private:
+    bool improves(size_t fold, double kappa) const noexcept;
+
+    long int search(size_t step, cancellation_check& stop);
+
+    void simulate_folds();
 };
 
 } // namespace efyj
@@ -0,0 +1,78 @@
+/* Copyright (C) 2016-2021 INRAE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef ORG_VLEPROJECT_EFYJ_DETAILS_PROGRESS_HPP
+#define ORG_VLEPROJECT_EFYJ_DETAILS_PROGRESS_HPP
+
+#include <atomic>
+
+namespace efyj {
+
+/** Progress of an adjustment or a prediction shared between the evaluator
+ * and the @e job handles reading it from other threads. The evaluator
+ * publishes its counters after each line combination with relaxed atomic
+ * operations and stops as soon as @e cancelled is set: the readers get
+ * recent values, not a consistent snapshot.
+ */
+struct progress
+{
+    std::atomic<unsigned long long int> candidates{ 0 };
+    std::atomic<double> expected{ 0.0 }; ///< candidates of all the steps.
+    std::atomic<double> kappa{ 0.0 };    ///< kappa of the last step done.
+    std::atomic<unsigned int> step{ 0 }; ///< step in progress.
+    std::atomic<unsigned int> steps{ 0 };
+    std::atomic<bool> cancelled{ false };
+
+    void start(size_t max_step, double expected_candidates) noexcept
+    {
+        steps.store(static_cast<unsigned int>(max_step),
+                    std::memory_order_relaxed);
+        expected.store(expected_candidates, std::memory_order_relaxed);
+    }
+
+    void begin_step(size_t current) noexcept
+    {
+        step.store(static_cast<unsigned int>(current),
+                   std::memory_order_relaxed);
+    }
+
+    void end_step(double current_kappa) noexcept
+    {
+        kappa.store(current_kappa, std::memory_order_relaxed);
+    }
+
+    /** Adds the @e number candidates of a line combination and returns
+     * false if the computation must stop. */
+    bool advance(unsigned long long int number) noexcept
+    {
+        candidates.fetch_add(number, std::memory_order_relaxed);
+        return !cancelled.load(std::memory_order_relaxed);
+    }
+
+    bool is_cancelled() const noexcept
+    {
+        return cancelled.load(std::memory_order_relaxed);
+    }
+};
+
+} // namespace efyj
+
+#endif
@@ -21,18 +21,19 @@
 
 #include <efyj/efyj.hpp>
 
+#include "post.hpp"
 #include "solver-stack.hpp"
 
 #include <cassert>
 #include <cmath>
+#include <numeric>
 
 namespace efyj {
 
 aggregate_attribute::aggregate_attribute(const Model& model,
                                          size_t att_,
                                          int id_)
-  : stack_size(0)
-  , att(static_cast<int>(att_))
+  : att(static_cast<int>(att_))
   , id(id_)
 {
     std::transform(
@@ -46,8 +47,6 @@ aggregate_attribute::aggregate_attribute(const Model& model,
                    std::back_inserter(functions),
                    [](const char id) { return id - '0'; });
 
-    saved_functions = functions;
-
     coeffs.resize(m_scale_size.size(), 0);
     coeffs[m_scale_size.size() - 1] = 1;
 
@@ -60,33 +59,9 @@ aggregate_attribute::aggregate_attribute(const Model& model,
             coeffs[i] = static_cast<int>(m_scale_size[i + 1]) * coeffs[i + 1];
     }
 
-    stack.resize(m_scale_size.size(), 0);
-    stack_size = 0;
-
     scale = model.attributes[att].scale_size();
 }
 
-int
-aggregate_attribute::result() const
-{
-#ifndef NDEBUG
-    for (size_t i = 0; i < coeffs.size(); ++i) {
-        assert(stack[i] < (int)m_scale_size[i] && "too big scale size");
-    }
-#endif
-
-    assert(stack_size < 0 &&
-           "not enough attribute in function's stack to get a result");
-
-    auto id = 0;
-    for (size_t i = 0, e = coeffs.size(); i != e; ++i)
-        id += coeffs[i] * stack[i];
-
-    return functions[id];
-
-    // return functions[coeffs.dot(stack)];
-}
-
 /** The @e reduce function returns the list of authorized lines in the
  * utility function of the aggregate attribute.
  *
@@ -105,7 +80,7 @@ aggregate_attribute::result() const
  * opt1 opt2  1 opt3  2
  */
 void
-aggregate_attribute::reduce(std::set<int>& whitelist)
+aggregate_attribute::reduce(Vector& stack, std::set<int>& whitelist) const
 {
 #ifndef NDEBUG
     for (size_t i = 0; i < coeffs.size(); ++i) {
@@ -174,7 +149,7 @@ aggregate_attribute::reduce(std::set<int>& whitelist)
     } while (!end);
 }
 
-solver_stack::solver_stack(const Model& model)
+solver_structure::solver_structure(const Model& model)
 {
     atts.reserve(model.attributes.size());
 
@@ -183,14 +158,9 @@ solver_stack::solver_stack(const Model& model)
 }
 
 void
-solver_stack::reinit()
-{
-    for (auto& att : atts)
-        att.function_restore();
-}
-
-void
-solver_stack::recursive_fill(const Model& model, size_t att, int& value_id)
+solver_structure::recursive_fill(const Model& model,
+                                 size_t att,
+                                 int& value_id)
 {
     if (model.attributes[att].is_basic()) {
         function.emplace_back(value_id++);
@@ -203,30 +173,40 @@ solver_stack::recursive_fill(const Model& model, size_t att, int& value_id)
     }
 }
 
-void
-solver_stack::set_functions(const std::vector<std::vector<scale_id>>& functions)
+solver_stack::solver_stack(const Model& model)
+  : solver_stack(std::make_shared<const solver_structure>(model))
+{}
+
+solver_stack::solver_stack(std::shared_ptr<const solver_structure> structure_)
+  : structure(std::move(structure_))
+  , override_count(structure->atts.size(), 0)
 {
-    assert(functions.size() == atts.size() && "incoherent: internal error");
+    result.reserve(structure->function.size());
+}
 
-    for (size_t i = 0, e = atts.size(); i != e; ++i) {
-        assert(atts[i].functions.size() == functions[i].size() &&
-               "incoherent: internal error");
+void
+solver_stack::reinit() noexcept
+{
+    for (const auto& elem : overrides)
+        --override_count[elem.attribute];
 
-        atts[i].functions = functions[i];
-        atts[i].saved_functions = functions[i];
-    }
+    overrides.clear();
 }
 
 void
-solver_stack::get_functions(std::vector<std::vector<scale_id>>& functions)
+solver_stack::get_functions(
+  std::vector<std::vector<scale_id>>& functions) const
 {
-    functions.resize(atts.size());
+    functions.resize(structure->atts.size());
 
     std::transform(
-      atts.cbegin(),
-      atts.cend(),
+      structure->atts.cbegin(),
+      structure->atts.cend(),
       functions.begin(),
       [](const aggregate_attribute& att) { return att.functions; });
+
+    for (const auto& elem : overrides)
+        functions[elem.attribute][elem.line] = elem.value;
 }
 
 std::string
@@ -234,9 +214,9 @@ solver_stack::string_functions() const
 {
     std::string ret;
 
-    for (const auto& att : atts)
-        for (auto id : att.functions)
-            ret += static_cast<char>(id + '0');
+    for (int i = 0, e = attribute_size(); i != e; ++i)
+        for (int j = 0, endj = function_size(i); j != endj; ++j)
+            ret += static_cast<char>(value(i, j) + '0');
 
     return ret;
 }
@@ -246,14 +226,34 @@ for_each_model_solver::full()
 {
     info(m_context, "[Full problem size]\n");
 
-    m_whitelist.clear();
-    m_whitelist.resize(m_solver.attribute_size());
+    auto space = std::make_shared<line_space>();
+    space->whitelist.resize(m_solver.attribute_size());
 
-    for (std::size_t i = { 0 }, e = m_whitelist.size(); i != e; ++i)
+    for (std::size_t i = { 0 }, e = space->whitelist.size(); i != e; ++i)
         for (int j = { 0 }, endj = m_solver.function_size(static_cast<int>(i));
              j != endj;
              ++j)
-            m_whitelist[i].emplace_back(j);
+            space->whitelist[i].emplace_back(j);
+
+    space->init_lines();
+    m_space = std::move(space);
+}
+
+void
+line_space::init_lines()
+{
+    lines.clear();
+
+    for (size_t i = 0, e = whitelist.size(); i != e; ++i)
+        for (size_t j = 0, endj = whitelist[i].size(); j != endj; ++j)
+            lines.emplace_back(static_cast<int>(i), static_cast<int>(j));
+}
+
+void
+for_each_model_solver::update_walkers(size_t from) noexcept
+{
+    for (size_t i = from, e = m_positions.size(); i != e; ++i)
+        m_updaters[i] = m_space->lines[m_positions[i]];
 }
 
 void
@@ -262,23 +262,23 @@ for_each_model_solver::detect_missing_scale_value()
     info(m_context, "[Number of models available]\n");
 
     long double model_number{ 1 };
-    for (size_t i = 0, e = m_whitelist.size(); i != e; ++i) {
+    for (size_t i = 0, e = m_space->whitelist.size(); i != e; ++i) {
         info(m_context,
              "{} ^ {}\n",
              m_solver.scale_size(static_cast<int>(i)),
-             m_whitelist[i].size());
+             m_space->whitelist[i].size());
         if (i + 1 != e)
             info(m_context, " * ");
 
         model_number *= std::pow(m_solver.scale_size(static_cast<int>(i)),
-                                 m_whitelist[i].size());
+                                 m_space->whitelist[i].size());
     }
 
     info(m_context, " = {}\n", model_number);
 
     info(m_context, "[Detect unused scale value]\n");
 
-    for (std::size_t i{ 0 }, e = m_whitelist.size(); i != e; ++i) {
+    for (std::size_t i{ 0 }, e = m_space->whitelist.size(); i != e; ++i) {
         int sv = m_solver.scale_size(static_cast<int>(i));
 
         info(m_context,
@@ -288,8 +288,8 @@ for_each_model_solver::detect_missing_scale_value()
              i,
              sv);
 
-        for (size_t x = 0, endx = m_whitelist[i].size(); x != endx; ++x)
-            info(m_context, "{} ", m_whitelist[i][x]);
+        for (size_t x = 0, endx = m_space->whitelist[i].size(); x != endx; ++x)
+            info(m_context, "{} ", m_space->whitelist[i][x]);
 
         info(m_context, "\n- function.......... : ");
         for (size_t x = 0, endx = m_solver.function_size(static_cast<int>(i));
@@ -303,8 +303,8 @@ for_each_model_solver::detect_missing_scale_value()
         for (int j = 0, endj = sv; j != endj; ++j) {
             size_t x, endx;
 
-            for (x = 0, endx = m_whitelist[i].size(); x != endx; ++x) {
-                if (m_solver.value(static_cast<int>(i), m_whitelist[i][x]) == j)
+            for (x = 0, endx = m_space->whitelist[i].size(); x != endx; ++x) {
+                if (m_solver.value(static_cast<int>(i), m_space->whitelist[i][x]) == j)
                     break;
             }
 
@@ -326,11 +326,11 @@ for_each_model_solver::for_each_model_solver(context& ctx, const Model& model)
 
     info(ctx, "[internal attribute id -> real attribute]\n");
 
-    for (size_t i = 0, e = m_solver.atts.size(); i != e; ++i)
+    for (size_t i = 0, e = m_solver.structure->atts.size(); i != e; ++i)
         info(ctx,
              "  {} {}\n",
              i,
-             model.attributes[m_solver.atts[i].att].name.c_str());
+             model.attributes[m_solver.structure->atts[i].att].name.c_str());
 }
 
 for_each_model_solver::for_each_model_solver(context& ctx,
@@ -344,11 +344,11 @@ for_each_model_solver::for_each_model_solver(context& ctx,
 
     detect_missing_scale_value();
 
-    for (size_t i = 0, e = m_solver.atts.size(); i != e; ++i)
+    for (size_t i = 0, e = m_solver.structure->atts.size(); i != e; ++i)
         info(ctx,
              "  {} {}\n",
              i,
-             model.attributes[m_solver.atts[i].att].name.c_str());
+             model.attributes[m_solver.structure->atts[i].att].name.c_str());
 }
 
 /** @e reduce is used to reduce the size of the problem. It removes
@@ -359,8 +359,8 @@ for_each_model_solver::reduce(const Options& options)
 {
     info(m_context, "[Reducing problem size]");
 
-    m_whitelist.clear();
-    m_whitelist.resize(m_solver.attribute_size());
+    auto space = std::make_shared<line_space>();
+    space->whitelist.resize(m_solver.attribute_size());
 
     std::vector<std::set<int>> whitelist;
     whitelist.resize(m_solver.attribute_size());
@@ -378,21 +378,104 @@ for_each_model_solver::reduce(const Options& options)
 
     /* convert the set into vector of vector. */
     for (size_t i = 0, e = whitelist.size(); i != e; ++i) {
-        m_whitelist[i].resize(whitelist[i].size());
+        space->whitelist[i].resize(whitelist[i].size());
 
-        std::copy(
-          whitelist[i].begin(), whitelist[i].end(), m_whitelist[i].begin());
+        std::copy(whitelist[i].begin(),
+                  whitelist[i].end(),
+                  space->whitelist[i].begin());
     }
+
+    space->init_lines();
+    m_space = std::move(space);
 }
 
 void
-for_each_model_solver::init_next_value()
+for_each_model_solver::sort_lines(const Options& options, line_order order)
+{
+    if (order == line_order::table)
+        return;
+
+    std::vector<double> weights(m_space->lines.size(), 0.0);
+
+    if (order == line_order::row_hits) {
+        info(m_context, "[Sort lines by row hits]\n");
+
+        std::vector<std::vector<int>> hits(m_solver.attribute_size());
+        for (int i = 0, e = m_solver.attribute_size(); i != e; ++i)
+            hits[i].resize(m_solver.function_size(i), 0);
+
+        for (size_t i = 0, e = options.options.rows(); i != e; ++i)
+            m_solver.hits(options.options.row(i), hits);
+
+        for (size_t i = 0, e = m_space->lines.size(); i != e; ++i) {
+            const int attribute = m_space->lines[i].attribute;
+            const int line = m_space->whitelist[attribute][m_space->lines[i].line];
+
+            weights[i] = hits[attribute][line];
+        }
+    } else {
+        info(m_context, "[Sort lines by single line kappa]\n");
+
+        weighted_kappa_calculator kappa_c(m_solver.structure->atts.back().scale_size());
+        std::vector<int> simulated(options.options.rows());
+
+        m_solver.reinit();
+
+        for (size_t i = 0, e = m_space->lines.size(); i != e; ++i) {
+            const int attribute = m_space->lines[i].attribute;
+            const int line = m_space->whitelist[attribute][m_space->lines[i].line];
+            double best = -1.0;
+
+            for (int v = 0, endv = m_solver.scale_size(attribute); v != endv;
+                 ++v) {
+                if (v == m_solver.default_value(attribute, line))
+                    continue;
+
+                m_solver.value_set(attribute, line, v);
+
+                for (size_t opt = 0, endopt = simulated.size(); opt != endopt;
+                     ++opt)
+                    simulated[opt] = m_solver.solve(options.options.row(opt));
+
+                best = std::max(best,
+                                kappa_c.squared(options.observed, simulated));
+            }
+
+            m_solver.value_restore(attribute, line);
+            weights[i] = best;
+        }
+    }
+
+    std::vector<size_t> index(m_space->lines.size());
+    std::iota(index.begin(), index.end(), 0);
+    std::stable_sort(
+      index.begin(), index.end(), [&weights](size_t lhs, size_t rhs) {
+          return weights[lhs] > weights[rhs];
+      });
+
+    auto space = std::make_shared<line_space>();
+    space->whitelist = m_space->whitelist;
+    space->lines.resize(m_space->lines.size());
+    for (size_t i = 0, e = index.size(); i != e; ++i)
+        space->lines[i] = m_space->lines[index[i]];
+
+    m_space = std::move(space);
+}
+
+void
+for_each_model_solver::restore() noexcept
 {
     m_solver.reinit();
+}
+
+void
+for_each_model_solver::init_next_value()
+{
+    restore();
 
     for (size_t i = 0, e = m_updaters.size(); i != e; ++i) {
         const int attribute = m_updaters[i].attribute;
-        const int line = m_whitelist[attribute][m_updaters[i].line];
+        const int line = m_space->whitelist[attribute][m_updaters[i].line];
 
         m_solver.value_clear(attribute, line);
     }
@@ -407,7 +490,7 @@ for_each_model_solver::next_value()
 
     for (;;) {
         int attribute = m_updaters[i].attribute;
-        int line = m_whitelist[attribute][m_updaters[i].line];
+        int line = m_space->whitelist[attribute][m_updaters[i].line];
 
         if (m_solver.value(attribute, line) + 1 <
             m_solver.scale_size(attribute)) {
@@ -429,121 +512,116 @@ for_each_model_solver::init_walkers(size_t walker_numbers)
 {
     assert(walker_numbers > 0);
 
+    if (walker_numbers > m_space->lines.size())
+        return false;
+
     m_updaters.resize(walker_numbers);
+    m_positions.resize(walker_numbers);
 
-    size_t i = 0;
-    int attribute = m_updaters[i].attribute = 0;
-    int line = m_updaters[i].line = 0;
+    std::iota(m_positions.begin(), m_positions.end(), 0);
+    update_walkers(0);
 
-    for (auto j = i + 1; j < m_updaters.size(); ++j) {
-        m_updaters[j].attribute = attribute;
-        m_updaters[j].line = ++line;
+    return true;
+}
 
-        if (static_cast<size_t>(m_updaters[j].line) >=
-            m_whitelist[m_updaters[j].attribute].size()) {
-            line = 0;
-            ++attribute;
+bool
+for_each_model_solver::init_walkers(size_t walker_numbers, size_t first)
+{
+    assert(walker_numbers > 0);
 
-            m_updaters[j].attribute = attribute;
-            m_updaters[j].line = line;
+    if (first + walker_numbers > m_space->lines.size())
+        return false;
 
-            if (attribute >= m_solver.attribute_size())
-                return false;
-        }
-    }
+    m_updaters.resize(walker_numbers);
+    m_positions.resize(walker_numbers);
+
+    std::iota(m_positions.begin(), m_positions.end(), first);
+    update_walkers(0);
 
     return true;
 }
 
+/** @e next_line moves the walkers to the next combination of
+ * @e m_updaters.size() (attribute, line) tuples in the lexicographic order
+ * of their positions in @e line_space::lines.
+ */
 bool
-for_each_model_solver::next_line()
+for_each_model_solver::next_line(size_t from)
 {
-    assert(!m_updaters.empty() && m_updaters.size() < INT_MAX);
+    assert(!m_positions.empty() && m_positions.size() < INT_MAX);
 
-    for (;;) {
-        size_t i = m_updaters.size() - 1;
-
-        for (;;) {
-            if (static_cast<size_t>(m_updaters[i].line + 1) <
-                m_whitelist[m_updaters[i].attribute].size()) {
-                ++m_updaters[i].line;
-
-                int attribute = m_updaters[i].attribute;
-                int line = m_updaters[i].line;
-                for (auto j = i + 1; j < m_updaters.size(); ++j) {
-                    m_updaters[j].attribute = attribute;
-                    m_updaters[j].line = ++line;
-
-                    if (static_cast<size_t>(m_updaters[j].line) >=
-                        m_whitelist[m_updaters[j].attribute].size()) {
-                        line = 0;
-                        ++attribute;
-
-                        m_updaters[j].attribute = attribute;
-                        m_updaters[j].line = line;
-
-                        if (attribute >= m_solver.attribute_size())
-                            return false;
-                    }
-                }
+    const size_t k = m_positions.size();
+    const size_t n = m_space->lines.size();
+    size_t i = k;
 
-                return true;
-            } else {
-                if (m_updaters[i].attribute + 1 < m_solver.attribute_size()) {
-                    ++m_updaters[i].attribute;
-                    m_updaters[i].line = 0;
-
-                    int attribute = m_updaters[i].attribute;
-                    int line = m_updaters[i].line;
-                    for (auto j = i + 1; j < m_updaters.size(); ++j) {
-                        m_updaters[j].attribute = attribute;
-                        m_updaters[j].line = ++line;
-
-                        if (static_cast<size_t>(m_updaters[j].line) >=
-                            m_whitelist[m_updaters[j].attribute].size()) {
-                            line = 0;
-                            ++attribute;
-
-                            m_updaters[j].attribute = attribute;
-                            m_updaters[j].line = line;
-
-                            if (attribute >= m_solver.attribute_size())
-                                return false;
-                        }
-                    }
-
-                    return true;
-                } else {
-                    if (i == 0)
-                        return false;
+    while (i > from) {
+        --i;
 
-                    --i;
-                }
-            }
+        if (m_positions[i] + (k - i) < n) {
+            ++m_positions[i];
+
+            for (size_t j = i + 1; j != k; ++j)
+                m_positions[j] = m_positions[j - 1] + 1;
+
+            update_walkers(i);
+            return true;
         }
     }
+
+    return false;
+}
+
+void
+for_each_model_solver::get_modifiers(
+  std::vector<line_modifier>& modifiers) const
+{
+    modifiers.resize(m_updaters.size());
+
+    for (size_t i = 0, e = m_updaters.size(); i != e; ++i) {
+        const int attribute = m_updaters[i].attribute;
+        const int line = m_space->whitelist[attribute][m_updaters[i].line];
+
+        modifiers[i] = { attribute, line, m_solver.value(attribute, line) };
+    }
+}
+
+void
+for_each_model_solver::set_modifiers(
+  const std::vector<line_modifier>& modifiers)
+{
+    restore();
+
+    for (const auto& elem : modifiers)
+        m_solver.value_set(elem.attribute, elem.line, elem.value);
 }
 
 std::vector<std::tuple<int, int, int>>
 for_each_model_solver::updaters() const
+{
+    std::vector<std::tuple<int, int, int>> ret;
+    updaters(ret);
+
+    return ret;
+}
+
+void
+for_each_model_solver::updaters(
+  std::vector<std::tuple<int, int, int>>& updaters) const
 {
     /* if mode with reduce, we recompute attributes/lines otherwise,
      * we can return m_updaters directly.
      */
 
-    std::vector<std::tuple<int, int, int>> ret;
-    ret.reserve(m_updaters.size());
+    updaters.resize(m_updaters.size());
 
     for (size_t i = 0, e = m_updaters.size(); i != e; ++i) {
         const int attribute = m_updaters[i].attribute;
-        const int line = m_whitelist[attribute][m_updaters[i].line];
-        // ret.emplace_back(attribute, line, m_solver.value(attribute, line));
-        ret.emplace_back(m_solver.atts[m_updaters[i].attribute].att,
-                         line,
-                         m_solver.value(attribute, line));
-    }
+        const int line = m_space->whitelist[attribute][m_updaters[i].line];
 
-    return ret;
+        updaters[i] = { m_solver.structure->atts[attribute].att,
+                        line,
+                        m_solver.value(attribute, line) };
+    }
 }
 
 size_t
@@ -551,12 +629,32 @@ for_each_model_solver::get_attribute_line_tuple_limit() const
 {
     size_t ret = 0;
 
-    for (const auto& att : m_whitelist)
+    for (const auto& att : m_space->whitelist)
         ret += att.size();
 
     return ret;
 }
 
+double
+for_each_model_solver::candidate_number(size_t max_step) const
+{
+    const size_t n = line_number();
+    max_step = std::min(max_step, n);
+
+    // elementary symmetric polynomials of the scale sizes: step[k] is the
+    // number of candidates with k walkers on the first lines.
+    std::vector<double> step(max_step + 1, 0.0);
+    step[0] = 1.0;
+
+    for (size_t i = 0; i != n; ++i) {
+        const double size = line_scale_size(i);
+        for (size_t k = std::min(i + 1, max_step); k > 0; --k)
+            step[k] += step[k - 1] * size;
+    }
+
+    return std::accumulate(step.begin() + 1, step.end(), 0.0);
+}
+
 void
 print(context& ctx,
       const std::vector<std::tuple<int, int, int>>& updaters) noexcept
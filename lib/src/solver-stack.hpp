@@ -22,7 +22,10 @@
 #ifndef INRA_EFYj_SOLVER_STACK_HPP
 #define INRA_EFYj_SOLVER_STACK_HPP
 
+#include <cstdint>
+#include <memory>
 #include <set>
+#include <utility>
 
 #include "model.hpp"
 #include "options.hpp"
@@ -48,19 +51,25 @@ struct aggregate_attribute
         return coeffs.size();
     }
 
-    inline void push(int i)
+    /** The @e pop_line function removes the @e option_size() last values of
+     * @e stack, the scale values of the children, and returns the line of
+     * the utility function they select. */
+    inline int pop_line(Vector& stack) const noexcept
     {
-        assert(stack_size >= 0 && "too many attribute in function's stack");
+        assert(stack.size() >= coeffs.size() &&
+               "not enough attribute in function's stack to get a result");
 
-        stack[stack_size--] = i;
-    }
+        auto id = 0;
+        for (size_t i = coeffs.size(); i != 0; --i) {
+            assert(stack.back() < static_cast<int>(m_scale_size[i - 1]) &&
+                   "too big scale size");
 
-    inline void clear()
-    {
-        stack_size = static_cast<int>(coeffs.size()) - 1;
-    }
+            id += coeffs[i - 1] * stack.back();
+            stack.pop_back();
+        }
 
-    int result() const;
+        return id;
+    }
 
     /** The @e reduce function returns the list of authorized lines in the
      * utility function of the aggregate attribute.
@@ -79,22 +88,16 @@ struct aggregate_attribute
      * opt1 opt2  1 opt3  1
      * opt1 opt2  1 opt3  2
      */
-    void reduce(std::set<int>& whitelist);
-
-    inline void function_restore() noexcept
-    {
-        functions = saved_functions;
-    }
+    void reduce(Vector& stack, std::set<int>& whitelist) const;
 
     Vector coeffs;
+
+    // The default utility function (e.g. read from model file).
     std::vector<scale_id> functions;
-    std::vector<scale_id> saved_functions;
     std::vector<size_t> m_scale_size;
-    Vector stack;
     scale_id scale;
-    int stack_size;
     int att;
-    int id; /* Reference in the solver_stack atts attribute. */
+    int id; /* Reference in the solver_structure atts attribute. */
 };
 
 struct Block
@@ -104,7 +107,7 @@ struct Block
       , type(BlockType::BLOCK_VALUE)
     {}
 
-    inline constexpr Block(aggregate_attribute* att) noexcept
+    inline constexpr Block(const aggregate_attribute* att) noexcept
       : att(att)
       , type(BlockType::BLOCK_ATTRIBUTE)
     {}
@@ -117,7 +120,7 @@ struct Block
     union
     {
         int value;
-        aggregate_attribute* att;
+        const aggregate_attribute* att;
     };
 
     enum class BlockType
@@ -143,32 +146,92 @@ struct line_updater
     int line;
 };
 
+/** A @e line_modifier overrides the value of the line @e line of the utility
+ * function of the aggregate attribute @e attribute (index in the
+ * @e solver_structure::atts vector).
+ */
+struct line_modifier
+{
+    int attribute;
+    int line;
+    int value;
+};
+
+/** The @e solver_structure is the immutable part of a solver compiled from
+ * a Model: the aggregate attributes with their default utility functions
+ * and the model in Reverse Polish notation. It is shared by all the
+ * @e solver_stack built from it, whatever their thread.
+ */
+struct solver_structure
+{
+    explicit solver_structure(const Model& model);
+
+    solver_structure(const solver_structure& other) = delete;
+    solver_structure& operator=(const solver_structure& other) = delete;
+
+    std::vector<aggregate_attribute> atts;
+
+    // @e function is a Reverse Polish notation. The blocks point into
+    // @e atts.
+    std::vector<Block> function;
+
+private:
+    void recursive_fill(const Model& model, size_t att, int& value_id);
+};
+
+/** The @e solver_stack is the execution state of a solver: a shared
+ * @e solver_structure, the scratch stack used by @e solve and the lines
+ * overriding the default utility functions. Copying a @e solver_stack
+ * only copies the overrides.
+ */
 struct solver_stack
 {
     solver_stack(const Model& model);
 
+    solver_stack(std::shared_ptr<const solver_structure> structure_);
+
     /** Restores the default function (e.g. read from model file) for each
      * aggregate attributes.
      */
-    void reinit();
+    void reinit() noexcept;
 
     template<typename T>
     scale_id solve(const T& options)
     {
         result.clear();
 
-        for (auto& block : function) {
+        for (const auto& block : structure->function) {
             if (block.is_value()) {
                 result.emplace_back(options[block.value]);
             } else {
-                block.att->clear();
+                const int line = block.att->pop_line(result);
+
+                result.emplace_back(function_value(*block.att, line));
+            }
+        }
+
+        assert(result.size() == 1 && "internal error in solver stack");
+
+        return result[0];
+    }
+
+    /** Same as @e solve and also stores in @e values[id] the value of
+     * each aggregate attribute @e id, the root included, during the same
+     * pass. @e values must have @e attribute_size() elements. */
+    template<typename T>
+    scale_id solve(const T& options, std::uint8_t* values)
+    {
+        result.clear();
 
-                for (size_t i = 0; i != block.att->option_size(); ++i) {
-                    block.att->push(result.back());
-                    result.pop_back();
-                }
+        for (const auto& block : structure->function) {
+            if (block.is_value()) {
+                result.emplace_back(options[block.value]);
+            } else {
+                const int line = block.att->pop_line(result);
+                const auto value = function_value(*block.att, line);
 
-                result.emplace_back(block.att->result());
+                values[block.att->id] = static_cast<std::uint8_t>(value);
+                result.emplace_back(value);
             }
         }
 
@@ -180,20 +243,21 @@ struct solver_stack
     template<typename V>
     void reduce(const V& options, std::vector<std::set<int>>& whitelist)
     {
+        Vector stack;
         result.clear();
 
-        for (auto& block : function) {
+        for (const auto& block : structure->function) {
             if (block.is_value()) {
                 result.emplace_back(options[block.value]);
             } else {
-                block.att->clear();
+                const auto first = result.end() -
+                                   static_cast<std::ptrdiff_t>(
+                                     block.att->option_size());
 
-                for (size_t i = 0; i != block.att->option_size(); ++i) {
-                    block.att->push(result.back());
-                    result.pop_back();
-                }
+                stack.assign(first, result.end());
+                result.erase(first, result.end());
 
-                block.att->reduce(whitelist[block.att->id]);
+                block.att->reduce(stack, whitelist[block.att->id]);
                 result.emplace_back(-1); // -1 means computed value.
             }
         }
@@ -201,113 +265,149 @@ struct solver_stack
         assert(result.size() == 1 && "internal error in solver stack");
     }
 
+    /** Increments in @e hits the line of the utility function used by each
+     * aggregate attribute to solve @e options. */
+    template<typename V>
+    void hits(const V& options, std::vector<std::vector<int>>& hits)
+    {
+        result.clear();
+
+        for (const auto& block : structure->function) {
+            if (block.is_value()) {
+                result.emplace_back(options[block.value]);
+            } else {
+                const int line = block.att->pop_line(result);
+
+                ++hits[block.att->id][line];
+                result.emplace_back(function_value(*block.att, line));
+            }
+        }
+
+        assert(result.size() == 1 && "internal error in solver stack");
+    }
+
     inline int attribute_size() const noexcept
     {
-        assert(atts.size() > 0 && atts.size() < INT_MAX);
+        assert(structure->atts.size() > 0 &&
+               structure->atts.size() < INT_MAX);
 
-        return static_cast<int>(atts.size());
+        return static_cast<int>(structure->atts.size());
     }
 
     inline int function_size(int attribute) const noexcept
     {
-        assert(atts.size() > 0 && atts.size() < INT_MAX);
-        assert(attribute >= 0 && attribute < static_cast<int>(atts.size()));
-        assert(atts[attribute].functions.size() < INT_MAX);
+        assert(attribute >= 0 && attribute < attribute_size());
+        assert(structure->atts[attribute].functions.size() < INT_MAX);
 
-        return static_cast<int>(atts[attribute].functions.size());
+        return static_cast<int>(structure->atts[attribute].functions.size());
     }
 
     inline int scale_size(int attribute) const noexcept
     {
-        assert(atts.size() > 0 && atts.size() < INT_MAX);
-        assert(attribute >= 0 && attribute < static_cast<int>(atts.size()));
+        assert(attribute >= 0 && attribute < attribute_size());
 
-        return static_cast<int>(atts[attribute].scale_size());
+        return static_cast<int>(structure->atts[attribute].scale_size());
     }
 
     inline int value(int attribute, int line) const noexcept
     {
-        assert(atts.size() > 0 && atts.size() < INT_MAX);
-        assert(attribute >= 0 && attribute < static_cast<int>(atts.size()));
-        assert(atts[attribute].functions.size() < INT_MAX);
-        assert(line >= 0 &&
-               line < static_cast<int>(atts[attribute].functions.size()));
+        assert(attribute >= 0 && attribute < attribute_size());
+        assert(line >= 0 && line < function_size(attribute));
 
-        return static_cast<int>(atts[attribute].functions[line]);
+        return static_cast<int>(
+          function_value(structure->atts[attribute], line));
     }
 
     inline int default_value(int attribute, int line) const noexcept
     {
-        assert(atts.size() > 0 && atts.size() < INT_MAX);
-        assert(attribute >= 0 && attribute < static_cast<int>(atts.size()));
-        assert(atts[attribute].saved_functions.size() < INT_MAX);
-        assert(line >= 0 &&
-               line < static_cast<int>(atts[attribute].saved_functions.size()));
+        assert(attribute >= 0 && attribute < attribute_size());
+        assert(line >= 0 && line < function_size(attribute));
 
-        return static_cast<int>(atts[attribute].saved_functions[line]);
+        return static_cast<int>(structure->atts[attribute].functions[line]);
     }
 
     inline void value_restore(int attribute, int line) noexcept
     {
-        assert(atts.size() > 0 && atts.size() < INT_MAX);
-        assert(attribute >= 0 && attribute < static_cast<int>(atts.size()));
-        assert(atts[attribute].functions.size() < INT_MAX);
-        assert(line >= 0 &&
-               line < static_cast<int>(atts[attribute].functions.size()));
-
-        atts[attribute].functions[line] = atts[attribute].saved_functions[line];
+        assert(attribute >= 0 && attribute < attribute_size());
+        assert(line >= 0 && line < function_size(attribute));
+
+        for (size_t i = 0, e = overrides.size(); i != e; ++i) {
+            if (overrides[i].attribute == attribute &&
+                overrides[i].line == line) {
+                overrides[i] = overrides.back();
+                overrides.pop_back();
+                --override_count[attribute];
+                return;
+            }
+        }
     }
 
     inline void value_set(int attribute, int line, int scale_value) noexcept
     {
-        assert(atts.size() > 0 && atts.size() < INT_MAX);
-        assert(attribute >= 0 && attribute < static_cast<int>(atts.size()));
-        assert(atts[attribute].functions.size() < INT_MAX);
-        assert(line >= 0 &&
-               line < static_cast<int>(atts[attribute].functions.size()));
+        assert(attribute >= 0 && attribute < attribute_size());
+        assert(line >= 0 && line < function_size(attribute));
 
-        atts[attribute].functions[line] = scale_value;
+        for (auto& elem : overrides) {
+            if (elem.attribute == attribute && elem.line == line) {
+                elem.value = scale_value;
+                return;
+            }
+        }
+
+        overrides.push_back({ attribute, line, scale_value });
+        ++override_count[attribute];
     }
 
     inline void value_increase(int attribute, int line) noexcept
     {
-        assert(atts.size() > 0 && atts.size() < INT_MAX);
-        assert(attribute >= 0 && attribute < static_cast<int>(atts.size()));
-        assert(atts[attribute].functions.size() < INT_MAX);
-        assert(line >= 0 &&
-               line < static_cast<int>(atts[attribute].functions.size()));
-
-        atts[attribute].functions[line] += 1;
+        value_set(attribute, line, value(attribute, line) + 1);
 
-        assert(atts[attribute].functions[line] < atts[attribute].scale_size());
+        assert(value(attribute, line) < scale_size(attribute));
     }
 
     inline void value_clear(int attribute, int line) noexcept
     {
-        assert(atts.size() > 0 && atts.size() < INT_MAX);
-        assert(attribute >= 0 && attribute < static_cast<int>(atts.size()));
-        assert(atts[attribute].functions.size() < INT_MAX);
-        assert(line >= 0 &&
-               line < static_cast<int>(atts[attribute].functions.size()));
-
-        atts[attribute].functions[line] = 0;
+        value_set(attribute, line, 0);
     }
 
-    void recursive_fill(const Model& model, size_t att, int& value_id);
-
-    void set_functions(const std::vector<std::vector<scale_id>>& functions);
-
-    void get_functions(std::vector<std::vector<scale_id>>& functions);
+    void get_functions(std::vector<std::vector<scale_id>>& functions) const;
 
     std::string string_functions() const;
 
-    std::vector<aggregate_attribute> atts;
+    std::shared_ptr<const solver_structure> structure;
 
-    // @e function is a Reverse Polish notation.
-    std::vector<Block> function;
+    // The lines overriding the default utility functions and, for each
+    // aggregate attribute, the number of its lines in @e overrides.
+    std::vector<line_modifier> overrides;
+    std::vector<int> override_count;
 
     // To avoid reallocation each solve(), we store the stack into the solver.
     std::vector<int> result;
+
+private:
+    inline scale_id function_value(const aggregate_attribute& att,
+                                   int line) const noexcept
+    {
+        if (override_count[att.id] != 0)
+            for (const auto& elem : overrides)
+                if (elem.attribute == att.id && elem.line == line)
+                    return elem.value;
+
+        return att.functions[line];
+    }
+};
+
+/** The lines the walkers can update: the whitelist of the lines of each
+ * aggregate attribute and all the (attribute, whitelist index) tuples in the
+ * enumeration order. It is rebuilt by @e full, @e reduce and @e sort_lines
+ * and shared by the copies of a @e for_each_model_solver.
+ */
+struct line_space
+{
+    std::vector<std::vector<int>> whitelist;
+    std::vector<line_updater> lines;
+
+    void init_lines();
 };
 
 class for_each_model_solver
@@ -316,7 +416,10 @@ public:
     context& m_context;
     solver_stack m_solver;
     std::vector<line_updater> m_updaters;
-    std::vector<std::vector<int>> m_whitelist;
+    std::shared_ptr<const line_space> m_space;
+
+    /* The position of each walker in the @e line_space::lines vector. */
+    std::vector<size_t> m_positions;
     int m_walker_number;
 
     /** @e full is used to enable all lines for all aggregate
@@ -324,6 +427,8 @@ public:
      */
     void full();
 
+    void update_walkers(size_t from) noexcept;
+
     void detect_missing_scale_value();
 
 public:
@@ -336,32 +441,73 @@ public:
      */
     void reduce(const Options& options);
 
+    /** @e sort_lines changes the enumeration order of the (attribute, line)
+     * tuples used by @e init_walkers and @e next_line. It must be called
+     * after @e full or @e reduce.
+     */
+    void sort_lines(const Options& options, line_order order);
+
+    /** Restores the default value of the lines modified by the walkers or
+     * by @e set_modifiers. */
+    void restore() noexcept;
+
     void init_next_value();
 
     bool next_value();
 
     bool init_walkers(size_t walker_numbers);
 
-    bool next_line();
+    /** Places the first walker at the position @e first of the
+     * (attribute, line) tuples and the others just after it. */
+    bool init_walkers(size_t walker_numbers, size_t first);
 
-    template<typename V>
-    scale_id solve(const V& options)
+    /** Moves the walkers @e from and above to their next combination. The
+     * walkers before @e from are not moved, @e next_line(1) enumerates the
+     * combinations sharing the position of the first walker. */
+    bool next_line(size_t from = 0);
+
+    size_t line_number() const noexcept
     {
-        return m_solver.solve(options);
+        return m_space->lines.size();
+    }
+
+    /** Returns the scale size of the attribute of the (attribute, line)
+     * tuple at the position @e position. */
+    int line_scale_size(size_t position) const noexcept
+    {
+        return m_solver.scale_size(m_space->lines[position].attribute);
     }
 
-    void set_functions(const std::vector<std::vector<scale_id>>& functions)
+    /** Returns the number of candidates of the steps 1 to @e max_step, i.e.
+     * the sum over the combinations of @e step (attribute, line) tuples of
+     * the product of their scale sizes. */
+    double candidate_number(size_t max_step) const;
+
+    template<typename V>
+    scale_id solve(const V& options)
     {
-        return m_solver.set_functions(functions);
+        return m_solver.solve(options);
     }
 
-    void get_functions(std::vector<std::vector<scale_id>>& functions)
+    void get_functions(std::vector<std::vector<scale_id>>& functions) const
     {
         return m_solver.get_functions(functions);
     }
 
+    /** Copies into @e modifiers the values of the lines under the walkers.
+     * With the default functions, they are enough to rebuild the current
+     * functions. */
+    void get_modifiers(std::vector<line_modifier>& modifiers) const;
+
+    /** Restores the default functions and applies @e modifiers. */
+    void set_modifiers(const std::vector<line_modifier>& modifiers);
+
     std::vector<std::tuple<int, int, int>> updaters() const;
 
+    /** Fills @e updaters with the (attribute, line, value) tuples of the
+     * walkers. The capacity of @e updaters is reused. */
+    void updaters(std::vector<std::tuple<int, int, int>>& updaters) const;
+
     size_t get_attribute_line_tuple_limit() const;
 
     std::string string_functions() const
@@ -26,6 +26,7 @@
 #include <functional>
 #include <limits>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <fmt/format.h>
@@ -284,6 +285,27 @@ tokenize(const std::string& str,
     }
 }
 
+/** Splits @e str into @e tokens at each @e delim character. Empty tokens
+ * are kept and the tokens reference the memory of @e str. */
+inline void
+tokenize(std::string_view str,
+         std::vector<std::string_view>& tokens,
+         char delim)
+{
+    tokens.clear();
+
+    for (;;) {
+        const auto pos = str.find(delim);
+        if (pos == std::string_view::npos) {
+            tokens.emplace_back(str);
+            return;
+        }
+
+        tokens.emplace_back(str.substr(0, pos));
+        str.remove_prefix(pos + 1);
+    }
+}
+
 /**
  * @brief Return true if @c Source can be casted into @c Target integer
  * type.
@@ -325,13 +347,13 @@ private:
 public:
     output_file() noexcept = default;
 
-    output_file(const char* file_path) noexcept
+    output_file(const char* file_path, const char* mode = "w") noexcept
     {
 #ifdef _WIN32
-        if (fopen_s(&file, file_path, "w"))
+        if (fopen_s(&file, file_path, mode))
             file = nullptr;
 #else
-        file = std::fopen(file_path, "w");
+        file = std::fopen(file_path, mode);
 #endif
     }
 
@@ -393,13 +415,13 @@ private:
 public:
     input_file() noexcept = default;
 
-    input_file(const char* file_path) noexcept
+    input_file(const char* file_path, const char* mode = "r") noexcept
     {
 #ifdef _WIN32
-        if (fopen_s(&file, file_path, "r"))
+        if (fopen_s(&file, file_path, mode))
             file = nullptr;
 #else
-        file = std::fopen(file_path, "r");
+        file = std::fopen(file_path, mode);
 #endif
     }
 
@@ -21,6 +21,8 @@
 
 #include <efyj/efyj.hpp>
 
+#include "cancellation.hpp"
+#include "efyj.hpp"
 #include "model.hpp"
 #include "options.hpp"
 #include "post.hpp"
@@ -28,13 +30,19 @@
 #include "utils.hpp"
 
 #include <filesystem>
+#include <fstream>
+#include <iterator>
 #include <random>
+#include <thread>
 
 #include "unit-test.hpp"
 
+#include <atomic>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <new>
 
 #if defined(__unix__) || defined(__APPLE__)
 #include <unistd.h>
@@ -44,6 +52,86 @@
 #include <tchar.h>
 #endif
 
+/* Counts the heap allocations of the test program and of the library to
+ * check the search loops do not allocate. The whole non-aligned family is
+ * replaced so every block is released by the allocator that provided it
+ * (std::stable_sort allocates with the nothrow operator new). */
+static std::atomic<unsigned long long> allocation_number{ 0 };
+
+static void*
+counted_malloc(std::size_t size) noexcept
+{
+    ++allocation_number;
+
+    return std::malloc(size ? size : 1);
+}
+
+void*
+operator new(std::size_t size)
+{
+    if (void* ptr = counted_malloc(size))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void*
+operator new[](std::size_t size)
+{
+    if (void* ptr = counted_malloc(size))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void*
+operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_malloc(size);
+}
+
+void*
+operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_malloc(size);
+}
+
+void
+operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void
+operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void
+operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void
+operator delete[](void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void
+operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void
+operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
 static inline bool
 change_pwd()
 {
@@ -527,6 +615,587 @@ test_problem_Model_file()
     }
 }
 
+void
+test_handles_for_Car()
+{
+    change_pwd();
+    efyj::context ctx;
+
+    auto csv = make_temporary("CarXXXXXXXX.csv");
+    Ensures(
+      efyj::is_success(efyj::extract_options_to_file(ctx, "Car.dxi", csv)));
+
+    efyj::evaluation_results expected;
+    Ensures(efyj::is_success(efyj::evaluate(ctx, "Car.dxi", csv, expected)));
+
+    efyj::model_handle model;
+    efyj::dataset_handle dataset;
+    Ensures(efyj::is_success(efyj::load_model(ctx, "Car.dxi", model)));
+    Ensures(efyj::is_success(efyj::load_dataset(ctx, model, csv, dataset)));
+
+    std::vector<efyj::evaluation_results> results(4);
+    std::vector<std::thread> threads;
+    for (auto& result : results)
+        threads.emplace_back([&model, &dataset, &result]() {
+            efyj::context local;
+            efyj::evaluate(local, model, dataset, result);
+        });
+
+    for (auto& thread : threads)
+        thread.join();
+
+    for (const auto& result : results) {
+        Ensures(result.simulations == expected.simulations);
+        Ensures(result.squared_weighted_kappa ==
+                expected.squared_weighted_kappa);
+    }
+
+    efyj::model_handle employ;
+    efyj::evaluation_results out;
+    Ensures(efyj::is_success(efyj::load_model(ctx, "Employ.dxi", employ)));
+    Ensures(efyj::evaluate(ctx, employ, dataset, out) ==
+            efyj::status::dataset_model_mismatch);
+}
+
+static bool
+store_evaluation_block(const efyj::evaluation_block& block, void* user_data)
+{
+    auto* out = static_cast<efyj::evaluation_results*>(user_data);
+
+    /* Stops the evaluation, and fails the test, on a wrong block. */
+    if (block.first_row != out->simulations.size() || block.size() > 2)
+        return false;
+
+    out->simulations.insert(out->simulations.end(),
+                            block.simulations.begin(),
+                            block.simulations.end());
+    out->linear_weighted_kappa = block.linear_weighted_kappa;
+    out->squared_weighted_kappa = block.squared_weighted_kappa;
+
+    return true;
+}
+
+void
+test_evaluate_stream_for_Car()
+{
+    change_pwd();
+    efyj::context ctx;
+
+    auto csv = make_temporary("CarXXXXXXXX.csv");
+    Ensures(
+      efyj::is_success(efyj::extract_options_to_file(ctx, "Car.dxi", csv)));
+
+    efyj::evaluation_results expected, out;
+    Ensures(efyj::is_success(efyj::evaluate(ctx, "Car.dxi", csv, expected)));
+
+    std::ifstream ifs(csv);
+    Ensures(efyj::is_success(efyj::evaluate(
+      ctx, "Car.dxi", ifs, store_evaluation_block, &out, 2)));
+
+    Ensures(out.simulations == expected.simulations);
+    Ensures(out.linear_weighted_kappa == expected.linear_weighted_kappa);
+    Ensures(out.squared_weighted_kappa == expected.squared_weighted_kappa);
+
+    /* The blocks are sent in file order with several workers. */
+    out.clear();
+    std::ifstream again(csv);
+    Ensures(efyj::is_success(efyj::evaluate(
+      ctx, "Car.dxi", again, store_evaluation_block, &out, 1, 3)));
+    Ensures(out.simulations == expected.simulations);
+}
+
+void
+test_evaluate_data_view_for_Car()
+{
+    change_pwd();
+    efyj::context ctx;
+
+    efyj::data d;
+    Ensures(efyj::is_success(efyj::extract_options(ctx, "Car.dxi", d)));
+
+    efyj::evaluation_results expected, out;
+    Ensures(efyj::is_success(efyj::evaluate(ctx, "Car.dxi", d, expected)));
+
+    const std::vector<std::uint8_t> observed(d.observed.begin(),
+                                             d.observed.end());
+    const std::vector<std::uint8_t> scale_values(d.scale_values.begin(),
+                                                 d.scale_values.end());
+
+    efyj::data_view view;
+    view.simulations = d.simulations;
+    view.places = d.places;
+    view.departments = d.departments;
+    view.years = d.years;
+    view.observed = efyj::array_view(
+      observed.data(), observed.size(), efyj::element_type::uint8);
+    view.scale_values = efyj::array_view(
+      scale_values.data(), scale_values.size(), efyj::element_type::uint8);
+
+    Ensures(efyj::is_success(efyj::evaluate(ctx, "Car.dxi", view, out)));
+    Ensures(out.simulations == expected.simulations);
+    Ensures(out.observations == expected.observations);
+    Ensures(out.squared_weighted_kappa == expected.squared_weighted_kappa);
+}
+
+void
+test_evaluate_threads_for_Car()
+{
+    change_pwd();
+    efyj::context ctx;
+
+    efyj::data d;
+    Ensures(efyj::is_success(efyj::extract_options(ctx, "Car.dxi", d)));
+
+    /* Enough rows for three threads. */
+    const auto rows = d.simulations.size();
+    const auto columns = d.scale_values.size() / rows;
+    efyj::data big;
+    while (big.simulations.size() < 3 * 4096) {
+        for (size_t i = 0; i != rows; ++i) {
+            big.simulations.emplace_back(d.simulations[i]);
+            big.places.emplace_back(d.places[i]);
+            big.departments.emplace_back(d.departments[i]);
+            big.years.emplace_back(d.years[i]);
+            big.observed.emplace_back(d.observed[i]);
+            big.scale_values.insert(
+              big.scale_values.end(),
+              d.scale_values.begin() + static_cast<long>(i * columns),
+              d.scale_values.begin() + static_cast<long>((i + 1) * columns));
+        }
+    }
+
+    efyj::evaluation_results expected, out;
+    Ensures(
+      efyj::is_success(efyj::evaluate(ctx, "Car.dxi", big, expected, 1u)));
+    Ensures(efyj::is_success(efyj::evaluate(ctx, "Car.dxi", big, out, 3u)));
+
+    Ensures(out.simulations == expected.simulations);
+    Ensures(out.observations == expected.observations);
+    Ensures(std::equal(out.confusion.begin(),
+                       out.confusion.end(),
+                       expected.confusion.begin(),
+                       expected.confusion.end()));
+    Ensures(std::equal(out.options.begin(),
+                       out.options.end(),
+                       expected.options.begin(),
+                       expected.options.end()));
+    Ensures(out.squared_weighted_kappa == expected.squared_weighted_kappa);
+    Ensures(out.linear_weighted_kappa == expected.linear_weighted_kappa);
+
+    /* An empty mask keeps every aggregate attribute, the root first. */
+    const std::vector<bool> all;
+    efyj::evaluation_results values;
+    Ensures(efyj::is_success(
+      efyj::evaluate(ctx, "Car.dxi", big, values, 3u, &all)));
+    Ensures(values.simulations == expected.simulations);
+    Ensures(values.attributes.rows() == values.simulations.size());
+    Ensures(values.attributes.columns() == values.attribute_names.size());
+    Ensures(values.attribute_names.size() == 4u);
+    Ensures(values.attribute_names.front() == "CAR");
+    for (size_t i = 0, e = values.simulations.size(); i != e; ++i)
+        Ensures(values.attributes(i, 0) == values.simulations[i]);
+    Ensures(expected.attributes.empty());
+}
+
+void
+test_model_cache_invalidation()
+{
+    change_pwd();
+    efyj::context ctx;
+
+    auto path = make_temporary("efyj-XXXXXXXX.dxi");
+    efyj::information_results car, employ;
+
+    std::filesystem::copy_file(
+      "Car.dxi", path, std::filesystem::copy_options::overwrite_existing);
+    Ensures(efyj::is_success(efyj::information(ctx, path, car)));
+    Ensures(efyj::is_success(efyj::information(ctx, path, car)));
+
+    /* A cache hit shares the model, a new modification time with the same
+     * content keeps it. */
+    std::shared_ptr<const efyj::Model> first, second, touched;
+    Ensures(efyj::is_success(efyj::make_model(ctx, path, first)));
+    Ensures(efyj::is_success(efyj::make_model(ctx, path, second)));
+    Ensures(first == second);
+
+    const auto time = std::filesystem::last_write_time(path);
+    std::filesystem::last_write_time(path, time + std::chrono::seconds(2));
+    Ensures(efyj::is_success(efyj::make_model(ctx, path, touched)));
+    Ensures(touched == first);
+
+    /* A rewrite of the same size with the modification time restored reads
+     * the file again. */
+    std::string content;
+    {
+        std::ifstream ifs("Car.dxi", std::ios::binary);
+        content.assign(std::istreambuf_iterator<char>(ifs),
+                       std::istreambuf_iterator<char>());
+    }
+
+    const auto pos = content.find("<NAME>high</NAME>");
+    Ensures(pos != std::string::npos);
+    content.replace(pos, 17, "<NAME>HIGH</NAME>");
+    {
+        std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+        ofs << content;
+    }
+    std::filesystem::last_write_time(path, time);
+
+    std::shared_ptr<const efyj::Model> rewritten;
+    Ensures(efyj::is_success(efyj::make_model(ctx, path, rewritten)));
+    Ensures(rewritten != first);
+    Ensures(!(*rewritten == *first));
+
+    /* The same relative path names another file after a chdir. */
+    const std::filesystem::path dir = make_temporary("efyj-XXXXXXXX");
+    std::filesystem::create_directory(dir);
+    std::filesystem::copy_file(path, dir / "Car.dxi");
+    std::filesystem::last_write_time(
+      dir / "Car.dxi", std::filesystem::last_write_time("Car.dxi"));
+
+    std::shared_ptr<const efyj::Model> original, other;
+    Ensures(efyj::is_success(efyj::make_model(ctx, "Car.dxi", original)));
+    std::filesystem::current_path(dir);
+    Ensures(efyj::is_success(efyj::make_model(ctx, "Car.dxi", other)));
+    change_pwd();
+    Ensures(!(*other == *original));
+    Ensures(*other == *rewritten);
+    std::filesystem::remove_all(dir);
+
+    std::filesystem::copy_file(
+      "Employ.dxi", path, std::filesystem::copy_options::overwrite_existing);
+    Ensures(efyj::is_success(efyj::information(ctx, path, employ)));
+    Ensures(car.basic_attribute_names != employ.basic_attribute_names);
+
+    std::filesystem::remove(path);
+}
+
+void
+test_model_writer_journal()
+{
+    change_pwd();
+    efyj::context ctx;
+    efyj::Model car;
+
+    {
+        const auto is = efyj::input_file("Car.dxi");
+        Ensures(is.is_open());
+        EnsuresNotThrow(car.read(ctx, is), std::exception);
+    }
+
+    const std::filesystem::path dir = make_temporary("efyj-XXXXXXXX");
+    std::filesystem::create_directory(dir);
+
+    {
+        efyj::model_writer writer;
+        Ensures(efyj::is_success(writer.init(ctx, dir.string())));
+
+        efyj::result r;
+        r.kappa = 0.5;
+        r.modifiers.emplace_back(1, 0, 2);
+        Ensures(efyj::is_success(writer.store(ctx, car, r)));
+        Ensures(writer.journal() == "1;0.5000000000;1-0-2\n");
+
+        /* The journal is private to the writer: nothing but the DEXi files
+         * goes in the output directory. */
+        Ensures(std::filesystem::is_empty(dir));
+        Ensures(efyj::is_success(writer.materialize()));
+        Ensures(std::filesystem::exists(dir / "1.dxi"));
+
+        r.modifiers.emplace_back(1, 1, 2);
+        Ensures(efyj::is_success(writer.store(ctx, car, r)));
+        Ensures(writer.journal() ==
+                "1;0.5000000000;1-0-2\n2;0.5000000000;1-0-2;1-1-2\n");
+    }
+
+    Ensures(std::filesystem::exists(dir / "2.dxi"));
+
+    efyj::Model patched;
+    {
+        const auto is = efyj::input_file((dir / "2.dxi").string().c_str());
+        Ensures(is.is_open());
+        EnsuresNotThrow(patched.read(ctx, is), std::exception);
+    }
+
+    Ensures(patched.attributes[1].functions.low[0] == '2');
+    Ensures(patched.attributes[1].functions.low[1] == '2');
+    Ensures(patched.attributes[1].functions.low.substr(2) ==
+            car.attributes[1].functions.low.substr(2));
+
+    std::filesystem::remove_all(dir);
+}
+
+void
+test_model_lookup_for_Car()
+{
+    change_pwd();
+    efyj::context ctx;
+    efyj::Model car;
+
+    {
+        const auto is = efyj::input_file("Car.dxi");
+        Ensures(is.is_open());
+        EnsuresNotThrow(car.read(ctx, is), std::exception);
+    }
+
+    const efyj::model_lookup lookup(car);
+
+    Ensures(lookup.find_attribute("BUY.PRICE") == 0);
+    Ensures(lookup.find_attribute("#DOORS") == 3);
+    Ensures(lookup.find_attribute("SAFETY") == 5);
+    Ensures(!lookup.find_attribute("PRICE"));
+    Ensures(!lookup.find_attribute("CAR"));
+    Ensures(!lookup.find_attribute("safety"));
+    Ensures(!lookup.find_attribute(""));
+
+    Ensures(lookup.find_scale_value(0, "high") == 0);
+    Ensures(lookup.find_scale_value(0, "low") == 2);
+    Ensures(lookup.find_scale_value(3, "more") == 3);
+    Ensures(lookup.find_observed("unacc") == 0);
+    Ensures(lookup.find_observed("exc") == 3);
+    Ensures(!lookup.find_scale_value(0, "more"));
+    Ensures(lookup.scale_size(3) == 4);
+
+    /* The names win over the decimal indices. */
+    Ensures(lookup.find_scale_value(3, "2") == 0);
+    Ensures(lookup.find_scale_value(3, "4") == 2);
+    Ensures(lookup.find_scale_value(0, "1") == 1);
+    Ensures(!lookup.find_scale_value(0, "3"));
+    Ensures(!lookup.find_scale_value(0, "-1"));
+    Ensures(!lookup.find_scale_value(0, "1x"));
+    Ensures(!lookup.find_scale_value(0, ""));
+
+    /* The scale indices of a data are lower than the scale size. */
+    efyj::data d;
+    efyj::evaluation_results out;
+    Ensures(efyj::is_success(efyj::extract_options(ctx, "Car.dxi", d)));
+
+    d.scale_values[0] = lookup.scale_size(0);
+    Ensures(efyj::evaluate(ctx, "Car.dxi", d, out) ==
+            efyj::status::scale_value_inconsistent);
+
+    d.scale_values[0] = -1;
+    Ensures(efyj::evaluate(ctx, "Car.dxi", d, out) ==
+            efyj::status::scale_value_inconsistent);
+}
+
+void
+test_chunked_options_for_Car()
+{
+    change_pwd();
+    efyj::context ctx;
+    efyj::Model car;
+
+    {
+        const auto is = efyj::input_file("Car.dxi");
+        Ensures(is.is_open());
+        EnsuresNotThrow(car.read(ctx, is), std::exception);
+    }
+
+    const std::vector<std::vector<std::string>> scales = {
+        { "high", "medium", "low" },   { "high", "medium", "low" },
+        { "to_2", "3-4", "more" },     { "2", "3", "4", "more" },
+        { "small", "medium", "big" },  { "small", "medium", "high" },
+        { "unacc", "acc", "good", "exc" }
+    };
+
+    /* About 3.5 MiB of options with a line of bad column number in the
+     * middle of the file: it is split into several chunks. */
+    constexpr size_t rows = 70000;
+    constexpr size_t skipped = rows / 2;
+    std::mt19937 gen(42);
+    std::vector<std::vector<int>> values;
+    std::vector<int> departments, years;
+    std::string text = "simulation;place;department;year;BUY.PRICE;"
+                       "MAINT.PRICE;#PERS;#DOORS;LUGGAGE;SAFETY;CAR\n";
+
+    for (size_t i = 0; i != rows; ++i) {
+        if (i == skipped)
+            text += "bad;P0;1;2000;high\n";
+
+        auto& row = values.emplace_back();
+        departments.push_back(static_cast<int>(gen() % 90));
+        years.push_back(2000 + static_cast<int>(gen() % 20));
+        text += "S" + std::to_string(i) + ";P" + std::to_string(i % 7) +
+                ";" + std::to_string(departments.back()) + ";" +
+                std::to_string(years.back());
+
+        for (const auto& scale : scales) {
+            row.push_back(static_cast<int>(gen() % scale.size()));
+            text += ";" + scale[row.back()];
+        }
+
+        text += "\n";
+    }
+
+    auto check = [&](const std::string& path, unsigned threads) {
+        efyj::input_file is(path.c_str());
+        Ensures(is.is_open());
+
+        efyj::Options options;
+        Ensures(options.read(ctx, is, car, threads) ==
+                efyj::status::success);
+        Ensures(options.simulations.size() == rows);
+        Ensures(options.places.size() == rows);
+        Ensures(options.options.rows() == rows);
+
+        for (size_t i = 0; i != rows; ++i) {
+            Ensures(options.simulations[i] == "S" + std::to_string(i));
+            Ensures(options.places[i] == "P" + std::to_string(i % 7));
+            Ensures(options.departments[i] == departments[i]);
+            Ensures(options.years[i] == years[i]);
+            Ensures(options.observed[i] == values[i].back());
+
+            for (size_t c = 0; c + 1 < scales.size(); ++c)
+                Ensures(options.options(i, c) == values[i][c]);
+        }
+    };
+
+    auto path = make_temporary("CarXXXXXXXX.csv");
+    auto write = [&path](const std::string& content) {
+        std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+        ofs << content;
+    };
+
+    write(text);
+    check(path, 4);
+    check(path, 1);
+
+    /* The unknown scale value is reported at its line, the header
+     * excluded, even if an earlier chunk rejects a line. */
+    write(text + "S;P0;1;2000;high;high;to_2;2;small;small;unknown\n");
+    {
+        efyj::input_file is(path.c_str());
+        efyj::Options options;
+        Ensures(options.read(ctx, is, car, 4) ==
+                efyj::status::csv_parser_scale_value_unknown);
+        Ensures(options.error_at_line == rows + 1);
+    }
+
+    std::filesystem::remove(path);
+}
+
+void
+test_convert_options_to_file()
+{
+    change_pwd();
+    efyj::context ctx;
+    efyj::status ret;
+
+    auto csv = make_temporary("CarXXXXXXXX.csv");
+    auto dataset = make_temporary("CarXXXXXXXX.efyj");
+
+    ret = efyj::extract_options_to_file(ctx, "Car.dxi", csv);
+    Ensures(efyj::is_success(ret));
+
+    ret = efyj::convert_options_to_file(ctx, "Car.dxi", csv, dataset);
+    Ensures(efyj::is_success(ret));
+
+    efyj::data opt1, opt2;
+    ret = efyj::extract_options(ctx, "Car.dxi", csv, opt1);
+    Ensures(efyj::is_success(ret));
+
+    ret = efyj::extract_options(ctx, "Car.dxi", dataset, opt2);
+    Ensures(efyj::is_success(ret));
+    Ensures(opt1.simulations == opt2.simulations);
+    Ensures(opt1.places == opt2.places);
+    Ensures(opt1.departments == opt2.departments);
+    Ensures(opt1.years == opt2.years);
+    Ensures(opt1.observed == opt2.observed);
+    Ensures(opt1.scale_values == opt2.scale_values);
+
+    efyj::evaluation_results eval;
+    ret = efyj::evaluate(ctx, "Employ.dxi", dataset, eval);
+    Ensures(ret == efyj::status::dataset_model_mismatch);
+}
+
+
+/* Reads the binary dataset @e bytes written in @e path with Car.dxi. */
+static efyj::status
+read_dataset_bytes(const std::string& path, const std::string& bytes)
+{
+    {
+        std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+        ofs.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    }
+
+    efyj::context ctx;
+    efyj::data out;
+    return efyj::extract_options(ctx, "Car.dxi", path, out);
+}
+
+void
+test_binary_dataset_errors()
+{
+    change_pwd();
+    efyj::context ctx;
+
+    auto csv = make_temporary("CarXXXXXXXX.csv");
+    auto dataset = make_temporary("CarXXXXXXXX.efyj");
+    auto corrupted = make_temporary("CarXXXXXXXX-bad.efyj");
+
+    Ensures(
+      efyj::is_success(efyj::extract_options_to_file(ctx, "Car.dxi", csv)));
+    Ensures(efyj::is_success(
+      efyj::convert_options_to_file(ctx, "Car.dxi", csv, dataset)));
+
+    std::string bytes;
+    {
+        std::ifstream ifs(dataset, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(ifs),
+                     std::istreambuf_iterator<char>());
+    }
+    Ensures(efyj::is_success(read_dataset_bytes(corrupted, bytes)));
+
+    /* Header: magic[8], version, byte order, fingerprint, rows at 24 and
+     * simulation bytes at 48. The file ends with the subdataset sizes, the
+     * subdataset identifiers and the simulation strings, each array padded
+     * to 8 bytes. */
+    std::uint64_t rows, simulation_bytes;
+    std::memcpy(&rows, bytes.data() + 24, sizeof(rows));
+    std::memcpy(&simulation_bytes, bytes.data() + 48, sizeof(rows));
+    auto padded = [](std::uint64_t size) { return (size + 7) / 8 * 8; };
+    const auto identifiers = bytes.size() - padded(simulation_bytes) -
+                             (rows + 1) * 8 - padded(rows * 4);
+    const auto sizes = identifiers - padded(rows * 4);
+
+    auto patch = [&bytes](size_t offset, std::int32_t value) {
+        auto copy = bytes;
+        std::memcpy(copy.data() + offset, &value, sizeof(value));
+        return copy;
+    };
+
+    auto bad = bytes;
+    bad[0] = 'X';
+    Ensures(efyj::is_bad(read_dataset_bytes(corrupted, bad)));
+
+    Ensures(read_dataset_bytes(corrupted, patch(8, 99)) ==
+            efyj::status::dataset_format_error);
+
+    bad = bytes;
+    bad[16] = static_cast<char>(~bad[16]);
+    Ensures(read_dataset_bytes(corrupted, bad) ==
+            efyj::status::dataset_model_mismatch);
+
+    Ensures(read_dataset_bytes(corrupted, bytes.substr(0, 40)) ==
+            efyj::status::dataset_format_error);
+    Ensures(read_dataset_bytes(corrupted, bytes.substr(0, bytes.size() / 2)) ==
+            efyj::status::dataset_format_error);
+
+    const auto too_large = static_cast<std::int32_t>(rows);
+    Ensures(read_dataset_bytes(corrupted, patch(sizes, too_large)) ==
+            efyj::status::dataset_format_error);
+    Ensures(read_dataset_bytes(corrupted, patch(sizes, -1)) ==
+            efyj::status::dataset_format_error);
+    Ensures(read_dataset_bytes(corrupted, patch(identifiers, 1)) ==
+            efyj::status::dataset_format_error);
+    Ensures(read_dataset_bytes(corrupted, patch(identifiers + 4, 1000)) ==
+            efyj::status::dataset_format_error);
+
+    std::filesystem::remove(csv);
+    std::filesystem::remove(dataset);
+    std::filesystem::remove(corrupted);
+}
 void
 check_the_options_set_function()
 {
@@ -745,6 +1414,86 @@ test_adjustment_solver_for_Car2()
     Ensures(all_kappa[1] == 1.0);
 }
 
+static bool
+update_top_result(const efyj::result& r, void* user_data)
+{
+    auto* results = reinterpret_cast<std::vector<efyj::result>*>(user_data);
+    results->emplace_back(r);
+
+    return true;
+}
+
+void
+test_adjustment_top_for_Car2()
+{
+    auto ctx = make_context();
+
+    efyj::data d;
+
+    auto ret = efyj::extract_options(ctx, "Car2.dxi", d);
+    Ensures(is_success(ret));
+
+    std::vector<efyj::result> results;
+    ret = efyj::adjustment(ctx,
+                           "Car2.dxi",
+                           d,
+                           update_top_result,
+                           &results,
+                           nullptr,
+                           nullptr,
+                           true,
+                           2,
+                           1u,
+                           3u);
+    Ensures(is_success(ret));
+    Ensures(results.size() == (size_t)3);
+
+    Ensures(results[0].alternatives.empty());
+
+    for (size_t i = 1, e = results.size(); i != e; ++i) {
+        const auto& alts = results[i].alternatives;
+
+        Ensures(alts.size() == (size_t)3);
+        Ensures(alts[0].kappa == results[i].kappa);
+        Ensures(alts[0].modifiers.size() == results[i].modifiers.size());
+
+        for (size_t j = 1, end = alts.size(); j < end; ++j)
+            Ensures(alts[j - 1].kappa >= alts[j].kappa);
+    }
+}
+
+void
+test_adjustment_line_order_for_Car2()
+{
+    auto ctx = make_context();
+
+    efyj::data d;
+
+    auto ret = efyj::extract_options(ctx, "Car2.dxi", d);
+    Ensures(is_success(ret));
+
+    for (auto order : { efyj::line_order::row_hits,
+                        efyj::line_order::kappa_gain }) {
+        std::vector<efyj::result> results;
+        ret = efyj::adjustment(ctx,
+                               "Car2.dxi",
+                               d,
+                               update_top_result,
+                               &results,
+                               nullptr,
+                               nullptr,
+                               true,
+                               1,
+                               1u,
+                               1u,
+                               order);
+        Ensures(is_success(ret));
+        Ensures(results.size() == (size_t)2);
+        Ensures(results[1].kappa == 1.0);
+        Ensures(results[1].modifiers.size() == (size_t)1);
+    }
+}
+
 void
 test_prediction_solver_for_Car()
 {
@@ -785,6 +1534,339 @@ test_prediction_solver_for_Car()
     Ensures(all_kappa[3] <= 1.0);
 }
 
+void
+test_prediction_thread_solver_for_Car()
+{
+    auto ctx = make_context();
+
+    efyj::data d;
+
+    auto ret = efyj::extract_options(ctx, "Car.dxi", d);
+    Ensures(is_success(ret));
+
+    d.years[0] = 1990;
+    d.years[1] = 1990;
+    d.departments[0] = 81;
+    d.departments[1] = 81;
+    d.places[0] = "Auzeville";
+    d.places[1] = "Auzeville";
+
+    std::vector<efyj::result> sequential, parallel;
+    ret = efyj::prediction(ctx,
+                           "Car.dxi",
+                           d,
+                           update_top_result,
+                           &sequential,
+                           nullptr,
+                           nullptr,
+                           true,
+                           3,
+                           1u);
+    Ensures(is_success(ret));
+
+    ret = efyj::prediction(ctx,
+                           "Car.dxi",
+                           d,
+                           update_top_result,
+                           &parallel,
+                           nullptr,
+                           nullptr,
+                           true,
+                           3,
+                           3u);
+    Ensures(is_success(ret));
+
+    Ensures(sequential.size() == parallel.size());
+    for (size_t i = 0, e = sequential.size(); i != e; ++i) {
+        Ensures(sequential[i].kappa == parallel[i].kappa);
+        Ensures(sequential[i].modifiers.size() ==
+                parallel[i].modifiers.size());
+
+        for (size_t j = 0, end = sequential[i].modifiers.size(); j != end;
+             ++j) {
+            const auto& lhs = sequential[i].modifiers[j];
+            const auto& rhs = parallel[i].modifiers[j];
+
+            Ensures(lhs.attribute == rhs.attribute);
+            Ensures(lhs.line == rhs.line);
+            Ensures(lhs.value == rhs.value);
+        }
+    }
+}
+
+void
+test_kappa_cache()
+{
+    const std::vector<int> simulated{ 0, 3, 1, 2, 2 };
+
+    /* The solve loops build the signature value by value. */
+    auto hash = efyj::kappa_cache::seed;
+    for (const auto value : simulated)
+        hash = efyj::kappa_cache::combine(hash, value);
+
+    Ensures(hash == efyj::kappa_cache::signature(simulated));
+    Ensures(hash != efyj::kappa_cache::signature(std::vector<int>{
+                      0, 3, 2, 1, 2 }));
+
+    efyj::kappa_cache cache;
+    double kappa = -1.0;
+
+    Ensures(!cache.find(hash, kappa));
+    cache.insert(hash, 0.25);
+    Ensures(cache.find(hash, kappa));
+    Ensures(kappa == 0.25);
+
+    cache.insert(hash, 0.5);
+    Ensures(cache.find(hash, kappa));
+    Ensures(kappa == 0.5);
+
+    cache.clear();
+    Ensures(!cache.find(hash, kappa));
+
+    /* A full table forgets old entries but never returns the kappa of
+     * another signature, and keeps the last inserted one. */
+    efyj::kappa_cache small(8);
+    for (int i = 0; i != 1000; ++i) {
+        const auto key = efyj::kappa_cache::signature(std::vector<int>{ i });
+        small.insert(key, i);
+        Ensures(small.find(key, kappa));
+        Ensures(kappa == i);
+    }
+
+    int found = 0;
+    for (int i = 0; i != 1000; ++i) {
+        const auto key = efyj::kappa_cache::signature(std::vector<int>{ i });
+        if (small.find(key, kappa)) {
+            Ensures(kappa == i);
+            ++found;
+        }
+    }
+
+    Ensures(found > 0);
+    Ensures(found <= 8);
+}
+
+void
+test_cancellation_check()
+{
+    std::atomic<bool> token{ false };
+
+    efyj::cancellation_check running(&token);
+    for (int i = 0; i < 100000; ++i)
+        Ensures(!running());
+    Ensures(!running.stopped());
+
+    token.store(true);
+    Ensures(running());
+    Ensures(running.stopped());
+
+    efyj::cancellation_check late(
+      nullptr, std::chrono::steady_clock::now() - std::chrono::seconds(1));
+    Ensures(late());
+
+    Ensures(efyj::make_deadline(0.0) == efyj::steady_time_point::max());
+}
+
+void
+test_jobs_for_Car2()
+{
+    auto ctx = make_context();
+
+    efyj::data d;
+    auto ret = efyj::extract_options(ctx, "Car2.dxi", d);
+    Ensures(is_success(ret));
+
+    efyj::model_handle model;
+    efyj::dataset_handle dataset;
+    Ensures(is_success(efyj::load_model(ctx, "Car2.dxi", model)));
+    Ensures(is_success(efyj::load_dataset(ctx, model, d, dataset)));
+
+    std::vector<efyj::result> expected, results;
+    ret = efyj::adjustment(ctx,
+                           model,
+                           dataset,
+                           update_top_result,
+                           &expected,
+                           nullptr,
+                           nullptr,
+                           true,
+                           2,
+                           1u);
+    Ensures(is_success(ret));
+
+    efyj::job job;
+    ret = efyj::start_adjustment(
+      ctx, model, dataset, update_top_result, &results, true, 2, job);
+    Ensures(is_success(ret));
+    Ensures(is_success(job.wait(ctx)));
+
+    auto progress = job.progress();
+    Ensures(progress.done);
+    Ensures(!progress.cancelled);
+    Ensures(progress.step == 2u);
+    Ensures(progress.steps >= 2u);
+    Ensures(progress.remaining == 0.0);
+
+    Ensures(results.size() == expected.size());
+    unsigned long long int candidates = 0;
+    for (size_t i = 0, e = results.size(); i != e; ++i) {
+        Ensures(results[i].kappa == expected[i].kappa);
+        if (i > 0)
+            candidates += results[i].kappa_computed;
+    }
+
+    Ensures(progress.candidates == candidates);
+    Ensures(progress.kappa == results.back().kappa);
+
+    /* A cancelled job stops at the next line combination without
+     * reporting the step in progress. */
+    results.clear();
+    ret = efyj::start_adjustment(
+      ctx, model, dataset, update_top_result, &results, true, 2, job);
+    Ensures(is_success(ret));
+    job.cancel();
+    Ensures(is_success(job.wait(ctx)));
+
+    progress = job.progress();
+    Ensures(progress.done);
+    Ensures(progress.cancelled);
+    Ensures(results.size() <= expected.size());
+}
+
+/* A job owned by its result callback: the callback waits for the job to be
+ * stored, then releases it from the job thread and stops the computation. */
+struct self_owned_job
+{
+    efyj::job job;
+    std::atomic<bool> stored{ false };
+    std::atomic<bool> released{ false };
+    efyj::status wait = efyj::status::success;
+};
+
+static bool
+release_job(const efyj::result& /*r*/, void* user_data)
+{
+    auto* owner = reinterpret_cast<self_owned_job*>(user_data);
+
+    while (!owner->stored.load(std::memory_order_acquire))
+        std::this_thread::yield();
+
+    efyj::context ctx;
+    owner->wait = owner->job.wait(ctx);
+    owner->job = efyj::job();
+    owner->released.store(true, std::memory_order_release);
+
+    return false;
+}
+
+void
+test_job_released_by_callback_for_Car2()
+{
+    auto ctx = make_context();
+
+    efyj::data d;
+    Ensures(is_success(efyj::extract_options(ctx, "Car2.dxi", d)));
+
+    efyj::model_handle model;
+    efyj::dataset_handle dataset;
+    Ensures(is_success(efyj::load_model(ctx, "Car2.dxi", model)));
+    Ensures(is_success(efyj::load_dataset(ctx, model, d, dataset)));
+
+    self_owned_job owner;
+    Ensures(is_success(efyj::start_adjustment(
+      ctx, model, dataset, release_job, &owner, true, 2, owner.job)));
+    owner.stored.store(true, std::memory_order_release);
+
+    while (!owner.released.load(std::memory_order_acquire))
+        std::this_thread::yield();
+
+    Ensures(owner.wait == efyj::status::internal_error);
+    Ensures(owner.job.empty());
+
+    /* The detached computation ends in the background: leaves it the time
+     * to write its results before the next test or the program exit. */
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+}
+
+/* Stores the number of heap allocations at each step. The callback must not
+ * allocate itself. */
+struct allocation_steps
+{
+    unsigned long long int number[8];
+    int steps = 0;
+};
+
+static bool
+update_allocation(const efyj::result& /*r*/, void* user_data)
+{
+    auto* steps = reinterpret_cast<allocation_steps*>(user_data);
+
+    steps->number[steps->steps] = allocation_number.load();
+    ++steps->steps;
+
+    return steps->steps < 8;
+}
+
+void
+test_allocation_free_search_for_Car()
+{
+    auto ctx = make_context();
+
+    efyj::data d;
+
+    auto ret = efyj::extract_options(ctx, "Car.dxi", d);
+    Ensures(is_success(ret));
+
+    d.years[0] = 1990;
+    d.years[1] = 1990;
+    d.departments[0] = 81;
+    d.departments[1] = 81;
+    d.places[0] = "Auzeville";
+    d.places[1] = "Auzeville";
+
+    {
+        allocation_steps steps;
+        ret = efyj::adjustment(ctx,
+                               "Car.dxi",
+                               d,
+                               update_allocation,
+                               &steps,
+                               nullptr,
+                               nullptr,
+                               true,
+                               3,
+                               1u);
+        Ensures(is_success(ret));
+        Ensures(steps.steps == 4);
+
+        /* The step 3 evaluates many more candidates than the step 2: only
+         * the output of the step allocates. */
+        Ensures(steps.number[3] - steps.number[2] ==
+                steps.number[2] - steps.number[1]);
+    }
+
+    {
+        allocation_steps steps;
+        ret = efyj::prediction(ctx,
+                               "Car.dxi",
+                               d,
+                               update_allocation,
+                               &steps,
+                               nullptr,
+                               nullptr,
+                               true,
+                               3,
+                               1u);
+        Ensures(is_success(ret));
+        Ensures(steps.steps == 4);
+
+        /* The step 3 evaluates many more candidates than the step 2: only
+         * the output of the step allocates. */
+        Ensures(steps.number[3] - steps.number[2] ==
+                steps.number[2] - steps.number[1]);
+    }
+}
+
 int
 main()
 {
@@ -803,11 +1885,29 @@ main()
     test_basic_solver_for_Enterprise();
     test_basic_solver_for_IPSIM_PV_simulation1_1();
     test_problem_Model_file();
+    test_handles_for_Car();
+    test_evaluate_stream_for_Car();
+    test_evaluate_data_view_for_Car();
+    test_evaluate_threads_for_Car();
+    test_model_cache_invalidation();
+    test_model_writer_journal();
+    test_model_lookup_for_Car();
+    test_chunked_options_for_Car();
+    test_convert_options_to_file();
+    test_binary_dataset_errors();
     check_the_options_set_function();
     check_the_efyj_set_function();
     test_adjustment_solver_for_Car();
     test_adjustment_solver_for_Car2();
+    test_adjustment_top_for_Car2();
+    test_adjustment_line_order_for_Car2();
     test_prediction_solver_for_Car();
+    test_prediction_thread_solver_for_Car();
+    test_kappa_cache();
+    test_cancellation_check();
+    test_jobs_for_Car2();
+    test_allocation_free_search_for_Car();
+    test_job_released_by_callback_for_Car2();
 
     return unit_test::report_errors();
 }
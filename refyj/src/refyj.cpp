@@ -74,6 +74,11 @@ show_context(const efyj::context& ctx) noexcept
                     << get_error_message(ctx.status) << ctx.data_1 << ctx.line
                     << ctx.column << '\n';
         break;
+    case efyj::status::dataset_format_error:
+    case efyj::status::dataset_model_mismatch:
+        Rcpp::Rcerr << "dataset error " << get_error_message(ctx.status)
+                    << " - " << ctx.data_1 << '\n';
+        break;
     case efyj::status::extract_option_same_input_files:
         Rcpp::Rcerr << get_error_message(ctx.status) << '\n';
         break;
@@ -101,6 +106,46 @@ show_context(const efyj::context& ctx) noexcept
     }
 }
 
+/* A NULL @c aggregates disables the values of the aggregate attributes. */
+static const std::vector<bool>*
+make_mask(const Rcpp::Nullable<Rcpp::LogicalVector>& aggregates,
+          std::vector<bool>& mask)
+{
+    if (aggregates.isNull())
+        return nullptr;
+
+    const Rcpp::LogicalVector v(aggregates.get());
+    mask.assign(v.begin(), v.end());
+    return &mask;
+}
+
+static Rcpp::List
+make_evaluation_list(const efyj::evaluation_results& out, bool aggregates)
+{
+    auto ret = Rcpp::List::create(
+      Rcpp::Named("simulations") = Rcpp::wrap(out.simulations),
+      Rcpp::Named("observation") = Rcpp::wrap(out.observations),
+      Rcpp::Named("linear_weighted_kappa") =
+        Rcpp::wrap(out.linear_weighted_kappa),
+      Rcpp::Named("squared_weighted_kappa") =
+        Rcpp::wrap(out.squared_weighted_kappa));
+
+    if (aggregates) {
+        const auto rows = static_cast<int>(out.simulations.size());
+        const auto cols = static_cast<int>(out.attribute_names.size());
+        Rcpp::IntegerMatrix attributes(rows, cols);
+
+        for (int i = 0; i != rows; ++i)
+            for (int j = 0; j != cols; ++j)
+                attributes(i, j) = out.attributes(i, j);
+
+        Rcpp::colnames(attributes) = Rcpp::wrap(out.attribute_names);
+        ret["attributes"] = attributes;
+    }
+
+    return ret;
+}
+
 //' Extract information from DEXi file.
 //'
 //' This function parses the DEXi file and returns some informations mode.
@@ -168,9 +213,15 @@ information(const Rcpp::String& model)
 //' @param observed A vector of integers
 //' @param scale_values A vector of integers with the number of aggregate
 //' table times number of row in simulations, places and other vectors.
+//' @param thread The number of threads sharing the rows.
+//' @param aggregates NULL or a vector of logicals, one per attribute of
+//' the DEXi file, selecting the aggregate attributes whose values are
+//' returned. An empty vector selects all of them.
 //'
 //' @return A List with the list of simulation and observation vectors
-//' the kappa linear and the kappa squared.
+//' the kappa linear and the kappa squared. With \code{aggregates}, the
+//' \code{attributes} matrix has one row per option and one named column
+//' per selected aggregate attribute.
 //'
 //' @export
 // [[Rcpp::export]]
@@ -181,7 +232,9 @@ evaluate(const Rcpp::String& model,
          const Rcpp::NumericVector& departments,
          const Rcpp::NumericVector& years,
          const Rcpp::NumericVector& observed,
-         const Rcpp::NumericVector& scale_values)
+         const Rcpp::NumericVector& scale_values,
+         const int thread = 1,
+         const Rcpp::Nullable<Rcpp::LogicalVector>& aggregates = R_NilValue)
 {
     try {
         efyj::context ctx;
@@ -202,6 +255,12 @@ evaluate(const Rcpp::String& model,
                     "'observed' must have the same length.\n");
             return R_NilValue;
         }
+
+        if (thread <= 0) {
+            Rprintf("'thread' must be a positive value.\n");
+            return R_NilValue;
+        }
+
         efyj::evaluation_results out;
 
         efyj::data d;
@@ -212,19 +271,210 @@ evaluate(const Rcpp::String& model,
         d.observed = Rcpp::as<std::vector<int>>(observed);
         d.scale_values = Rcpp::as<std::vector<int>>(scale_values);
 
-        if (const auto ret = efyj::evaluate(ctx, model, d, out); is_bad(ret)) {
+        std::vector<bool> mask;
+        const auto* mask_ptr = make_mask(aggregates, mask);
+
+        if (const auto ret = efyj::evaluate(ctx,
+                                            model,
+                                            d,
+                                            out,
+                                            static_cast<unsigned>(thread),
+                                            mask_ptr);
+            is_bad(ret)) {
             show_context(ctx);
             Rprintf("Evaluation failed: %s\n", efyj::get_error_message(ret));
             return R_NilValue;
         }
 
-        return Rcpp::List::create(
-          Rcpp::Named("simulations") = Rcpp::wrap(out.simulations),
-          Rcpp::Named("observation") = Rcpp::wrap(out.observations),
-          Rcpp::Named("linear_weighted_kappa") =
-            Rcpp::wrap(out.linear_weighted_kappa),
-          Rcpp::Named("squared_weighted_kappa") =
-            Rcpp::wrap(out.squared_weighted_kappa));
+        return make_evaluation_list(out, mask_ptr != nullptr);
+    } catch (const std::bad_alloc& e) {
+        Rprintf("failed: %s\n", e.what());
+    } catch (const std::exception& e) {
+        Rprintf("failed: %s\n", e.what());
+    } catch (...) {
+        Rprintf("failed: unknown error\n");
+    }
+
+    return R_NilValue;
+}
+
+//' Reads a DEXi file once and returns a handle shared by the
+//' evaluate_handle, adjustment_handle and prediction_handle functions.
+//'
+//' @param model The file path of the DEXi model.
+//'
+//' @return An external pointer to the model handle.
+//'
+//' @export
+// [[Rcpp::export]]
+SEXP
+load_model(const Rcpp::String& model)
+{
+    try {
+        efyj::context ctx;
+        ctx.out = &Rcpp::Rcout;
+        ctx.err = &Rcpp::Rcerr;
+        ctx.line = 0;
+        ctx.column = 0;
+        ctx.size = 0;
+        ctx.data_1.reserve(256u);
+        ctx.status = efyj::status::success;
+        ctx.log_priority = efyj::log_level::info;
+
+        auto out = std::make_unique<efyj::model_handle>();
+        if (const auto ret = efyj::load_model(ctx, model, *out);
+            is_bad(ret)) {
+            show_context(ctx);
+            Rprintf("Load model failed: %s\n", efyj::get_error_message(ret));
+            return R_NilValue;
+        }
+
+        return Rcpp::XPtr<efyj::model_handle>(out.release(), true);
+    } catch (const std::bad_alloc& e) {
+        Rprintf("failed: %s\n", e.what());
+    } catch (const std::exception& e) {
+        Rprintf("failed: %s\n", e.what());
+    } catch (...) {
+        Rprintf("failed: unknown error\n");
+    }
+
+    return R_NilValue;
+}
+
+//' Converts a dataset once for a model handle.
+//'
+//' @param model A model handle returned by load_model.
+//' @param simulations A vector of strings
+//' @param places A vector of strings
+//' @param departments A vector of integers
+//' @param years A vector of integers
+//' @param observed A vector of integers
+//' @param scale_values A vector of integers with the number of aggregate
+//' table times number of row in simulations, places and other vectors.
+//'
+//' @return An external pointer to the dataset handle.
+//'
+//' @export
+// [[Rcpp::export]]
+SEXP
+load_dataset(SEXP model,
+             const Rcpp::CharacterVector& simulations,
+             const Rcpp::CharacterVector& places,
+             const Rcpp::NumericVector& departments,
+             const Rcpp::NumericVector& years,
+             const Rcpp::NumericVector& observed,
+             const Rcpp::NumericVector& scale_values)
+{
+    try {
+        efyj::context ctx;
+        ctx.out = &Rcpp::Rcout;
+        ctx.err = &Rcpp::Rcerr;
+        ctx.line = 0;
+        ctx.column = 0;
+        ctx.size = 0;
+        ctx.data_1.reserve(256u);
+        ctx.status = efyj::status::success;
+        ctx.log_priority = efyj::log_level::info;
+
+        if (simulations.length() != places.length() ||
+            simulations.length() != departments.length() ||
+            simulations.length() != years.length() ||
+            simulations.length() != observed.length()) {
+            Rprintf("'simulations', 'places', 'departments', 'years', "
+                    "'observed' must have the same length.\n");
+            return R_NilValue;
+        }
+
+        Rcpp::XPtr<efyj::model_handle> handle(model);
+
+        efyj::data d;
+        d.simulations = Rcpp::as<std::vector<std::string>>(simulations);
+        d.places = Rcpp::as<std::vector<std::string>>(places);
+        d.departments = Rcpp::as<std::vector<int>>(departments);
+        d.years = Rcpp::as<std::vector<int>>(years);
+        d.observed = Rcpp::as<std::vector<int>>(observed);
+        d.scale_values = Rcpp::as<std::vector<int>>(scale_values);
+
+        auto out = std::make_unique<efyj::dataset_handle>();
+        if (const auto ret = efyj::load_dataset(ctx, *handle, d, *out);
+            is_bad(ret)) {
+            show_context(ctx);
+            Rprintf("Load dataset failed: %s\n",
+                    efyj::get_error_message(ret));
+            return R_NilValue;
+        }
+
+        return Rcpp::XPtr<efyj::dataset_handle>(out.release(), true);
+    } catch (const std::bad_alloc& e) {
+        Rprintf("failed: %s\n", e.what());
+    } catch (const std::exception& e) {
+        Rprintf("failed: %s\n", e.what());
+    } catch (...) {
+        Rprintf("failed: unknown error\n");
+    }
+
+    return R_NilValue;
+}
+
+//' Evaluates a model handle with a dataset handle.
+//'
+//' @param model A model handle returned by load_model.
+//' @param dataset A dataset handle returned by load_dataset.
+//' @param thread The number of threads sharing the rows.
+//' @param aggregates NULL or a vector of logicals, one per attribute of
+//' the DEXi file, selecting the aggregate attributes whose values are
+//' returned. An empty vector selects all of them.
+//'
+//' @return A List with the list of simulation and observation vectors
+//' the kappa linear and the kappa squared. With \code{aggregates}, the
+//' \code{attributes} matrix has one row per option and one named column
+//' per selected aggregate attribute.
+//'
+//' @export
+// [[Rcpp::export]]
+Rcpp::List
+evaluate_handle(SEXP model,
+                SEXP dataset,
+                const int thread = 1,
+                const Rcpp::Nullable<Rcpp::LogicalVector>& aggregates =
+                  R_NilValue)
+{
+    try {
+        efyj::context ctx;
+        ctx.out = &Rcpp::Rcout;
+        ctx.err = &Rcpp::Rcerr;
+        ctx.line = 0;
+        ctx.column = 0;
+        ctx.size = 0;
+        ctx.data_1.reserve(256u);
+        ctx.status = efyj::status::success;
+        ctx.log_priority = efyj::log_level::info;
+
+        if (thread <= 0) {
+            Rprintf("'thread' must be a positive value.\n");
+            return R_NilValue;
+        }
+
+        Rcpp::XPtr<efyj::model_handle> m(model);
+        Rcpp::XPtr<efyj::dataset_handle> d(dataset);
+
+        std::vector<bool> mask;
+        const auto* mask_ptr = make_mask(aggregates, mask);
+
+        efyj::evaluation_results out;
+        if (const auto ret = efyj::evaluate(ctx,
+                                            *m,
+                                            *d,
+                                            out,
+                                            static_cast<unsigned>(thread),
+                                            mask_ptr);
+            is_bad(ret)) {
+            show_context(ctx);
+            Rprintf("Evaluation failed: %s\n", efyj::get_error_message(ret));
+            return R_NilValue;
+        }
+
+        return make_evaluation_list(out, mask_ptr != nullptr);
     } catch (const std::bad_alloc& e) {
         Rprintf("failed: %s\n", e.what());
     } catch (const std::exception& e) {
@@ -341,6 +591,10 @@ struct result_fn
     const int limit = 0;
     int current_limit = 0;
 
+    std::vector<int> alternative_steps;
+    std::vector<double> alternative_kappa;
+    Rcpp::List alternative_modifiers;
+
     result_fn(std::vector<int>& all_modifiers_,
               std::vector<double>& all_kappa_,
               std::vector<double>& all_time_,
@@ -375,6 +629,19 @@ update_result(const efyj::result& r, void* user_data)
         result->all_kappa.emplace_back(r.kappa);
         result->all_time.emplace_back(r.time);
 
+        for (const auto& alt : r.alternatives) {
+            std::vector<int> modifiers;
+            for (const auto& elem : alt.modifiers) {
+                modifiers.emplace_back(elem.attribute);
+                modifiers.emplace_back(elem.line);
+                modifiers.emplace_back(elem.value);
+            }
+
+            result->alternative_steps.emplace_back(result->current_limit);
+            result->alternative_kappa.emplace_back(alt.kappa);
+            result->alternative_modifiers.push_back(Rcpp::wrap(modifiers));
+        }
+
         ++result->current_limit;
 
         return result->current_limit < result->limit;
@@ -397,9 +664,12 @@ update_result(const efyj::result& r, void* user_data)
 //' @param observed A vector of integers
 //' @param scale_values A vector of integers with the number of aggregate
 //' table times number of row in simulations, places and other vectors.
+//' @param top The number of best candidates kept for each step.
 //'
 //' @return A List with all change in DEXi file to get the better values
-//' the vector the kappa linear and the kappa squared.
+//' the vector the kappa linear and the kappa squared. If top is greater
+//' than one, the list also contains the step, the kappa and the modifiers
+//' of each retained candidate.
 //'
 //' @export
 // [[Rcpp::export]]
@@ -413,7 +683,8 @@ adjustment(const Rcpp::String& model,
            const Rcpp::NumericVector& scale_values,
            const bool reduce,
            const int limit,
-           const int thread)
+           const int thread,
+           const int top = 1)
 {
     try {
         efyj::context ctx;
@@ -451,6 +722,11 @@ adjustment(const Rcpp::String& model,
             return R_NilValue;
         }
 
+        if (top <= 0) {
+            Rprintf("'top' must be a positive value.\n");
+            return R_NilValue;
+        }
+
         efyj::data d;
         d.simulations = Rcpp::as<std::vector<std::string>>(simulations);
         d.places = Rcpp::as<std::vector<std::string>>(places);
@@ -468,13 +744,26 @@ adjustment(const Rcpp::String& model,
                                               nullptr,
                                               reduce,
                                               limit,
-                                              thread);
+                                              thread,
+                                              top);
             is_bad(ret)) {
             const auto msg = efyj::get_error_message(ret);
             Rprintf("Adjustment failed: %s\n", msg);
             return R_NilValue;
         }
 
+        if (top > 1)
+            return Rcpp::List::create(
+              Rcpp::Named("modifiers") = Rcpp::wrap(all_modifiers),
+              Rcpp::Named("kappa") = Rcpp::wrap(all_kappa),
+              Rcpp::Named("time") = Rcpp::wrap(all_time),
+              Rcpp::Named("alternative_steps") =
+                Rcpp::wrap(fn.alternative_steps),
+              Rcpp::Named("alternative_kappa") =
+                Rcpp::wrap(fn.alternative_kappa),
+              Rcpp::Named("alternative_modifiers") =
+                fn.alternative_modifiers);
+
         return Rcpp::List::create(Rcpp::Named("modifiers") =
                                     Rcpp::wrap(all_modifiers),
                                   Rcpp::Named("kappa") = Rcpp::wrap(all_kappa),
@@ -598,6 +887,176 @@ prediction(const Rcpp::String& model,
     return R_NilValue;
 }
 
+//' Adjustment of a model handle with a dataset handle.
+//'
+//' @param model A model handle returned by load_model.
+//' @param dataset A dataset handle returned by load_dataset.
+//' @param reduce Reduces the number of lines to explore.
+//' @param limit The maximum number of modifiers.
+//' @param thread The number of threads.
+//' @param top The number of best candidates kept for each step.
+//'
+//' @return The same List as the adjustment function.
+//'
+//' @export
+// [[Rcpp::export]]
+Rcpp::List
+adjustment_handle(SEXP model,
+                  SEXP dataset,
+                  const bool reduce,
+                  const int limit,
+                  const int thread,
+                  const int top = 1)
+{
+    try {
+        efyj::context ctx;
+        ctx.out = &Rcpp::Rcout;
+        ctx.err = &Rcpp::Rcerr;
+        ctx.line = 0;
+        ctx.column = 0;
+        ctx.size = 0;
+        ctx.data_1.reserve(256u);
+        ctx.status = efyj::status::success;
+        ctx.log_priority = efyj::log_level::info;
+
+        std::vector<int> all_modifiers;
+        std::vector<double> all_kappa;
+        std::vector<double> all_time;
+        result_fn fn(all_modifiers, all_kappa, all_time, limit);
+
+        if (thread <= 0) {
+            Rprintf("'thread' must be a positive value.\n");
+            return R_NilValue;
+        }
+
+        if (top <= 0) {
+            Rprintf("'top' must be a positive value.\n");
+            return R_NilValue;
+        }
+
+        Rcpp::XPtr<efyj::model_handle> m(model);
+        Rcpp::XPtr<efyj::dataset_handle> d(dataset);
+
+        if (const auto ret = efyj::adjustment(ctx,
+                                              *m,
+                                              *d,
+                                              update_result,
+                                              &fn,
+                                              check_user_interrupt,
+                                              nullptr,
+                                              reduce,
+                                              limit,
+                                              static_cast<unsigned>(thread),
+                                              static_cast<unsigned>(top));
+            is_bad(ret)) {
+            show_context(ctx);
+            const auto msg = efyj::get_error_message(ret);
+            Rprintf("Adjustment failed: %s\n", msg);
+            return R_NilValue;
+        }
+
+        if (top > 1)
+            return Rcpp::List::create(
+              Rcpp::Named("modifiers") = Rcpp::wrap(all_modifiers),
+              Rcpp::Named("kappa") = Rcpp::wrap(all_kappa),
+              Rcpp::Named("time") = Rcpp::wrap(all_time),
+              Rcpp::Named("alternative_steps") =
+                Rcpp::wrap(fn.alternative_steps),
+              Rcpp::Named("alternative_kappa") =
+                Rcpp::wrap(fn.alternative_kappa),
+              Rcpp::Named("alternative_modifiers") =
+                fn.alternative_modifiers);
+
+        return Rcpp::List::create(Rcpp::Named("modifiers") =
+                                    Rcpp::wrap(all_modifiers),
+                                  Rcpp::Named("kappa") = Rcpp::wrap(all_kappa),
+                                  Rcpp::Named("time") = Rcpp::wrap(all_time));
+    } catch (const std::bad_alloc& e) {
+        Rprintf("failed: %s\n", e.what());
+    } catch (const std::exception& e) {
+        Rprintf("failed: %s\n", e.what());
+    } catch (...) {
+        Rprintf("failed: unknown error\n");
+    }
+
+    return R_NilValue;
+}
+
+//' Prediction of a model handle with a dataset handle.
+//'
+//' @param model A model handle returned by load_model.
+//' @param dataset A dataset handle returned by load_dataset.
+//' @param reduce Reduces the number of lines to explore.
+//' @param limit The maximum number of modifiers.
+//' @param thread The number of threads.
+//'
+//' @return The same List as the prediction function.
+//'
+//' @export
+// [[Rcpp::export]]
+Rcpp::List
+prediction_handle(SEXP model,
+                  SEXP dataset,
+                  const bool reduce,
+                  const int limit,
+                  const int thread)
+{
+    try {
+        efyj::context ctx;
+        ctx.out = &Rcpp::Rcout;
+        ctx.err = &Rcpp::Rcerr;
+        ctx.line = 0;
+        ctx.column = 0;
+        ctx.size = 0;
+        ctx.data_1.reserve(256u);
+        ctx.status = efyj::status::success;
+        ctx.log_priority = efyj::log_level::info;
+
+        std::vector<int> all_modifiers;
+        std::vector<double> all_kappa;
+        std::vector<double> all_time;
+        result_fn fn(all_modifiers, all_kappa, all_time, limit);
+
+        if (thread <= 0) {
+            Rprintf("'thread' must be a positive value.\n");
+            return R_NilValue;
+        }
+
+        Rcpp::XPtr<efyj::model_handle> m(model);
+        Rcpp::XPtr<efyj::dataset_handle> d(dataset);
+
+        if (const auto ret = efyj::prediction(ctx,
+                                              *m,
+                                              *d,
+                                              update_result,
+                                              &fn,
+                                              check_user_interrupt,
+                                              nullptr,
+                                              reduce,
+                                              limit,
+                                              static_cast<unsigned>(thread));
+            is_bad(ret)) {
+            show_context(ctx);
+            const auto msg = efyj::get_error_message(ret);
+            Rprintf("Prediction failed: %s\n", msg);
+            return R_NilValue;
+        }
+
+        return Rcpp::List::create(Rcpp::Named("modifiers") =
+                                    Rcpp::wrap(all_modifiers),
+                                  Rcpp::Named("kappa") = Rcpp::wrap(all_kappa),
+                                  Rcpp::Named("time") = Rcpp::wrap(all_time));
+    } catch (const std::bad_alloc& e) {
+        Rprintf("failed: %s\n", e.what());
+    } catch (const std::exception& e) {
+        Rprintf("failed: %s\n", e.what());
+    } catch (...) {
+        Rprintf("failed: unknown error\n");
+    }
+
+    return R_NilValue;
+}
+
 //' Extract information from DEXi file.
 //'
 //' This function parses the dexi and returns some informations about DEXi